@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+// micro_bench/macro_bench共用的结果输出: 默认打印表格, 传--json时输出一个JSON对象,
+// 便于保存下来和之前的结果对比
+// SWIFTNET_BUILD_TYPE由CMake传入, 用Makefile编译时为unknown
+
+#ifndef SWIFTNET_BUILD_TYPE
+#define SWIFTNET_BUILD_TYPE "unknown"
+#endif
+
+class BenchReport
+{
+public:
+    BenchReport(const std::string &suite, int argc, char *argv[])
+        : suite_(suite), json_(false)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            if (::strcmp(argv[i], "--json") == 0)
+            {
+                json_ = true;
+            }
+        }
+        if (!json_)
+        {
+            printf("suite=%s build=%s\n", suite_.c_str(), SWIFTNET_BUILD_TYPE);
+            printf("%-32s %14s %-8s %12s\n", "case", "value", "unit", "iterations");
+        }
+    }
+
+    ~BenchReport()
+    {
+        if (json_)
+        {
+            printf("{\"suite\": \"%s\", \"build_type\": \"%s\", \"results\": [", suite_.c_str(), SWIFTNET_BUILD_TYPE);
+            for (size_t i = 0; i < results_.size(); ++i)
+            {
+                const Result &r = results_[i];
+                printf("%s\n  {\"name\": \"%s\", \"value\": %.3f, \"unit\": \"%s\", \"iterations\": %lld}",
+                       i == 0 ? "" : ",", r.name.c_str(), r.value, r.unit.c_str(), r.iterations);
+            }
+            printf("\n]}\n");
+        }
+    }
+
+    // 表格模式下立即打印, 长时间运行时能看到进度
+    void add(const std::string &name, double value, const std::string &unit, long long iterations)
+    {
+        results_.push_back(Result{name, value, unit, iterations});
+        if (!json_)
+        {
+            printf("%-32s %14.2f %-8s %12lld\n", name.c_str(), value, unit.c_str(), iterations);
+            fflush(stdout);
+        }
+    }
+
+private:
+    struct Result
+    {
+        std::string name;
+        double value;
+        std::string unit;
+        long long iterations;
+    };
+
+    std::string suite_;
+    bool json_;
+    std::vector<Result> results_;
+};
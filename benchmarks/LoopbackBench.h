@@ -0,0 +1,93 @@
+#pragma once
+
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/TcpClient.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// macro_bench/uds_bench共用: 服务端跑在单独的线程里, 客户端都在调用方的loop里
+
+// 在单独的线程里构造并运行服务端, 析构时退出loop并在该线程里销毁服务端
+class ServerThread
+{
+public:
+    typedef std::function<std::shared_ptr<void>(EventLoop *)> Setup;
+
+    explicit ServerThread(const Setup &setup)
+        : loop_(nullptr),
+          ready_(false),
+          thread_([this, setup]()
+                  {
+                      EventLoop loop;
+                      std::shared_ptr<void> server = setup(&loop);
+                      loop_ = &loop;
+                      ready_ = true;
+                      loop.loop(); })
+    {
+        while (!ready_)
+        {
+            ::usleep(1000);
+        }
+    }
+
+    ~ServerThread()
+    {
+        EventLoop *loop = loop_;
+        loop_->queueInLoop([loop]()
+                           { loop->quit(); });
+        thread_.join();
+    }
+
+private:
+    EventLoop *loop_;
+    std::atomic<bool> ready_;
+    std::thread thread_;
+};
+
+// 客户端连接都建立后开始计时, seconds秒后退出loop; 返回实际计时的秒数
+// onStart在计时开始时调用, 各项基准在这里清零计数
+inline double runClients(EventLoop *loop, std::vector<std::unique_ptr<TcpClient>> &clients,
+                         std::atomic<int> &connected, double seconds, const std::function<void()> &onStart)
+{
+    for (auto &client : clients)
+    {
+        client->connect();
+    }
+    std::chrono::steady_clock::time_point start;
+    std::function<void()> waitConnected;
+    waitConnected = [&]()
+    {
+        if (connected < static_cast<int>(clients.size()))
+        {
+            loop->runAfter(0.001, waitConnected);
+            return;
+        }
+        start = std::chrono::steady_clock::now();
+        onStart();
+        loop->runAfter(seconds, [loop]()
+                       { loop->quit(); });
+    };
+    loop->runAfter(0.001, waitConnected);
+    loop->loop();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // 断开后再跑一会儿loop, 让连接在loop线程里销毁
+    for (auto &client : clients)
+    {
+        client->disconnect();
+    }
+    loop->runAfter(0.2, [loop]()
+                   { loop->quit(); });
+    loop->loop();
+    clients.clear();
+    loop->runAfter(0.05, [loop]()
+                   { loop->quit(); });
+    loop->loop();
+    return elapsed;
+}
@@ -0,0 +1,130 @@
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/TcpConnection.h>
+#include <swiftNetCore/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// 短连接场景下每个连接在服务端引起的堆分配次数
+// 客户端线程只用系统调用, 不会分配内存, 计数全部来自服务端(accept线程 + 1个IO线程)
+// 每个连接: connect, 发1字节, 收到回显, close
+// 用法: ./conn_alloc_bench [连接数]
+
+static std::atomic<int64_t> g_allocations(0);
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = ::malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    ::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    ::free(p);
+}
+
+static bool pingOnce(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    char c = 'x';
+    bool ok = ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) == 0 &&
+              ::write(fd, &c, 1) == 1 && ::read(fd, &c, 1) == 1;
+    ::close(fd);
+    return ok;
+}
+
+struct Result
+{
+    double allocationsPerConn;
+    double connsPerSecond;
+};
+
+static Result runOnce(uint16_t port, int connections, bool pooled)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "conn_alloc_bench");
+    server.setThreadNum(1);
+    server.setConnectionPool(pooled);
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                              { conn->send(buf); });
+    server.start();
+
+    Result result = {0, 0};
+    std::thread client([&]()
+                       {
+                           // 等连接全部在服务端关闭, 析构和内存归还都已经发生
+                           auto waitIdle = [&]()
+                           {
+                               while (server.connectionCount() != 0)
+                               {
+                                   ::usleep(1000);
+                               }
+                               ::usleep(20 * 1000);
+                           };
+                           // 预热: 填满对象池, 让各个容器长到稳定大小
+                           for (int i = 0; i < 200; ++i)
+                           {
+                               pingOnce(port);
+                           }
+                           waitIdle();
+
+                           int64_t before = g_allocations.load();
+                           auto start = std::chrono::steady_clock::now();
+                           for (int i = 0; i < connections; ++i)
+                           {
+                               if (!pingOnce(port))
+                               {
+                                   fprintf(stderr, "connection %d failed\n", i);
+                               }
+                           }
+                           auto end = std::chrono::steady_clock::now();
+                           waitIdle();
+                           int64_t allocations = g_allocations.load() - before;
+
+                           result.allocationsPerConn = static_cast<double>(allocations) / connections;
+                           result.connsPerSecond = connections / std::chrono::duration<double>(end - start).count();
+                           loop.queueInLoop([&]()
+                                            { loop.quit(); }); });
+    loop.loop();
+    client.join();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : 5000;
+
+    printf("connections=%d\n", connections);
+    printf("%-10s %12s %12s\n", "mode", "allocs/conn", "conns/s");
+    Result plain = runOnce(19890, connections, false);
+    printf("%-10s %12.2f %12.0f\n", "new", plain.allocationsPerConn, plain.connsPerSecond);
+    Result pooled = runOnce(19891, connections, true);
+    printf("%-10s %12.2f %12.0f\n", "pooled", pooled.allocationsPerConn, pooled.connsPerSecond);
+    return 0;
+}
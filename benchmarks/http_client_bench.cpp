@@ -0,0 +1,136 @@
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/Logger.h>
+#include <swiftNetCore/http/HttpClientPool.h>
+#include <swiftNetCore/http/HttpRequest.h>
+#include <swiftNetCore/http/HttpResponse.h>
+#include <swiftNetCore/http/HttpServer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <unistd.h>
+
+// HttpClientPool对本机HttpServer的吞吐
+// 每个调用方收到响应后立刻发下一个请求(闭环), 并发数就是同时在途的请求数
+// 服务端单独一个线程, 客户端的连接都在主线程的loop里, 每个主机最多min(并发数, 64)个连接
+// 用法: ./http_client_bench [每档秒数]
+
+static const uint16_t kPort = 19892;
+
+struct Run
+{
+  HttpClientPool *pool;
+  InetAddress upstream;
+  HttpRequest request;
+  std::chrono::steady_clock::time_point deadline;
+  int64_t completed;
+  int64_t failed;
+  int outstanding;
+  EventLoop *loop;
+};
+
+// 只在客户端loop线程里调用
+static void issue(Run *run)
+{
+  ++run->outstanding;
+  run->pool->send(run->upstream, run->request, [run](const HttpResponse &resp)
+                  {
+                    --run->outstanding;
+                    if (resp.statusCode() == HttpResponse::k200Ok)
+                    {
+                      ++run->completed;
+                    }
+                    else
+                    {
+                      ++run->failed;
+                    }
+                    if (std::chrono::steady_clock::now() < run->deadline)
+                    {
+                      issue(run);
+                    }
+                    else if (run->outstanding == 0)
+                    {
+                      run->loop->queueInLoop([run]()
+                                             { run->loop->quit(); });
+                    } });
+}
+
+static void runOnce(EventLoop *loop, int callers, double seconds)
+{
+  int connections = std::min(callers, 64);
+  HttpClientPool pool(loop, "http_client_bench");
+  pool.setMaxConnectionsPerHost(connections);
+  pool.start();
+
+  Run run;
+  run.pool = &pool;
+  run.upstream = InetAddress(kPort, "127.0.0.1");
+  const char *method = "GET";
+  run.request.setMethod(method, method + 3);
+  run.request.setPath("/hello");
+  run.request.setVersion(HttpRequest::kHttp11);
+  run.request.addHeader("Host", "127.0.0.1");
+  run.completed = 0;
+  run.failed = 0;
+  run.outstanding = 0;
+  run.loop = loop;
+
+  // 连接都放在loop里, 请求的发起和回调在同一个线程, Run不用加锁
+  auto start = std::chrono::steady_clock::now();
+  loop->runAfter(0.0, [&]()
+                 {
+                   run.deadline = std::chrono::steady_clock::now() +
+                                  std::chrono::microseconds(static_cast<int64_t>(seconds * 1000 * 1000));
+                   start = std::chrono::steady_clock::now();
+                   for (int i = 0; i < callers; ++i)
+                   {
+                     issue(&run);
+                   } });
+  loop->loop();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%8d %12d %12.0f %10lld\n", callers, connections,
+         run.completed / elapsed, static_cast<long long>(run.failed));
+}
+
+int main(int argc, char *argv[])
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+  Logger::instance().setMinLogLevel(LogLevel::WARN);
+
+  EventLoop *serverLoop = nullptr;
+  std::atomic<bool> serverReady(false);
+  std::thread serverThread([&]()
+                           {
+                             EventLoop loop;
+                             HttpServer server(&loop, InetAddress(kPort), "http_client_bench");
+                             server.setHttpCallback([](const HttpRequest &, HttpResponse *resp)
+                                                    {
+                                                      resp->setStatusCode(HttpResponse::k200Ok);
+                                                      resp->setStatusMessage("OK");
+                                                      resp->setContentType("text/plain");
+                                                      resp->setBody("hello, world!\n"); });
+                             server.start();
+                             serverLoop = &loop;
+                             serverReady = true;
+                             loop.loop(); });
+  while (!serverReady)
+  {
+    ::usleep(1000);
+  }
+
+  EventLoop loop;
+  printf("%8s %12s %12s %10s\n", "callers", "connections", "req/s", "failed");
+  runOnce(&loop, 1, seconds);
+  runOnce(&loop, 16, seconds);
+  runOnce(&loop, 256, seconds);
+
+  serverLoop->queueInLoop([serverLoop]()
+                          { serverLoop->quit(); });
+  serverThread.join();
+  return 0;
+}
@@ -0,0 +1,220 @@
+#include "BenchReport.h"
+#include "LoopbackBench.h"
+
+#include <swiftNetCore/Buffer.h>
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/Logger.h>
+#include <swiftNetCore/TcpClient.h>
+#include <swiftNetCore/TcpConnection.h>
+#include <swiftNetCore/TcpServer.h>
+#include <swiftNetCore/http/HttpContext.h>
+#include <swiftNetCore/http/HttpRequest.h>
+#include <swiftNetCore/http/HttpResponse.h>
+#include <swiftNetCore/http/HttpServer.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// 本机回环上的端到端基准: 服务端单独一个线程, 客户端都在主线程的loop里
+// 用法: ./macro_bench [--json] [每项秒数, 默认2]
+
+static const uint16_t kEchoPort = 19893;
+static const uint16_t kHttpPort = 19894;
+static const uint16_t kChurnPort = 19895;
+
+// 每个会话先发一个块, 之后把收到的数据原样发回去, 服务端也是回显
+static void benchEchoPingpong(BenchReport &report, EventLoop *loop, double seconds, int sessions, size_t blockSize)
+{
+    ServerThread server([](EventLoop *serverLoop)
+                        {
+                            std::shared_ptr<TcpServer> s(new TcpServer(serverLoop, InetAddress(kEchoPort), "echo"));
+                            s->setConnectionCallback([](const TcpConnectionPtr &conn)
+                                                     {
+                                                         if (conn->connected())
+                                                         {
+                                                             conn->setTcpNoDelay(true);
+                                                         } });
+                            s->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                  { conn->send(buf); });
+                            s->start();
+                            return std::shared_ptr<void>(s); });
+
+    std::string block(blockSize, 'x');
+    std::atomic<int> connected(0);
+    int64_t bytesRead = 0;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    for (int i = 0; i < sessions; ++i)
+    {
+        clients.emplace_back(new TcpClient(loop, InetAddress(kEchoPort, "127.0.0.1"), "pingpong"));
+        clients.back()->setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                              {
+                                                  if (conn->connected())
+                                                  {
+                                                      conn->setTcpNoDelay(true);
+                                                      conn->send(block);
+                                                      ++connected;
+                                                  } });
+        clients.back()->setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                           {
+                                               bytesRead += buf->readableBytes();
+                                               conn->send(buf); });
+    }
+    double elapsed = runClients(loop, clients, connected, seconds, [&]()
+                                { bytesRead = 0; });
+    report.add("echo_pingpong_" + std::to_string(sessions) + "x" + std::to_string(blockSize / 1024) + "KiB",
+               bytesRead / elapsed / 1024 / 1024, "MiB/s", bytesRead / static_cast<int64_t>(blockSize));
+}
+
+// 闭环的HTTP hello world, 每个连接收到完整响应后立刻发下一个请求
+static void benchHttpHello(BenchReport &report, EventLoop *loop, double seconds, int connections)
+{
+    ServerThread server([](EventLoop *serverLoop)
+                        {
+                            std::shared_ptr<HttpServer> s(new HttpServer(serverLoop, InetAddress(kHttpPort), "hello"));
+                            s->setHttpCallback([](const HttpRequest &, HttpResponse *resp)
+                                               {
+                                                   resp->setStatusCode(HttpResponse::k200Ok);
+                                                   resp->setStatusMessage("OK");
+                                                   resp->setContentType("text/plain");
+                                                   resp->setBody("hello, world!\n"); });
+                            s->start();
+                            return std::shared_ptr<void>(s); });
+
+    HttpRequest req;
+    req.setMethod(HttpRequest::kGet);
+    req.setPath("/hello");
+    req.setVersion(HttpRequest::kHttp11);
+    req.addHeader("Host", "127.0.0.1");
+    Buffer wire;
+    req.appendToBuffer(&wire);
+    std::string request = wire.retrieveAllAsString();
+
+    std::atomic<int> connected(0);
+    int64_t completed = 0;
+    int64_t failed = 0;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    std::vector<std::unique_ptr<HttpContext>> contexts;
+    for (int i = 0; i < connections; ++i)
+    {
+        HttpContext *context = new HttpContext;
+        contexts.emplace_back(context);
+        clients.emplace_back(new TcpClient(loop, InetAddress(kHttpPort, "127.0.0.1"), "hello"));
+        clients.back()->setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                              {
+                                                  if (conn->connected())
+                                                  {
+                                                      conn->setTcpNoDelay(true);
+                                                      conn->send(request);
+                                                      ++connected;
+                                                  } });
+        clients.back()->setMessageCallback([&, context](const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+                                           {
+                                               while (buf->readableBytes() > 0)
+                                               {
+                                                   if (!context->parseResponse(buf, receiveTime))
+                                                   {
+                                                       ++failed;
+                                                       conn->forceClose();
+                                                       return;
+                                                   }
+                                                   if (!context->gotAll())
+                                                   {
+                                                       break;
+                                                   }
+                                                   if (context->response().statusCode() == HttpResponse::k200Ok)
+                                                   {
+                                                       ++completed;
+                                                   }
+                                                   else
+                                                   {
+                                                       ++failed;
+                                                   }
+                                                   context->reset();
+                                                   conn->send(request);
+                                               } });
+    }
+    double elapsed = runClients(loop, clients, connected, seconds, [&]()
+                                {
+                                    completed = 0;
+                                    failed = 0; });
+    if (failed > 0)
+    {
+        fprintf(stderr, "http_hello: %lld failed responses\n", static_cast<long long>(failed));
+    }
+    report.add("http_hello_" + std::to_string(connections) + "conn", completed / elapsed, "req/s", completed);
+}
+
+// 短连接: 服务端一建立连接就关闭, 客户端断开后TcpClient立刻重连
+// 由服务端先关闭, TIME_WAIT留在服务端, 不会耗尽客户端的临时端口
+static void benchConnectionChurn(BenchReport &report, EventLoop *loop, double seconds, int clientsNum)
+{
+    ServerThread server([](EventLoop *serverLoop)
+                        {
+                            std::shared_ptr<TcpServer> s(new TcpServer(serverLoop, InetAddress(kChurnPort), "churn"));
+                            s->setConnectionCallback([](const TcpConnectionPtr &conn)
+                                                     {
+                                                         if (conn->connected())
+                                                         {
+                                                             conn->shutdown();
+                                                         } });
+                            s->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                                                  { buf->retrieveAll(); });
+                            s->start();
+                            return std::shared_ptr<void>(s); });
+
+    std::atomic<int> connected(0);
+    int64_t established = 0;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    for (int i = 0; i < clientsNum; ++i)
+    {
+        clients.emplace_back(new TcpClient(loop, InetAddress(kChurnPort, "127.0.0.1"), "churn"));
+        clients.back()->enableRetry();
+        std::shared_ptr<bool> first(new bool(true));
+        clients.back()->setConnectionCallback([&, first](const TcpConnectionPtr &conn)
+                                              {
+                                                  if (conn->connected())
+                                                  {
+                                                      ++established;
+                                                      if (*first)
+                                                      {
+                                                          *first = false;
+                                                          ++connected;
+                                                      }
+                                                  } });
+        clients.back()->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                                           { buf->retrieveAll(); });
+    }
+    double elapsed = runClients(loop, clients, connected, seconds, [&]()
+                                { established = 0; });
+    report.add("connection_churn_" + std::to_string(clientsNum) + "clients", established / elapsed, "conn/s", established);
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = 2.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] != '-')
+        {
+            seconds = atof(argv[i]);
+        }
+    }
+    Logger::instance().setMinLogLevel(LogLevel::ERROR);
+
+    BenchReport report("macro", argc, argv);
+    EventLoop loop;
+    benchEchoPingpong(report, &loop, seconds, 1, 16 * 1024);
+    benchEchoPingpong(report, &loop, seconds, 16, 16 * 1024);
+    benchHttpHello(report, &loop, seconds, 1);
+    benchHttpHello(report, &loop, seconds, 32);
+    benchConnectionChurn(report, &loop, seconds, 8);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <swiftNetCore/Metrics.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+// 对比分片计数器与单个共享原子变量的写入开销, 说明指标常开的代价
+// 用法: ./metrics_bench [线程数] [每线程迭代次数]
+
+static std::atomic<int64_t> g_shared(0);
+
+template <typename Func>
+double runThreads(int numThreads, int64_t iterations, Func func)
+{
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back([&]()
+                             {
+                                 for (int64_t n = 0; n < iterations; ++n)
+                                 {
+                                     func();
+                                 } });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    return ns / iterations; // 每个线程每次操作的耗时
+}
+
+int main(int argc, char *argv[])
+{
+    int numThreads = argc > 1 ? atoi(argv[1]) : static_cast<int>(std::thread::hardware_concurrency());
+    int64_t iterations = argc > 2 ? atoll(argv[2]) : 20 * 1000 * 1000;
+    if (numThreads < 1)
+    {
+        numThreads = 1;
+    }
+
+    Counter &counter = MetricsRegistry::instance().counter("bench_counter_total", "benchmark counter");
+    Gauge &gauge = MetricsRegistry::instance().gauge("bench_gauge", "benchmark gauge");
+    volatile int64_t plain = 0;
+
+    printf("threads=%d iterations=%lld\n", numThreads, static_cast<long long>(iterations));
+    printf("%-28s %10s\n", "case", "ns/op");
+
+    printf("%-28s %10.2f\n", "plain increment (1 thread)",
+           runThreads(1, iterations, [&]()
+                      { plain = plain + 1; }));
+    printf("%-28s %10.2f\n", "Counter::inc (1 thread)",
+           runThreads(1, iterations, [&]()
+                      { counter.inc(); }));
+    printf("%-28s %10.2f\n", "Gauge::inc/dec (1 thread)",
+           runThreads(1, iterations, [&]()
+                      { gauge.inc(); gauge.dec(); }));
+    printf("%-28s %10.2f\n", "shared atomic (1 thread)",
+           runThreads(1, iterations, [&]()
+                      { g_shared.fetch_add(1, std::memory_order_relaxed); }));
+    printf("%-28s %10.2f\n", "Counter::inc (N threads)",
+           runThreads(numThreads, iterations, [&]()
+                      { counter.inc(); }));
+    printf("%-28s %10.2f\n", "shared atomic (N threads)",
+           runThreads(numThreads, iterations, [&]()
+                      { g_shared.fetch_add(1, std::memory_order_relaxed); }));
+
+    auto start = std::chrono::steady_clock::now();
+    std::string text;
+    for (int i = 0; i < 1000; ++i)
+    {
+        text.clear();
+        MetricsRegistry::instance().writePrometheus(&text);
+    }
+    auto end = std::chrono::steady_clock::now();
+    printf("%-28s %10.2f\n", "writePrometheus (us/scrape)",
+           std::chrono::duration<double, std::micro>(end - start).count() / 1000);
+
+    int64_t expected = iterations * (1 + numThreads);
+    if (counter.value() != expected)
+    {
+        printf("counter mismatch: %lld != %lld\n",
+               static_cast<long long>(counter.value()), static_cast<long long>(expected));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,240 @@
+#include "BenchReport.h"
+
+#include <swiftNetCore/Buffer.h>
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/EventLoopThread.h>
+#include <swiftNetCore/Logger.h>
+#include <swiftNetCore/Timestamp.h>
+#include <swiftNetCore/http/HttpContext.h>
+#include <swiftNetCore/http/HttpResponse.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 热点路径的微基准, 单线程循环调用, 结果为每次操作的纳秒数
+// 用法: ./micro_bench [--json] [迭代次数倍数, 默认1]
+
+static const char kRequest[] =
+    "GET /api/v1/items?id=12345&fields=name,price HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8000\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef\r\n"
+    "\r\n";
+
+// 阻止编译器把被测代码当作无用代码删掉
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+template <typename Func>
+double nsPerOp(long long iterations, Func func)
+{
+    // 先跑一小段预热缓存和分支预测
+    for (long long i = 0; i < iterations / 10; ++i)
+    {
+        func();
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < iterations; ++i)
+    {
+        func();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+static void benchBuffer(BenchReport &report, long long scale)
+{
+    Buffer buf;
+    std::string small(64, 'x');
+    long long n = 20 * 1000 * 1000 * scale;
+    report.add("buffer_append_retrieve_64B", nsPerOp(n, [&]()
+                                                    {
+                                                        buf.append(small);
+                                                        doNotOptimize(*buf.peek());
+                                                        buf.retrieve(small.size()); }),
+               "ns/op", n);
+
+    std::string large(4096, 'x');
+    n = 2 * 1000 * 1000 * scale;
+    report.add("buffer_append_retrieve_4KiB", nsPerOp(n, [&]()
+                                                     {
+                                                         buf.append(large);
+                                                         doNotOptimize(*buf.peek());
+                                                         buf.retrieve(large.size()); }),
+               "ns/op", n);
+
+    // 攒满64KiB再一次取走, 包含扩容/挪动数据的开销
+    n = 200 * 1000 * scale;
+    report.add("buffer_append_16x4KiB_retrieve", nsPerOp(n, [&]()
+                                                        {
+                                                            for (int i = 0; i < 16; ++i)
+                                                            {
+                                                                buf.append(large);
+                                                            }
+                                                            doNotOptimize(*buf.peek());
+                                                            buf.retrieveAll(); }),
+               "ns/op", n);
+}
+
+static void benchFindCRLF(BenchReport &report, long long scale)
+{
+    Buffer buf;
+    buf.append(kRequest, sizeof kRequest - 1);
+    long long n = 2 * 1000 * 1000 * scale;
+    // 扫完一个完整请求头里的所有行
+    report.add("find_crlf_request_headers", nsPerOp(n, [&]()
+                                                   {
+                                                       const char *start = buf.peek();
+                                                       const char *crlf;
+                                                       while ((crlf = buf.findCRLF(start)) != NULL)
+                                                       {
+                                                           start = crlf + 2;
+                                                       }
+                                                       doNotOptimize(start); }),
+               "ns/op", n);
+}
+
+static void benchHttpParse(BenchReport &report, long long scale)
+{
+    Buffer buf;
+    HttpContext context;
+    Timestamp now = Timestamp::now();
+    bool ok = true;
+    long long n = 500 * 1000 * scale;
+    report.add("http_context_parse_request", nsPerOp(n, [&]()
+                                                    {
+                                                        buf.append(kRequest, sizeof kRequest - 1);
+                                                        ok = context.parseRequest(&buf, now) && context.gotAll() && ok;
+                                                        context.reset(); }),
+               "ns/op", n);
+    if (!ok)
+    {
+        fprintf(stderr, "http_context_parse_request: parse failed\n");
+        exit(1);
+    }
+
+    const char response[] = "HTTP/1.1 200 OK\r\n"
+                            "Content-Length: 14\r\n"
+                            "Connection: Keep-Alive\r\n"
+                            "Content-Type: text/plain\r\n"
+                            "Server: swiftNetCore\r\n"
+                            "\r\n"
+                            "hello, world!\n";
+    report.add("http_context_parse_response", nsPerOp(n, [&]()
+                                                     {
+                                                         buf.append(response, sizeof response - 1);
+                                                         ok = context.parseResponse(&buf, now) && context.gotAll() && ok;
+                                                         context.reset(); }),
+               "ns/op", n);
+    if (!ok)
+    {
+        fprintf(stderr, "http_context_parse_response: parse failed\n");
+        exit(1);
+    }
+}
+
+static void benchHttpSerialize(BenchReport &report, long long scale)
+{
+    HttpResponse resp(false);
+    resp.setStatusCode(HttpResponse::k200Ok);
+    resp.setStatusMessage("OK");
+    resp.setContentType("text/plain");
+    resp.addHeader("Server", "swiftNetCore");
+    resp.setBody("hello, world!\n");
+    Buffer buf;
+    long long n = 2 * 1000 * 1000 * scale;
+    report.add("http_response_serialize", nsPerOp(n, [&]()
+                                                 {
+                                                     resp.appendToBuffer(&buf);
+                                                     doNotOptimize(*buf.peek());
+                                                     buf.retrieveAll(); }),
+               "ns/op", n);
+}
+
+static void benchTimer(BenchReport &report, long long scale)
+{
+    // 在loop所在线程里调用, runAfter/cancel都是同步执行的, 不需要跑loop
+    EventLoop loop;
+    long long n = 500 * 1000 * scale;
+    report.add("timer_add_cancel", nsPerOp(n, [&]()
+                                          {
+                                              TimerId id = loop.runAfter(3600.0, []() {});
+                                              loop.cancel(id); }),
+               "ns/op", n);
+
+    // 已有大量定时器时再增删, 看红黑树深度的影响
+    std::vector<TimerId> background;
+    for (int i = 0; i < 10000; ++i)
+    {
+        background.push_back(loop.runAfter(3600.0 + i, []() {}));
+    }
+    report.add("timer_add_cancel_10k_pending", nsPerOp(n, [&]()
+                                                      {
+                                                          TimerId id = loop.runAfter(1800.0, []() {});
+                                                          loop.cancel(id); }),
+               "ns/op", n);
+    for (const TimerId &id : background)
+    {
+        loop.cancel(id);
+    }
+}
+
+static void benchQueueInLoop(BenchReport &report, long long scale)
+{
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+    std::atomic<long long> executed(0);
+    long long n = 1000 * 1000 * scale;
+    // 一个线程不停地往loop投递, 计到loop线程全部执行完为止, 包含唤醒的开销
+    double ns = nsPerOp(1, [&]()
+                        {
+                            executed = 0;
+                            for (long long i = 0; i < n; ++i)
+                            {
+                                loop->queueInLoop([&executed]()
+                                                  { executed.store(executed.load(std::memory_order_relaxed) + 1,
+                                                                   std::memory_order_release); });
+                            }
+                            while (executed.load(std::memory_order_acquire) < n)
+                            {
+                                std::this_thread::yield();
+                            } });
+    report.add("queue_in_loop_cross_thread", ns / n, "ns/op", n);
+}
+
+int main(int argc, char *argv[])
+{
+    long long scale = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] != '-')
+        {
+            scale = atoll(argv[i]);
+        }
+    }
+    if (scale < 1)
+    {
+        scale = 1;
+    }
+    Logger::instance().setMinLogLevel(LogLevel::ERROR);
+
+    BenchReport report("micro", argc, argv);
+    benchBuffer(report, scale);
+    benchFindCRLF(report, scale);
+    benchHttpParse(report, scale);
+    benchHttpSerialize(report, scale);
+    benchTimer(report, scale);
+    benchQueueInLoop(report, scale);
+    return 0;
+}
@@ -0,0 +1,244 @@
+#include <swiftNetCore/Buffer.h>
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/EventLoopThreadPool.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/Logger.h>
+#include <swiftNetCore/TcpClient.h>
+#include <swiftNetCore/TcpConnection.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// pingpong吞吐测试的客户端: 每个会话连上后先发一个块, 之后把收到的数据原样发回
+// 会话按轮询分到各IO线程, 每个块大小各测一轮, 报告客户端收到的MiB/s
+// 用法: ./pingpong_client <host> <port> <IO线程数> <会话数> <每轮秒数> [块大小...]
+// 不给块大小时依次测16B, 64B, ... 1MiB
+
+namespace
+{
+
+std::atomic<int> g_connected(0);
+std::atomic<int> g_disconnected(0);
+
+// 除构造外都在所属loop线程里执行
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &block, int id)
+        : client_(loop, serverAddr, "pingpong#" + std::to_string(id)),
+          block_(block),
+          bytesRead_(0),
+          stopping_(false)
+    {
+        client_.setConnectionCallback([this](const TcpConnectionPtr &conn)
+                                      { onConnection(conn); });
+        client_.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                   { onMessage(conn, buf); });
+    }
+
+    void start() { client_.connect(); }
+
+    // 不再回发, 等输出缓冲区写完后半关闭, 服务端随后关闭连接
+    void stop()
+    {
+        stopping_ = true;
+        client_.disconnect();
+    }
+
+    int64_t bytesRead() const { return bytesRead_.load(std::memory_order_relaxed); }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            conn->send(block_);
+            ++g_connected;
+        }
+        else
+        {
+            ++g_disconnected;
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf)
+    {
+        bytesRead_.store(bytesRead_.load(std::memory_order_relaxed) + buf->readableBytes(),
+                         std::memory_order_relaxed);
+        if (stopping_)
+        {
+            buf->retrieveAll();
+        }
+        else
+        {
+            conn->send(buf);
+        }
+    }
+
+    TcpClient client_;
+    const std::string &block_;
+    std::atomic<int64_t> bytesRead_; // 只由loop线程写入
+    bool stopping_;
+};
+
+// 在loop线程里执行f并等它完成
+template <typename F>
+void runAndWait(EventLoop *loop, F f)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        f();
+                        done.set_value(); });
+    done.get_future().wait();
+}
+
+template <typename Pred>
+bool waitFor(Pred pred, double seconds)
+{
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(static_cast<int64_t>(seconds * 1000 * 1000));
+    while (!pred())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        ::usleep(1000);
+    }
+    return true;
+}
+
+std::string formatSize(size_t bytes)
+{
+    if (bytes >= 1024 * 1024)
+    {
+        return std::to_string(bytes / 1024 / 1024) + "MiB";
+    }
+    if (bytes >= 1024)
+    {
+        return std::to_string(bytes / 1024) + "KiB";
+    }
+    return std::to_string(bytes) + "B";
+}
+
+// 跑一轮, 返回MiB/s, 出错时返回负数
+double runRound(const std::vector<EventLoop *> &loops, const InetAddress &serverAddr,
+                int sessionCount, double seconds, size_t blockSize)
+{
+    std::string block(blockSize, 'x');
+    g_connected = 0;
+    g_disconnected = 0;
+    std::vector<std::unique_ptr<Session>> sessions;
+    for (int i = 0; i < sessionCount; ++i)
+    {
+        sessions.emplace_back(new Session(loops[i % loops.size()], serverAddr, block, i));
+    }
+    for (auto &session : sessions)
+    {
+        session->start();
+    }
+    if (!waitFor([&]()
+                 { return g_connected == sessionCount; },
+                 5.0))
+    {
+        fprintf(stderr, "only %d of %d sessions connected\n", g_connected.load(), sessionCount);
+        return -1;
+    }
+
+    // 连接都建立后才开始计数, 排除建连和慢启动的抖动
+    auto sum = [&]()
+    {
+        int64_t total = 0;
+        for (auto &session : sessions)
+        {
+            total += session->bytesRead();
+        }
+        return total;
+    };
+    int64_t startBytes = sum();
+    auto start = std::chrono::steady_clock::now();
+    ::usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    int64_t bytes = sum() - startBytes;
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (int i = 0; i < sessionCount; ++i)
+    {
+        Session *session = sessions[i].get();
+        loops[i % loops.size()]->runInLoop([session]()
+                                           { session->stop(); });
+    }
+    if (!waitFor([&]()
+                 { return g_disconnected == sessionCount; },
+                 10.0))
+    {
+        fprintf(stderr, "only %d of %d sessions closed\n", g_disconnected.load(), sessionCount);
+    }
+    for (int i = 0; i < sessionCount; ++i)
+    {
+        runAndWait(loops[i % loops.size()], [&]()
+                   { sessions[i].reset(); });
+    }
+    return bytes / elapsed / 1024 / 1024;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc < 6)
+    {
+        fprintf(stderr, "usage: %s <host> <port> <threads> <sessions> <seconds> [blocksize...]\n", argv[0]);
+        return 1;
+    }
+    InetAddress serverAddr(static_cast<uint16_t>(atoi(argv[2])), argv[1]);
+    int threads = atoi(argv[3]);
+    int sessionCount = atoi(argv[4]);
+    double seconds = atof(argv[5]);
+    if (threads < 1 || sessionCount < 1 || seconds <= 0)
+    {
+        fprintf(stderr, "threads and sessions must be at least 1, seconds must be positive\n");
+        return 1;
+    }
+    std::vector<size_t> blockSizes;
+    for (int i = 6; i < argc; ++i)
+    {
+        blockSizes.push_back(static_cast<size_t>(atol(argv[i])));
+    }
+    if (blockSizes.empty())
+    {
+        for (size_t size = 16; size <= 1024 * 1024; size *= 4)
+        {
+            blockSizes.push_back(size);
+        }
+    }
+    Logger::instance().setMinLogLevel(LogLevel::WARN);
+
+    EventLoop baseLoop;
+    EventLoopThreadPool pool(&baseLoop, "pingpong");
+    pool.setThreadNum(threads);
+    pool.start();
+    std::vector<EventLoop *> loops = pool.getAllLoops();
+
+    printf("%-8s %8s %8s %12s %14s\n", "block", "threads", "sessions", "MiB/s", "blocks/s");
+    for (size_t blockSize : blockSizes)
+    {
+        double mibps = runRound(loops, serverAddr, sessionCount, seconds, blockSize);
+        if (mibps < 0)
+        {
+            return 1;
+        }
+        printf("%-8s %8d %8d %12.2f %14.0f\n", formatSize(blockSize).c_str(), threads, sessionCount,
+               mibps, mibps * 1024 * 1024 / blockSize);
+        fflush(stdout);
+    }
+    return 0;
+}
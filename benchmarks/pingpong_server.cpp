@@ -0,0 +1,41 @@
+#include <swiftNetCore/Buffer.h>
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/Logger.h>
+#include <swiftNetCore/TcpConnection.h>
+#include <swiftNetCore/TcpServer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// pingpong吞吐测试的服务端, 把收到的数据原样发回, 配合pingpong_client使用
+// 直接把输入Buffer交给send(Buffer*), 在loop线程里写出去, 不经过std::string
+// 用法: ./pingpong_server <端口> [IO线程数, 默认0即只用主loop]
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <port> [sub-loops]\n", argv[0]);
+        return 1;
+    }
+    uint16_t port = static_cast<uint16_t>(atoi(argv[1]));
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+    Logger::instance().setMinLogLevel(LogLevel::WARN);
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "pingpong");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn)
+                                 {
+                                     if (conn->connected())
+                                     {
+                                         conn->setTcpNoDelay(true);
+                                     } });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                              { conn->send(buf); });
+    server.setThreadNum(threads);
+    server.start();
+    printf("pingpong server listening on %d with %d sub-loops\n", port, threads);
+    loop.loop();
+    return 0;
+}
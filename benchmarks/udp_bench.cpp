@@ -0,0 +1,241 @@
+#include "BenchReport.h"
+#include "LoopbackBench.h"
+
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/Logger.h>
+#include <swiftNetCore/UdpServer.h>
+#include <swiftNetCore/UdpSocket.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdlib.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <vector>
+
+// 回环上的UDP收发包速率, 服务端是单独线程里的UdpServer, 客户端的UdpSocket都在主线程的loop里
+//   sink: 客户端每轮循环给每个套接字排64个64字节的报文, 服务端只计数, 比较recvmmsg每批1个和64个,
+//         以及两个SO_REUSEPORT套接字分到两个loop
+//   echo: 每个客户端套接字保持256个报文在途, 服务端原样回显, 比较回复逐个sendmmsg和合并成GSO报文
+// 除了每秒包数, 还给出服务端loop线程每CPU秒处理的包数(pps/core), 单核机器上发送方和接收方抢同一个核,
+// 后者更能反映每个包的开销
+// 用法: ./udp_bench [--json] [每项秒数, 默认2]
+
+namespace
+{
+
+const uint16_t kUdpPort = 19898;
+const size_t kPayloadSize = 64;
+const int kBurst = 64;
+const int kEchoWindow = 256;
+
+struct Case
+{
+    std::string name;
+    int serverThreads; // 0表示只用baseloop一个套接字
+    int batchSize;
+    bool echo;
+    bool gso;
+};
+
+// 客户端一侧的状态, 排进loop的函数持有它的shared_ptr, 一项跑完后残留的函数看到running为false直接返回
+struct ClientState
+{
+    InetAddress server;
+    std::string payload;
+    std::vector<UdpSocketPtr> sockets;
+    bool running = true;
+    int64_t sent = 0;
+    int64_t received = 0;
+    int64_t lastReceived = 0;
+};
+using ClientStatePtr = std::shared_ptr<ClientState>;
+
+double threadCpuSeconds()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// 服务端各个loop线程到目前为止用掉的CPU时间之和
+double serverCpuSeconds(const std::shared_ptr<UdpServer> &server)
+{
+    double total = 0;
+    for (const UdpSocketPtr &socket : server->sockets())
+    {
+        std::promise<double> cpu;
+        socket->getLoop()->runInLoop([&cpu]()
+                                     { cpu.set_value(threadCpuSeconds()); });
+        total += cpu.get_future().get();
+    }
+    return total;
+}
+
+void sendBurst(const ClientStatePtr &state, const UdpSocketPtr &socket, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        socket->sendTo(state->server, state->payload.data(), state->payload.size());
+    }
+    state->sent += count;
+}
+
+// sink: 每轮循环给发送队列已经清空的套接字再排一批, 接收方来不及收时由内核丢弃
+void pump(EventLoop *loop, const ClientStatePtr &state)
+{
+    if (!state->running)
+    {
+        return;
+    }
+    for (const UdpSocketPtr &socket : state->sockets)
+    {
+        if (socket->pendingBytes() == 0)
+        {
+            sendBurst(state, socket, kBurst);
+        }
+    }
+    loop->queueInLoop([loop, state]()
+                      { pump(loop, state); });
+}
+
+// echo: 回环上缓冲区满了也会丢包, 50ms没有收到任何回复就给每个套接字补满窗口
+void checkStall(EventLoop *loop, const ClientStatePtr &state)
+{
+    if (!state->running)
+    {
+        return;
+    }
+    if (state->received == state->lastReceived)
+    {
+        for (const UdpSocketPtr &socket : state->sockets)
+        {
+            sendBurst(state, socket, kEchoWindow);
+        }
+    }
+    state->lastReceived = state->received;
+    loop->runAfter(0.05, [loop, state]()
+                   { checkStall(loop, state); });
+}
+
+void runCase(BenchReport &report, EventLoop *loop, double seconds, const Case &c, int clientSockets)
+{
+    std::atomic<int64_t> serverReceived(0);
+    std::shared_ptr<UdpServer> server;
+    ServerThread serverThread([&](EventLoop *serverLoop)
+                              {
+                                  server.reset(new UdpServer(serverLoop, InetAddress(kUdpPort, "127.0.0.1"), "udp_bench"));
+                                  server->setThreadNum(c.serverThreads);
+                                  server->setBatchSize(c.batchSize);
+                                  server->setGso(c.gso);
+                                  bool echo = c.echo;
+                                  server->setMessageCallback([&serverReceived, echo](const UdpSocketPtr &socket, const char *data, size_t len,
+                                                                                     const InetAddress &peer, Timestamp)
+                                                             {
+                                                                 serverReceived.fetch_add(1, std::memory_order_relaxed);
+                                                                 if (echo)
+                                                                 {
+                                                                     socket->sendTo(peer, data, len);
+                                                                 } });
+                                  server->start();
+                                  return std::shared_ptr<void>(server); });
+
+    ClientStatePtr state(new ClientState);
+    state->server = server->localAddress();
+    state->payload.assign(kPayloadSize, 'x');
+    ClientState *raw = state.get();
+    for (int i = 0; i < clientSockets; ++i)
+    {
+        UdpSocketPtr socket(new UdpSocket(loop, InetAddress(0, "127.0.0.1"), "udp_client"));
+        socket->setGso(c.gso);
+        socket->setMessageCallback([raw](const UdpSocketPtr &socket, const char *, size_t, const InetAddress &, Timestamp)
+                                   {
+                                       ++raw->received;
+                                       if (raw->running)
+                                       {
+                                           socket->sendTo(raw->server, raw->payload.data(), raw->payload.size());
+                                           ++raw->sent;
+                                       } });
+        socket->start();
+        state->sockets.push_back(socket);
+    }
+
+    if (c.echo)
+    {
+        checkStall(loop, state);
+    }
+    else
+    {
+        pump(loop, state);
+    }
+
+    // 先预热100ms再开始计数
+    std::chrono::steady_clock::time_point start;
+    double cpuStart = 0;
+    int64_t receivedStart = 0;
+    loop->runAfter(0.1, [&]()
+                   {
+                       start = std::chrono::steady_clock::now();
+                       cpuStart = serverCpuSeconds(server);
+                       state->sent = 0;
+                       state->received = 0;
+                       receivedStart = serverReceived.load();
+                       loop->runAfter(seconds, [loop]()
+                                      { loop->quit(); }); });
+    loop->loop();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = serverCpuSeconds(server) - cpuStart;
+    int64_t received = serverReceived.load() - receivedStart;
+
+    state->running = false;
+    state->sockets.clear();
+    // 服务端要在它自己的线程里析构, 这里只放掉引用
+    server.reset();
+
+    if (c.echo)
+    {
+        report.add(c.name + "_replies", state->received / elapsed, "pps", state->received);
+    }
+    else
+    {
+        report.add(c.name + "_tx", state->sent / elapsed, "pps", state->sent);
+    }
+    report.add(c.name + "_rx", received / elapsed, "pps", received);
+    report.add(c.name + "_rx_per_core", cpu > 0 ? received / cpu : 0, "pps/core", received);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    double seconds = 2.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] != '-')
+        {
+            seconds = atof(argv[i]);
+        }
+    }
+    Logger::instance().setMinLogLevel(LogLevel::ERROR);
+
+    std::vector<Case> cases;
+    cases.push_back(Case{"sink_batch1", 0, 1, false, false});
+    cases.push_back(Case{"sink_batch64", 0, 64, false, false});
+    cases.push_back(Case{"sink_batch64_gso", 0, 64, false, true});
+    cases.push_back(Case{"sink_batch64_2loops", 2, 64, false, true});
+    cases.push_back(Case{"echo_sendmmsg", 0, 64, true, false});
+    cases.push_back(Case{"echo_gso", 0, 64, true, true});
+
+    BenchReport report("udp", argc, argv);
+    EventLoop loop;
+    for (const Case &c : cases)
+    {
+        runCase(report, &loop, seconds, c, 4);
+    }
+    return 0;
+}
@@ -0,0 +1,254 @@
+#include "BenchReport.h"
+#include "LoopbackBench.h"
+
+#include <swiftNetCore/Buffer.h>
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/Histogram.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/Logger.h>
+#include <swiftNetCore/TcpClient.h>
+#include <swiftNetCore/TcpConnection.h>
+#include <swiftNetCore/TcpServer.h>
+#include <swiftNetCore/Timestamp.h>
+#include <swiftNetCore/http/HttpContext.h>
+#include <swiftNetCore/http/HttpRequest.h>
+#include <swiftNetCore/http/HttpResponse.h>
+#include <swiftNetCore/http/HttpServer.h>
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// 同一台机器上回环TCP与unix domain socket的对比, 每种传输方式跑同样的几项:
+//   rr_64B: 64字节请求/回显, 一问一答, 单连接测延迟, 16连接测吞吐
+//   stream_64KiB: 4个会话各自来回弹64KiB的块, 测带宽
+//   http_hello: HttpServer上的hello world, 16连接闭环
+// 用法: ./uds_bench [--json] [每项秒数, 默认2]
+
+namespace
+{
+
+struct Transport
+{
+    std::string name;
+    InetAddress addr;
+};
+
+std::shared_ptr<void> startEchoServer(EventLoop *loop, const InetAddress &addr)
+{
+    std::shared_ptr<TcpServer> s(new TcpServer(loop, addr, "echo"));
+    s->setConnectionCallback([](const TcpConnectionPtr &conn)
+                             {
+                                 if (conn->connected())
+                                 {
+                                     conn->setTcpNoDelay(true);
+                                 } });
+    s->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                          { conn->send(buf); });
+    s->start();
+    return std::shared_ptr<void>(s);
+}
+
+// 每个连接同时只有一个请求在途, 收齐messageSize字节的回显算一次完成
+void benchRequestResponse(BenchReport &report, EventLoop *loop, double seconds,
+                          const Transport &transport, int connections, size_t messageSize)
+{
+    InetAddress addr = transport.addr;
+    ServerThread server([addr](EventLoop *serverLoop)
+                        { return startEchoServer(serverLoop, addr); });
+
+    std::string message(messageSize, 'x');
+    std::atomic<int> connected(0);
+    int64_t completed = 0;
+    Histogram latency;
+    std::vector<size_t> received(connections, 0);
+    std::vector<int64_t> sentNs(connections, 0);
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    for (int i = 0; i < connections; ++i)
+    {
+        clients.emplace_back(new TcpClient(loop, addr, "rr"));
+        clients.back()->setConnectionCallback([&, i](const TcpConnectionPtr &conn)
+                                              {
+                                                  if (conn->connected())
+                                                  {
+                                                      conn->setTcpNoDelay(true);
+                                                      sentNs[i] = monotonicNanos();
+                                                      conn->send(message);
+                                                      ++connected;
+                                                  } });
+        clients.back()->setMessageCallback([&, i](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                           {
+                                               received[i] += buf->readableBytes();
+                                               buf->retrieveAll();
+                                               if (received[i] >= messageSize)
+                                               {
+                                                   int64_t now = monotonicNanos();
+                                                   latency.record((now - sentNs[i]) / 1000);
+                                                   ++completed;
+                                                   received[i] -= messageSize;
+                                                   sentNs[i] = now;
+                                                   conn->send(message);
+                                               } });
+    }
+    double elapsed = runClients(loop, clients, connected, seconds, [&]()
+                                {
+                                    completed = 0;
+                                    latency.reset(); });
+
+    std::string name = transport.name + "_rr_" + std::to_string(messageSize) + "B_" +
+                       std::to_string(connections) + "conn";
+    report.add(name, completed / elapsed, "rr/s", completed);
+    if (connections == 1)
+    {
+        report.add(name + "_p50", static_cast<double>(latency.percentile(50)), "us", latency.count());
+        report.add(name + "_p99", static_cast<double>(latency.percentile(99)), "us", latency.count());
+    }
+}
+
+// 和macro_bench的echo pingpong一样, 测大块数据来回的带宽
+void benchStream(BenchReport &report, EventLoop *loop, double seconds,
+                 const Transport &transport, int sessions, size_t blockSize)
+{
+    InetAddress addr = transport.addr;
+    ServerThread server([addr](EventLoop *serverLoop)
+                        { return startEchoServer(serverLoop, addr); });
+
+    std::string block(blockSize, 'x');
+    std::atomic<int> connected(0);
+    int64_t bytesRead = 0;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    for (int i = 0; i < sessions; ++i)
+    {
+        clients.emplace_back(new TcpClient(loop, addr, "stream"));
+        clients.back()->setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                              {
+                                                  if (conn->connected())
+                                                  {
+                                                      conn->send(block);
+                                                      ++connected;
+                                                  } });
+        clients.back()->setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                           {
+                                               bytesRead += buf->readableBytes();
+                                               conn->send(buf); });
+    }
+    double elapsed = runClients(loop, clients, connected, seconds, [&]()
+                                { bytesRead = 0; });
+    report.add(transport.name + "_stream_" + std::to_string(blockSize / 1024) + "KiB_" +
+                   std::to_string(sessions) + "conn",
+               bytesRead / elapsed / 1024 / 1024, "MiB/s", bytesRead / static_cast<int64_t>(blockSize));
+}
+
+void benchHttpHello(BenchReport &report, EventLoop *loop, double seconds,
+                    const Transport &transport, int connections)
+{
+    InetAddress addr = transport.addr;
+    ServerThread server([addr](EventLoop *serverLoop)
+                        {
+                            std::shared_ptr<HttpServer> s(new HttpServer(serverLoop, addr, "hello"));
+                            s->setHttpCallback([](const HttpRequest &, HttpResponse *resp)
+                                               {
+                                                   resp->setStatusCode(HttpResponse::k200Ok);
+                                                   resp->setStatusMessage("OK");
+                                                   resp->setContentType("text/plain");
+                                                   resp->setBody("hello, world!\n"); });
+                            s->start();
+                            return std::shared_ptr<void>(s); });
+
+    HttpRequest req;
+    req.setMethod(HttpRequest::kGet);
+    req.setPath("/hello");
+    req.setVersion(HttpRequest::kHttp11);
+    req.addHeader("Host", "localhost");
+    Buffer wire;
+    req.appendToBuffer(&wire);
+    std::string request = wire.retrieveAllAsString();
+
+    std::atomic<int> connected(0);
+    int64_t completed = 0;
+    int64_t failed = 0;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    std::vector<std::unique_ptr<HttpContext>> contexts;
+    for (int i = 0; i < connections; ++i)
+    {
+        HttpContext *context = new HttpContext;
+        contexts.emplace_back(context);
+        clients.emplace_back(new TcpClient(loop, addr, "hello"));
+        clients.back()->setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                              {
+                                                  if (conn->connected())
+                                                  {
+                                                      conn->setTcpNoDelay(true);
+                                                      conn->send(request);
+                                                      ++connected;
+                                                  } });
+        clients.back()->setMessageCallback([&, context](const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+                                           {
+                                               while (buf->readableBytes() > 0)
+                                               {
+                                                   if (!context->parseResponse(buf, receiveTime))
+                                                   {
+                                                       ++failed;
+                                                       conn->forceClose();
+                                                       return;
+                                                   }
+                                                   if (!context->gotAll())
+                                                   {
+                                                       break;
+                                                   }
+                                                   if (context->response().statusCode() == HttpResponse::k200Ok)
+                                                   {
+                                                       ++completed;
+                                                   }
+                                                   else
+                                                   {
+                                                       ++failed;
+                                                   }
+                                                   context->reset();
+                                                   conn->send(request);
+                                               } });
+    }
+    double elapsed = runClients(loop, clients, connected, seconds, [&]()
+                                {
+                                    completed = 0;
+                                    failed = 0; });
+    if (failed > 0)
+    {
+        fprintf(stderr, "%s http_hello: %lld failed responses\n", transport.name.c_str(), static_cast<long long>(failed));
+    }
+    report.add(transport.name + "_http_hello_" + std::to_string(connections) + "conn",
+               completed / elapsed, "req/s", completed);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    double seconds = 2.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] != '-')
+        {
+            seconds = atof(argv[i]);
+        }
+    }
+    Logger::instance().setMinLogLevel(LogLevel::ERROR);
+
+    std::vector<Transport> transports;
+    transports.push_back(Transport{"tcp", InetAddress(19897, "127.0.0.1")});
+    transports.push_back(Transport{"unix", InetAddress::fromUnixPath("/tmp/swiftnet_uds_bench.sock")});
+    transports.push_back(Transport{"unix_abstract", InetAddress::fromUnixPath("@swiftnet_uds_bench")});
+
+    BenchReport report("uds", argc, argv);
+    EventLoop loop;
+    for (const Transport &transport : transports)
+    {
+        benchRequestResponse(report, &loop, seconds, transport, 1, 64);
+        benchRequestResponse(report, &loop, seconds, transport, 16, 64);
+        benchStream(report, &loop, seconds, transport, 4, 64 * 1024);
+        benchHttpHello(report, &loop, seconds, transport, 16);
+    }
+    ::unlink("/tmp/swiftnet_uds_bench.sock");
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/Metrics.h>
+#include <swiftNetCore/TcpConnection.h>
+#include <swiftNetCore/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// 回环地址上对比普通发送和MSG_ZEROCOPY发送每GB消耗的CPU
+// 发送端是TcpServer的loop线程, 接收端是一个阻塞读的线程
+// 用法: ./zerocopy_bench [总MB数] [每块KB数]
+// 注意: 回环上内核会把zero copy的数据再拷贝一次(见copied计数), 真实网卡上才能体现收益
+
+static double threadCpuSeconds()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+struct Result
+{
+    double seconds;
+    double senderCpu;
+    double receiverCpu;
+    int64_t bytes;
+};
+
+static Result runOnce(uint16_t port, int64_t totalBytes, size_t blobSize, bool zeroCopy)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "zerocopy_bench");
+    BlobPtr blob = std::make_shared<Blob>(std::string(blobSize, 'z'));
+    int64_t queued = 0;
+    double senderCpuStart = 0;
+    Result result = {0, 0, 0, 0};
+
+    // 队列排空后再补一批, 让发送队列一直有数据
+    auto fill = [&](const TcpConnectionPtr &conn)
+    {
+        for (int i = 0; i < 8 && queued < totalBytes; ++i)
+        {
+            conn->send(blob);
+            queued += blobSize;
+        }
+        if (queued >= totalBytes)
+        {
+            conn->shutdown();
+        }
+    };
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                 {
+                                     if (conn->connected())
+                                     {
+                                         if (zeroCopy && !conn->setZeroCopyThreshold(blobSize))
+                                         {
+                                             printf("SO_ZEROCOPY is not supported\n");
+                                         }
+                                         senderCpuStart = threadCpuSeconds();
+                                         fill(conn);
+                                     } });
+    server.setWriteCompleteCallback([&](const TcpConnectionPtr &conn)
+                                    {
+                                        if (queued < totalBytes)
+                                        {
+                                            fill(conn);
+                                        } });
+    server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                              { buf->retrieveAll(); });
+    server.start();
+
+    std::thread receiver([&]()
+                         {
+                             int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                             struct sockaddr_in addr;
+                             ::memset(&addr, 0, sizeof addr);
+                             addr.sin_family = AF_INET;
+                             addr.sin_port = htons(port);
+                             addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                             if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+                             {
+                                 perror("connect");
+                                 exit(1);
+                             }
+                             double cpuStart = threadCpuSeconds();
+                             auto start = std::chrono::steady_clock::now();
+                             static char buf[1 << 20];
+                             int64_t bytes = 0;
+                             ssize_t n;
+                             while ((n = ::read(fd, buf, sizeof buf)) > 0)
+                             {
+                                 bytes += n;
+                             }
+                             auto end = std::chrono::steady_clock::now();
+                             result.receiverCpu = threadCpuSeconds() - cpuStart;
+                             result.seconds = std::chrono::duration<double>(end - start).count();
+                             result.bytes = bytes;
+                             ::close(fd);
+                             loop.queueInLoop([&]()
+                                              {
+                                                  result.senderCpu = threadCpuSeconds() - senderCpuStart;
+                                                  loop.quit(); }); });
+    loop.loop();
+    receiver.join();
+    return result;
+}
+
+static void print(const char *name, const Result &r)
+{
+    double gb = r.bytes / 1e9;
+    printf("%-10s %8.2f %12.3f %14.3f %10.2f\n",
+           name, r.bytes / 1e6, r.senderCpu / gb, r.receiverCpu / gb, gb / r.seconds);
+}
+
+int main(int argc, char *argv[])
+{
+    int64_t totalBytes = (argc > 1 ? atoll(argv[1]) : 2048) * 1000 * 1000;
+    size_t blobSize = (argc > 2 ? atoi(argv[2]) : 256) * 1024;
+
+    printf("total=%lldMB blob=%zuKB\n", static_cast<long long>(totalBytes / 1000000), blobSize / 1024);
+    printf("%-10s %8s %12s %14s %10s\n", "mode", "MB", "send cpu/GB", "recv cpu/GB", "GB/s");
+    print("copy", runOnce(19870, totalBytes, blobSize, false));
+    print("zerocopy", runOnce(19871, totalBytes, blobSize, true));
+
+    Counter &completions = MetricsRegistry::instance().counter("swiftnet_tcp_zerocopy_completions_total", "");
+    Counter &copied = MetricsRegistry::instance().counter("swiftnet_tcp_zerocopy_copied_total", "");
+    printf("zerocopy completions=%lld copied=%lld\n",
+           static_cast<long long>(completions.value()), static_cast<long long>(copied.value()));
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include <swiftNetCore/Buffer.h>
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/Logger.h>
+#include <swiftNetCore/TcpConnection.h>
+#include <swiftNetCore/TcpServer.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+// 读端流控测试: 输入高水位4KiB, 客户端发比它大得多的帧(4字节长度 + 64KiB), 每帧分8次发,
+// 服务端要读好几次才能凑齐一帧. 收齐一帧后把帧长登记为待处理量(超过高水位, 暂停读), 50ms后再减掉.
+// 检查两帧都能收到, 并且确实暂停过一次读
+// 用法: ./flowcontrol_test, 成功时退出码为0
+
+static const uint16_t kPort = 19881;
+static const size_t kHighWaterMark = 4096;
+static const size_t kLowWaterMark = 1024;
+static const size_t kFrameSize = 64 * 1024;
+static const int kFrames = 2;
+static const int kChunks = 8;
+
+// 客户端: 发完所有帧, 等每帧一个"ok\n"的应答, 返回收到的应答数
+static int runClient()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        ::close(fd);
+        return 0;
+    }
+    struct timeval timeout = {3, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+    std::string frame(4 + kFrameSize, 'x');
+    uint32_t len = htonl(static_cast<uint32_t>(kFrameSize));
+    ::memcpy(&frame[0], &len, sizeof len);
+    size_t chunk = frame.size() / kChunks;
+    for (int f = 0; f < kFrames; ++f)
+    {
+        for (size_t off = 0; off < frame.size(); off += chunk)
+        {
+            size_t n = std::min(chunk, frame.size() - off);
+            if (::send(fd, frame.data() + off, n, MSG_NOSIGNAL) != static_cast<ssize_t>(n))
+            {
+                perror("send");
+                ::close(fd);
+                return 0;
+            }
+            ::usleep(5 * 1000);
+        }
+    }
+
+    int acks = 0;
+    std::string received;
+    char buf[64];
+    while (acks < kFrames)
+    {
+        ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+        if (n <= 0)
+        {
+            break;
+        }
+        received.append(buf, n);
+        size_t eol;
+        while ((eol = received.find('\n')) != std::string::npos)
+        {
+            received.erase(0, eol + 1);
+            ++acks;
+        }
+    }
+    ::close(fd);
+    return acks;
+}
+
+int main()
+{
+    Logger::instance().setMinLogLevel(LogLevel::ERROR);
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort), "flowcontrol");
+    int frames = 0;
+    int pauses = 0;
+    server.setConnectionCallback([](const TcpConnectionPtr &conn)
+                                 {
+                                     if (conn->connected())
+                                     {
+                                         conn->setInputHighWaterMark(kHighWaterMark, kLowWaterMark);
+                                     } });
+    server.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                              {
+                                  // 不完整的帧留在缓冲区里, 它早就超过了高水位, 但不能因此停止读
+                                  while (buf->readableBytes() >= 4)
+                                  {
+                                      uint32_t be32;
+                                      ::memcpy(&be32, buf->peek(), sizeof be32);
+                                      int64_t len = ntohl(be32);
+                                      if (buf->readableBytes() < 4 + static_cast<size_t>(len))
+                                      {
+                                          break;
+                                      }
+                                      buf->retrieve(4 + len);
+                                      ++frames;
+                                      conn->send("ok\n");
+                                      conn->addPendingWork(len);
+                                      if (conn->inputPaused())
+                                      {
+                                          ++pauses;
+                                      }
+                                      std::weak_ptr<TcpConnection> weak(conn);
+                                      loop.runAfter(0.05, [weak, len]()
+                                                    {
+                                                        TcpConnectionPtr c(weak.lock());
+                                                        if (c)
+                                                        {
+                                                            c->addPendingWork(-len);
+                                                        } });
+                                  } });
+    server.start();
+
+    std::atomic<int> acks(-1);
+    std::thread client([&acks, &loop]()
+                       {
+                           acks = runClient();
+                           loop.queueInLoop([&loop]()
+                                            { loop.quit(); });
+                       });
+    loop.loop();
+    client.join();
+
+    bool ok = frames == kFrames && acks == kFrames && pauses > 0;
+    printf("frames=%d acks=%d pauses=%d: %s\n", frames, acks.load(), pauses, ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/ListenerHandover.h>
+#include <swiftNetCore/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// 热升级测试: 老进程在压力下把监听socket交给新进程, 检查客户端没有任何连接错误
+// 用法: ./handover_test            启动老进程 -> 压测 -> 启动新进程接管 -> 老进程drain退出
+//       ./handover_test server     单独启动一个服务进程, 有老进程时自动接管
+
+static const uint16_t kPort = 19880;
+static const char *kHandoverPath = "/tmp/swiftnet_handover_test.sock";
+
+// 每收到一行就回复自己的pid
+static int runServer()
+{
+    EventLoop loop;
+    ListenerHandoverClient client(kHandoverPath);
+    std::map<std::string, int> fds;
+    std::unique_ptr<TcpServer> server;
+    if (client.fetch(&fds) && fds.count("echo"))
+    {
+        server.reset(new TcpServer(&loop, fds["echo"], "handover"));
+    }
+    else
+    {
+        server.reset(new TcpServer(&loop, InetAddress(kPort), "handover"));
+    }
+
+    std::string pid = std::to_string(::getpid()) + "\n";
+    server->setConnectionCallback([](const TcpConnectionPtr &) {});
+    server->setMessageCallback([&pid](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                               {
+                                   const char *eol;
+                                   while ((eol = buf->findEOL()) != nullptr)
+                                   {
+                                       buf->retrieveUntil(eol + 1);
+                                       conn->send(pid);
+                                   } });
+    server->start();
+    client.ack();
+
+    ListenerHandoverServer handover(&loop, kHandoverPath);
+    handover.addListener("echo", server->listenFd());
+    handover.setHandoverCallback([&]()
+                                 {
+                                     server->setListenerHandedOver();
+                                     server->drain(5.0, [&]()
+                                                   { loop.quit(); }); });
+    handover.start();
+    loop.loop();
+    return 0;
+}
+
+static pid_t spawnServer(const char *self)
+{
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        ::execl(self, self, "server", static_cast<char *>(nullptr));
+        _exit(127);
+    }
+    return pid;
+}
+
+// 一次短连接请求, 返回服务端pid, 失败返回-1
+static int request()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int pid = -1;
+    char buf[32];
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) == 0 &&
+        ::write(fd, "ping\n", 5) == 5)
+    {
+        ssize_t total = 0;
+        ssize_t n;
+        while (total < static_cast<ssize_t>(sizeof buf) - 1 &&
+               (n = ::read(fd, buf + total, sizeof buf - 1 - total)) > 0)
+        {
+            total += n;
+            if (buf[total - 1] == '\n')
+            {
+                buf[total] = '\0';
+                pid = atoi(buf);
+                break;
+            }
+        }
+    }
+    ::close(fd);
+    return pid;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "server") == 0)
+    {
+        return runServer();
+    }
+
+    ::unlink(kHandoverPath);
+    pid_t oldPid = spawnServer(argv[0]);
+    while (request() < 0)
+    {
+        ::usleep(10 * 1000);
+    }
+
+    std::atomic<bool> running(true);
+    std::atomic<int> errors(0);
+    std::mutex mutex;
+    std::map<int, int> servedBy;
+    std::vector<std::thread> clients;
+    for (int i = 0; i < 4; ++i)
+    {
+        clients.emplace_back([&]()
+                             {
+                                 while (running)
+                                 {
+                                     int pid = request();
+                                     if (pid < 0)
+                                     {
+                                         ++errors;
+                                         continue;
+                                     }
+                                     std::lock_guard<std::mutex> lock(mutex);
+                                     ++servedBy[pid];
+                                 } });
+    }
+
+    ::sleep(1);
+    pid_t newPid = spawnServer(argv[0]);
+    int status = 0;
+    ::waitpid(oldPid, &status, 0); // 老进程drain完成后自己退出
+    ::sleep(1);
+    running = false;
+    for (std::thread &t : clients)
+    {
+        t.join();
+    }
+    ::kill(newPid, SIGTERM);
+    ::waitpid(newPid, nullptr, 0);
+    ::unlink(kHandoverPath);
+
+    printf("old pid %d served %d, exit status %d\n", oldPid, servedBy[oldPid], WEXITSTATUS(status));
+    printf("new pid %d served %d\n", newPid, servedBy[newPid]);
+    printf("connection errors: %d\n", errors.load());
+    bool ok = errors == 0 && servedBy[oldPid] > 0 && servedBy[newPid] > 0 &&
+              WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+#include <swiftNetCore/OutputQueue.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+// 部分写出的MSG_ZEROCOPY分段: 4MiB的分段第一次只能用MSG_ZEROCOPY写出一部分, 等到这次发送的完成通知后
+// 再把剩下的部分用普通拷贝发完. 检查这个分段发完后被释放, 之后再发的数据也不会滞留在队列里
+// 用法: ./zerocopy_test, 成功时退出码为0
+
+static const size_t kSegmentSize = 4 * 1024 * 1024;
+
+// 读完错误队列里的完成通知, 返回读到的条数
+static int drainCompletions(int fd, OutputQueue *queue)
+{
+    int got = 0;
+    while (true)
+    {
+        char control[128];
+        struct msghdr msg;
+        ::memset(&msg, 0, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            return got;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            const struct sock_extended_err *serr =
+                reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+            if (serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+            {
+                queue->completeZeroCopy(serr->ee_info, serr->ee_data);
+                ++got;
+            }
+        }
+    }
+}
+
+// 把接收端读空
+static size_t drainReceiver(int fd)
+{
+    size_t total = 0;
+    char buf[65536];
+    ssize_t n;
+    while ((n = ::recv(fd, buf, sizeof buf, MSG_DONTWAIT)) > 0)
+    {
+        total += n;
+    }
+    return total;
+}
+
+// 一边读接收端一边写, 直到队列写空
+static bool sendAll(int sender, int receiver, OutputQueue *queue)
+{
+    for (int i = 0; i < 10000 && !queue->empty(); ++i)
+    {
+        int savedErrno = 0;
+        if (queue->writeFd(sender, &savedErrno) < 0 && savedErrno != EAGAIN)
+        {
+            perror("writeFd");
+            return false;
+        }
+        drainReceiver(receiver);
+        drainCompletions(sender, queue);
+    }
+    return queue->empty();
+}
+
+int main()
+{
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof addr;
+    ::bind(listener, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr);
+    ::listen(listener, 1);
+    ::getsockname(listener, reinterpret_cast<struct sockaddr *>(&addr), &len);
+
+    int sender = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int sndbuf = 64 * 1024;
+    ::setsockopt(sender, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+    int one = 1;
+    if (::setsockopt(sender, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof one) < 0)
+    {
+        printf("SO_ZEROCOPY not supported: SKIP\n");
+        return 0;
+    }
+    ::connect(sender, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr);
+    int receiver = ::accept(listener, nullptr, nullptr);
+    struct pollfd pfd = {sender, POLLOUT, 0};
+    ::poll(&pfd, 1, 1000);
+
+    OutputQueue queue;
+    queue.setZeroCopyThreshold(1);
+    queue.append(std::string(kSegmentSize, 'z'));
+    int savedErrno = 0;
+    ssize_t n = queue.writeFd(sender, &savedErrno);
+    if (n <= 0 || static_cast<size_t>(n) >= kSegmentSize)
+    {
+        printf("first write %zd, expected a partial write: FAIL\n", n);
+        return 1;
+    }
+
+    // 接收端读走这部分数据后内核释放skb, 发出完成通知, 这时分段还有一部分没发
+    int completions = 0;
+    for (int i = 0; i < 200 && completions == 0; ++i)
+    {
+        drainReceiver(receiver);
+        completions = drainCompletions(sender, &queue);
+        ::usleep(5 * 1000);
+    }
+    if (completions == 0)
+    {
+        printf("no zero copy completion: FAIL\n");
+        return 1;
+    }
+
+    // 剩下的部分用普通拷贝发送
+    queue.setZeroCopyThreshold(0);
+    bool sent = sendAll(sender, receiver, &queue);
+    size_t inflightAfterTail = queue.zeroCopyInFlight();
+    queue.append("tail", 4);
+    sent = sendAll(sender, receiver, &queue) && sent;
+    size_t inflightAfterMore = queue.zeroCopyInFlight();
+
+    bool ok = sent && inflightAfterTail == 0 && inflightAfterMore == 0;
+    printf("first=%zd inflight=%zu/%zu: %s\n", n, inflightAfterTail, inflightAfterMore, ok ? "PASS" : "FAIL");
+    ::close(sender);
+    ::close(receiver);
+    ::close(listener);
+    return ok ? 0 : 1;
+}
@@ -1,15 +1,18 @@
 #include "Acceptor.h"
 #include "Logger.h"
 #include "InetAddress.h"
+#include "Probes.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 
-static int createNonblocking()
+static int createNonblocking(sa_family_t family)
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (sockfd < 0)
     {
         LOG_FATAL("%s:%s:%d listen socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
@@ -17,40 +20,139 @@ static int createNonblocking()
     return sockfd;
 }
 
+// 上次运行留下的socket文件会让bind失败. 只有确认它是没人监听的socket文件时才删掉:
+// 普通文件或别的服务正在监听的socket都不能动, 直接LOG_FATAL
+static void removeStaleUnixSocket(const InetAddress &listenAddr)
+{
+    std::string path = listenAddr.toIp();
+    struct stat st;
+    if (::lstat(path.c_str(), &st) < 0)
+    {
+        if (errno != ENOENT)
+        {
+            LOG_FATAL("%s:%s:%d lstat %s err:%d \n", __FILE__, __FUNCTION__, __LINE__, path.c_str(), errno);
+        }
+        return;
+    }
+    if (!S_ISSOCK(st.st_mode))
+    {
+        LOG_FATAL("%s:%s:%d %s exists and is not a socket \n", __FILE__, __FUNCTION__, __LINE__, path.c_str());
+    }
+
+    // 非阻塞地连一下: 对端backlog满时返回EAGAIN而不是阻塞, 同样说明有人在监听
+    int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (probe < 0)
+    {
+        LOG_FATAL("%s:%s:%d probe socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    int ret = ::connect(probe, listenAddr.getSockAddr(), listenAddr.getSockLen());
+    int savedErrno = errno;
+    ::close(probe);
+    if (ret == 0 || savedErrno != ECONNREFUSED)
+    {
+        LOG_FATAL("%s:%s:%d %s is in use by another server (probe connect ret:%d err:%d) \n",
+                  __FILE__, __FUNCTION__, __LINE__, path.c_str(), ret, ret == 0 ? 0 : savedErrno);
+    }
+    if (::unlink(path.c_str()) < 0 && errno != ENOENT)
+    {
+        LOG_FATAL("%s:%s:%d unlink stale socket %s err:%d \n", __FILE__, __FUNCTION__, __LINE__, path.c_str(), errno);
+    }
+    LOG_INFO("%s:%s:%d removed stale socket %s \n", __FILE__, __FUNCTION__, __LINE__, path.c_str());
+}
+
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop),
-      acceptScoket_(createNonblocking()),
-      acceptChannel_(loop, acceptScoket_.fd()),
+      acceptScoket_(new Socket(createNonblocking(listenAddr.family()))),
+      acceptChannel_(loop, acceptScoket_->fd()),
       listenning_(false)
 {
-    acceptScoket_.setReuseAddr(true);
-    acceptScoket_.setReusePort(true);
-    acceptScoket_.bindAddress(listenAddr); // bind
+    if (listenAddr.isUnix())
+    {
+        // 抽象命名空间没有文件
+        std::string path = listenAddr.toIp();
+        if (!path.empty() && path[0] != '@')
+        {
+            removeStaleUnixSocket(listenAddr);
+        }
+    }
+    else
+    {
+        acceptScoket_->setReuseAddr(true);
+        acceptScoket_->setReusePort(true);
+    }
+    acceptScoket_->bindAddress(listenAddr); // bind
 
     // TcpServer::start() Acceptor.listen 有新用户的来凝结, 要执行一个回调 connfd -> channel -> subloop
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
 
+Acceptor::Acceptor(EventLoop *loop, int listenFd)
+    : loop_(loop),
+      acceptScoket_(new Socket(listenFd)),
+      acceptChannel_(loop, listenFd),
+      listenning_(false)
+{
+    // 继承来的fd不一定是非阻塞的, close-on-exec标志也不会跟着SCM_RIGHTS传过来
+    int flags = ::fcntl(listenFd, F_GETFL, 0);
+    if (flags < 0 || ::fcntl(listenFd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        LOG_FATAL("%s:%s:%d adopt listen fd %d err:%d \n", __FILE__, __FUNCTION__, __LINE__, listenFd, errno);
+    }
+    ::fcntl(listenFd, F_SETFD, FD_CLOEXEC);
+    acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+}
+
 Acceptor::~Acceptor()
 {
-    acceptChannel_.disableAll();
-    acceptChannel_.remove();
+    if (acceptScoket_)
+    {
+        acceptChannel_.disableAll();
+        acceptChannel_.remove();
+    }
 }
 
 void Acceptor::listen()
 {
     listenning_ = true;
-    acceptScoket_.listen(); // listen
+    acceptScoket_->listen(); // listen
     acceptChannel_.enableReading();
 }
 
+void Acceptor::stopListening(bool acceptBacklog)
+{
+    if (!acceptScoket_)
+    {
+        return;
+    }
+    listenning_ = false;
+    acceptChannel_.disableAll();
+    acceptChannel_.remove();
+
+    InetAddress peerAddr;
+    int connfd;
+    while (acceptBacklog && (connfd = acceptScoket_->accept(&peerAddr)) >= 0)
+    {
+        SWIFTNET_PROBE1(conn_accept, connfd);
+        if (newConnectionCallback_)
+        {
+            newConnectionCallback_(connfd, peerAddr);
+        }
+        else
+        {
+            ::close(connfd);
+        }
+    }
+    acceptScoket_.reset();
+}
+
 // listenfd有事件发生了, 就是有新用户连接了
 void Acceptor::handleRead()
 {
     InetAddress peerAddr;
-    int connfd = acceptScoket_.accept(&peerAddr);
+    int connfd = acceptScoket_->accept(&peerAddr);
     if (connfd >= 0)
     {
+        SWIFTNET_PROBE1(conn_accept, connfd);
         if (newConnectionCallback_)
         {
             newConnectionCallback_(connfd, peerAddr); // 轮询找到subloop， 唤醒，分发当前的新客户端的channel
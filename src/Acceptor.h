@@ -5,6 +5,7 @@
 #include "Channel.h"
 
 #include <functional>
+#include <memory>
 
 class EventLoop;
 class InetAddress;
@@ -14,6 +15,8 @@ class Acceptor : noncopyable
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>;
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+    // 接管一个已经bind/listen好的监听fd(例如热升级时从老进程继承来的), 析构时关闭它
+    Acceptor(EventLoop *loop, int listenFd);
     ~Acceptor();
 
     void setNewCOnnectionCallback(const NewConnectionCallback &cb)
@@ -22,12 +25,17 @@ public:
     }
 
     bool listenning() const { return listenning_; }
+    // 监听fd, stopListening之后为-1
+    int listenFd() const { return acceptScoket_ ? acceptScoket_->fd() : -1; }
     void listen();
+    // 不再接受新连接: acceptBacklog为true时先把backlog里已经完成握手的连接取出来交给上层, 再关闭监听socket
+    // 监听socket已经交给了别的进程时传false, backlog里的连接留给对方, 关闭只是少了一个引用
+    void stopListening(bool acceptBacklog = true);
 private:
     void handleRead();
 
     EventLoop *loop_;
-    Socket acceptScoket_;
+    std::unique_ptr<Socket> acceptScoket_; // stopListening之后为空
     Channel acceptChannel_;
     NewConnectionCallback newConnectionCallback_;
     bool listenning_;
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// 不可变的待发送数据块, 通过shared_ptr在线程之间、多个连接之间共享, 发送时不再拷贝
+class Blob : noncopyable
+{
+public:
+    explicit Blob(std::string &&data)
+        : data_(std::move(data))
+    {
+    }
+
+    explicit Blob(const std::string &data)
+        : data_(data)
+    {
+    }
+
+    Blob(const void *data, size_t len)
+        : data_(static_cast<const char *>(data), len)
+    {
+    }
+
+    const char *data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+
+private:
+    const std::string data_;
+};
+
+using BlobPtr = std::shared_ptr<const Blob>;
+using BlobList = std::vector<BlobPtr>;
@@ -19,6 +19,18 @@ public:
     {
     }
 
+    // 复用别处交出来的内存(见releaseStorage), 太小的话补到初始大小
+    explicit Buffer(std::vector<char> &&storage)
+        : buffer_(std::move(storage)),
+          readerIndex_(kCheapPrepend),
+          writeIndex_(kCheapPrepend)
+    {
+        if (buffer_.size() < kCheapPrepend + kInitialSize)
+        {
+            buffer_.resize(kCheapPrepend + kInitialSize);
+        }
+    }
+
     Buffer(const Buffer &other)
         : buffer_(other.buffer_),
           readerIndex_(other.readerIndex_),
@@ -26,8 +38,37 @@ public:
     {
     }
 
+    // 移动后other留下一个空的小缓冲区, 仍然可以继续使用
+    Buffer(Buffer &&other)
+        : Buffer(0)
+    {
+        swap(other);
+    }
+
+    Buffer &operator=(const Buffer &other) = default;
+
+    Buffer &operator=(Buffer &&other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    void swap(Buffer &other)
+    {
+        buffer_.swap(other.buffer_);
+        std::swap(readerIndex_, other.readerIndex_);
+        std::swap(writeIndex_, other.writeIndex_);
+    }
+
     std::vector<char> &buffer() { return buffer_; }
 
+    // 交出底层内存, 之后Buffer不能再使用
+    std::vector<char> releaseStorage()
+    {
+        retrieveAll();
+        return std::move(buffer_);
+    }
+
     size_t readableBytes() const { return writeIndex_ - readerIndex_; }
 
     size_t writeableBytes() const { return buffer_.size() - writeIndex_; }
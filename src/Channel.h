@@ -5,6 +5,7 @@
 
 #include <functional>
 #include <memory>
+#include <string>
 
 // 前置声明
 class EventLoop;
@@ -17,6 +18,7 @@ class Channel : noncopyable
 public:
     using EventCallback = std::function<void()>;
     using ReadEventCallback = std::function<void(Timestamp)>;
+    using NameCallback = std::function<std::string()>;
 
     Channel(EventLoop *loop, int fd);
     ~Channel();
@@ -29,6 +31,10 @@ public:
     void setWriteCallback(EventCallback cb) { writeCallback_ = std::move(cb); }
     void setCloseCallback(EventCallback cb) { closeCallback_ = std::move(cb); }
     void setErrorCallback(EventCallback cb) { errorCallback_ = std::move(cb); }
+    // 慢回调上报时用来获取channel所属对象的名字, 例如连接名
+    void setNameCallback(NameCallback cb) { nameCallback_ = std::move(cb); }
+
+    std::string name() const { return nameCallback_ ? nameCallback_() : std::string(); }
 
     // 防止当channel被手动remove掉, channel还在执行回调操作
     void tie(const std::shared_ptr<void> &);
@@ -97,4 +103,5 @@ private:
     EventCallback writeCallback_;
     EventCallback closeCallback_;
     EventCallback errorCallback_;
+    NameCallback nameCallback_;
 };
\ No newline at end of file
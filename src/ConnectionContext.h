@@ -0,0 +1,95 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * 连接上挂的应用层状态(例如HTTP解析器), 代替boost::any:
+ * 不超过kInlineSize的类型直接placement new在连接对象内部, 放不下的才在堆上分配
+ * 取值时只比较一个函数指针, 不走RTTI; 只在连接所属的loop线程访问
+ */
+class ConnectionContext : noncopyable
+{
+public:
+    static const size_t kInlineSize = 448;
+
+    ConnectionContext() : ptr_(nullptr), destroy_(nullptr) {}
+    ~ConnectionContext() { reset(); }
+
+    // 先销毁旧的状态再构造T, 所以参数不能引用旧的状态
+    template <typename T, typename... Args>
+    T *emplace(Args &&...args)
+    {
+        reset();
+        T *p = construct<T>(std::integral_constant<bool, fitsInline<T>()>(), std::forward<Args>(args)...);
+        ptr_ = p;
+        return p;
+    }
+
+    // 为空或者类型不符时返回nullptr
+    template <typename T>
+    T *get()
+    {
+        return holds<T>() ? static_cast<T *>(ptr_) : nullptr;
+    }
+
+    template <typename T>
+    const T *get() const
+    {
+        return holds<T>() ? static_cast<const T *>(ptr_) : nullptr;
+    }
+
+    template <typename T>
+    bool holds() const
+    {
+        return destroy_ == &destroyInline<T> || destroy_ == &destroyHeap<T>;
+    }
+
+    template <typename T>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(T) <= kInlineSize && alignof(T) <= alignof(std::max_align_t);
+    }
+
+    bool empty() const { return ptr_ == nullptr; }
+
+    void reset()
+    {
+        if (destroy_)
+        {
+            destroy_(ptr_);
+            ptr_ = nullptr;
+            destroy_ = nullptr;
+        }
+    }
+
+private:
+    template <typename T, typename... Args>
+    T *construct(std::true_type, Args &&...args)
+    {
+        T *p = new (&storage_) T(std::forward<Args>(args)...);
+        destroy_ = &destroyInline<T>;
+        return p;
+    }
+
+    template <typename T, typename... Args>
+    T *construct(std::false_type, Args &&...args)
+    {
+        T *p = new T(std::forward<Args>(args)...);
+        destroy_ = &destroyHeap<T>;
+        return p;
+    }
+
+    template <typename T>
+    static void destroyInline(void *p) { static_cast<T *>(p)->~T(); }
+    template <typename T>
+    static void destroyHeap(void *p) { delete static_cast<T *>(p); }
+
+    typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type storage_;
+    void *ptr_;
+    void (*destroy_)(void *); // 同时用作类型标记
+};
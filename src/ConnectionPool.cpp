@@ -0,0 +1,73 @@
+#include "ConnectionPool.h"
+
+#include <new>
+
+ConnectionPool::ConnectionPool(size_t maxFree)
+    : maxFree_(maxFree),
+      blockSize_(0)
+{
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    for (void *block : freeBlocks_)
+    {
+        ::operator delete(block);
+    }
+}
+
+void *ConnectionPool::allocate(size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (blockSize_ == 0)
+        {
+            blockSize_ = size;
+        }
+        if (size == blockSize_ && !freeBlocks_.empty())
+        {
+            void *block = freeBlocks_.back();
+            freeBlocks_.pop_back();
+            return block;
+        }
+    }
+    return ::operator new(size);
+}
+
+void ConnectionPool::deallocate(void *p, size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (size == blockSize_ && freeBlocks_.size() < maxFree_)
+        {
+            freeBlocks_.push_back(p);
+            return;
+        }
+    }
+    ::operator delete(p);
+}
+
+std::vector<char> ConnectionPool::takeBuffer()
+{
+    std::vector<char> storage;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!freeBuffers_.empty())
+    {
+        storage.swap(freeBuffers_.back());
+        freeBuffers_.pop_back();
+    }
+    return storage;
+}
+
+void ConnectionPool::recycleBuffer(std::vector<char> &&storage)
+{
+    if (storage.empty() || storage.size() > kMaxRecycledBuffer)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (freeBuffers_.size() < maxFree_)
+    {
+        freeBuffers_.push_back(std::move(storage));
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * 连接对象池, TcpServer给每个IO loop配一个:
+ * 1. 固定大小内存块的空闲链表, 通过PoolAllocator交给std::allocate_shared,
+ *    TcpConnection和shared_ptr控制块一次分配, 释放后留给下一个连接
+ * 2. 输入缓冲区内存的slab, 连接析构时交回, 新连接直接拿走
+ * 最后一个shared_ptr可能在任意线程释放, 所以用锁保护, 每个连接只进几次临界区
+ */
+class ConnectionPool : noncopyable
+{
+public:
+    static const size_t kDefaultMaxFree = 1024;
+    // 超过这个大小的输入缓冲区不回收, 免得一个大请求之后长期占着内存
+    static const size_t kMaxRecycledBuffer = 64 * 1024;
+
+    explicit ConnectionPool(size_t maxFree = kDefaultMaxFree);
+    ~ConnectionPool();
+
+    // 第一次分配决定块大小, 其他大小直接走operator new
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    // 没有可用的时返回空vector
+    std::vector<char> takeBuffer();
+    void recycleBuffer(std::vector<char> &&storage);
+
+private:
+    std::mutex mutex_;
+    const size_t maxFree_;
+    size_t blockSize_;
+    std::vector<void *> freeBlocks_;
+    std::vector<std::vector<char>> freeBuffers_;
+};
+
+// 从ConnectionPool分配内存的allocator, 用于std::allocate_shared
+template <typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(const std::shared_ptr<ConnectionPool> &pool) : pool_(pool) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &other) : pool_(other.pool()) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(pool_->allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { pool_->deallocate(p, n * sizeof(T)); }
+
+    const std::shared_ptr<ConnectionPool> &pool() const { return pool_; }
+
+private:
+    std::shared_ptr<ConnectionPool> pool_;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T> &a, const PoolAllocator<U> &b)
+{
+    return a.pool() == b.pool();
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T> &a, const PoolAllocator<U> &b)
+{
+    return !(a == b);
+}
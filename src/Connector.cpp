@@ -12,19 +12,70 @@
 #include "Logger.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "Metrics.h"
 #include "SocketsOps.h"
 
+#include <algorithm>
 #include <errno.h>
+#include <random>
 #include <string>
 
 const int Connector::kMaxRetryDelayMs;
 
+namespace
+{
+  Counter &g_connectRetries = MetricsRegistry::instance().counter(
+      "swiftnet_connector_retries_total", "Number of connect attempts scheduled after a failure");
+  Counter &g_connectTimeouts = MetricsRegistry::instance().counter(
+      "swiftnet_connector_timeouts_total", "Number of connect attempts abandoned by the connect timeout");
+  Counter &g_connectGiveUps = MetricsRegistry::instance().counter(
+      "swiftnet_connector_give_ups_total", "Number of connectors that stopped retrying");
+  Counter &g_retryBudgetExhausted = MetricsRegistry::instance().counter(
+      "swiftnet_connector_retry_budget_exhausted_total", "Number of retries refused by a shared retry budget");
+
+  // full jitter: uniform in [0, ceilingMs], so clients cut off by the same
+  // upstream restart do not come back in lockstep
+  int fullJitter(int ceilingMs)
+  {
+    static thread_local std::mt19937 engine{std::random_device{}()};
+    std::uniform_int_distribution<int> dist(0, ceilingMs);
+    return dist(engine);
+  }
+}
+
+RetryBudget::RetryBudget(double capacity, double refillPerSecond)
+    : capacity_(capacity),
+      refillPerSecond_(refillPerSecond),
+      tokens_(capacity),
+      lastRefill_(std::chrono::steady_clock::now())
+{
+}
+
+bool RetryBudget::tryAcquire()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double elapsed = std::chrono::duration<double>(now - lastRefill_).count();
+  tokens_ = std::min(capacity_, tokens_ + elapsed * refillPerSecond_);
+  lastRefill_ = now;
+  if (tokens_ < 1)
+  {
+    return false;
+  }
+  tokens_ -= 1;
+  return true;
+}
+
 Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
     : loop_(loop),
       serverAddr_(serverAddr),
       connect_(false),
+      stopped_(false),
       state_(kDisconnected),
-      retryDelayMs_(kInitRetryDelayMs)
+      retryDelayMs_(kInitRetryDelayMs),
+      connectTimeout_(0),
+      maxRetries_(-1),
+      retries_(0)
 {
   LOG_INFO("ctor[%p]", this);
 }
@@ -37,7 +88,12 @@ Connector::~Connector()
 void Connector::start()
 {
   connect_ = true;
-  loop_->runInLoop(std::bind(&Connector::startInLoop, this)); // FIXME: unsafe
+  stopped_ = false;
+  ConnectorPtr self(shared_from_this());
+  loop_->runInLoop([self]()
+                   {
+                     self->retries_ = 0;
+                     self->startInLoop(); });
 }
 
 void Connector::startInLoop()
@@ -55,12 +111,13 @@ void Connector::startInLoop()
 void Connector::stop()
 {
   connect_ = false;
-  loop_->queueInLoop(std::bind(&Connector::stopInLoop, this)); // FIXME: unsafe
-  // FIXME: cancel timer
+  stopped_ = true;
+  loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
 }
 
 void Connector::stopInLoop()
 {
+  loop_->cancel(retryTimer_);
   if (state_ == kConnecting)
   {
     setState(kDisconnected);
@@ -72,7 +129,7 @@ void Connector::stopInLoop()
 void Connector::connect()
 {
   int sockfd = sockets::createNonblockingOrDie(serverAddr_.family());
-  int ret = sockets::connect(sockfd, (const struct sockaddr *)serverAddr_.getSocketAddr());
+  int ret = sockets::connect(sockfd, serverAddr_);
   int savedErrno = (ret == 0) ? 0 : errno;
   switch (savedErrno)
   {
@@ -88,6 +145,7 @@ void Connector::connect()
   case EADDRNOTAVAIL:
   case ECONNREFUSED:
   case ENETUNREACH:
+  case ENOENT: // AF_UNIX: the server has not created its socket file yet
     retry(sockfd);
     break;
 
@@ -100,12 +158,13 @@ void Connector::connect()
   case ENOTSOCK:
     LOG_ERROR("connect error in Connector::startInLoop %d", savedErrno);
     sockets::close(sockfd);
+    fail();
     break;
 
   default:
     LOG_ERROR("Unexpected error in Connector::startInLoop %d", savedErrno);
     sockets::close(sockfd);
-    // connectErrorCallback_();
+    fail();
     break;
   }
 }
@@ -114,7 +173,9 @@ void Connector::restart()
 {
   setState(kDisconnected);
   retryDelayMs_ = kInitRetryDelayMs;
+  retries_ = 0;
   connect_ = true;
+  stopped_ = false;
   startInLoop();
 }
 
@@ -130,15 +191,29 @@ void Connector::connecting(int sockfd)
   // channel_->tie(shared_from_this()); is not working,
   // as channel_ is not managed by shared_ptr
   channel_->enableWriting();
+
+  if (connectTimeout_ > 0)
+  {
+    std::weak_ptr<Connector> weak(shared_from_this());
+    timeoutTimer_ = loop_->runAfter(connectTimeout_, [weak]()
+                                    {
+                                      ConnectorPtr self = weak.lock();
+                                      if (self)
+                                      {
+                                        self->handleTimeout();
+                                      } });
+  }
 }
 
 int Connector::removeAndResetChannel()
 {
+  // every way out of kConnecting passes here
+  loop_->cancel(timeoutTimer_);
   channel_->disableAll();
   channel_->remove();
   int sockfd = channel_->fd();
   // Can't reset channel_ here, because we are inside Channel::handleEvent
-  loop_->queueInLoop(std::bind(&Connector::resetChannel, this)); // FIXME: unsafe
+  loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
   return sockfd;
 }
 
@@ -168,6 +243,7 @@ void Connector::handleWrite()
     else
     {
       setState(kConnected);
+      retries_ = 0;
       if (connect_)
       {
         newConnectionCallback_(sockfd);
@@ -196,19 +272,65 @@ void Connector::handleError()
   }
 }
 
+void Connector::handleTimeout()
+{
+  if (state_ == kConnecting)
+  {
+    LOG_WARN("Connector::handleTimeout - connect to %s timed out after %.3f seconds",
+             serverAddr_.toIpPort().c_str(), connectTimeout_);
+    g_connectTimeouts.inc();
+    int sockfd = removeAndResetChannel();
+    retry(sockfd);
+  }
+}
+
 void Connector::retry(int sockfd)
 {
   sockets::close(sockfd);
   setState(kDisconnected);
-  if (connect_)
+  if (!connect_)
   {
-    LOG_INFO("Connector::retry - Retry connecting to %s in %d milliseconds.", serverAddr_.toIpPort().c_str(), retryDelayMs_);
-    loop_->runAfter(retryDelayMs_ / 1000.0,
-                    std::bind(&Connector::startInLoop, shared_from_this()));
-    retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+    LOG_INFO("do not connect");
+  }
+  else if (maxRetries_ >= 0 && retries_ >= maxRetries_)
+  {
+    LOG_ERROR("Connector::retry - give up connecting to %s after %d retries",
+              serverAddr_.toIpPort().c_str(), retries_);
+    fail();
+  }
+  else if (retryBudget_ && !retryBudget_->tryAcquire())
+  {
+    LOG_ERROR("Connector::retry - give up connecting to %s, retry budget used up",
+              serverAddr_.toIpPort().c_str());
+    g_retryBudgetExhausted.inc();
+    fail();
   }
   else
   {
-    LOG_INFO("do not connect");
+    int delayMs = fullJitter(retryDelayMs_);
+    LOG_INFO("Connector::retry - Retry connecting to %s in %d milliseconds.", serverAddr_.toIpPort().c_str(), delayMs);
+    ++retries_;
+    g_connectRetries.inc();
+    retryTimer_ = loop_->runAfter(delayMs / 1000.0,
+                                  std::bind(&Connector::startInLoop, shared_from_this()));
+    retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+  }
+}
+
+void Connector::fail()
+{
+  connect_ = false;
+  g_connectGiveUps.inc();
+  if (connectFailedCallback_)
+  {
+    // connect() may run inside start(), whose caller can hold the lock the
+    // callback needs (e.g. HttpClientPool::send), so never call it directly
+    ConnectorPtr self(shared_from_this());
+    loop_->queueInLoop([self]()
+                       {
+                         if (!self->stopped_)
+                         {
+                           self->connectFailedCallback_();
+                         } });
   }
 }
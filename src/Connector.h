@@ -2,18 +2,44 @@
 
 #include "noncopyable.h"
 #include "InetAddress.h"
+#include "TimerId.h"
 
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <mutex>
 
 class Channel;
 class EventLoop;
 
+/// Retries shared by many Connectors, e.g. all connections of one client, so
+/// that an upstream outage cannot turn into a storm of reconnects however many
+/// connectors are retrying. A token bucket: holds up to capacity retries,
+/// refilled at refillPerSecond, starts full.
+class RetryBudget : noncopyable
+{
+public:
+  RetryBudget(double capacity, double refillPerSecond);
+
+  /// Thread safe. Takes one retry, false if the budget is used up.
+  bool tryAcquire();
+
+private:
+  std::mutex mutex_;
+  const double capacity_;
+  const double refillPerSecond_;
+  double tokens_;
+  std::chrono::steady_clock::time_point lastRefill_;
+};
+
+typedef std::shared_ptr<RetryBudget> RetryBudgetPtr;
+
 class Connector : noncopyable,
                   public std::enable_shared_from_this<Connector>
 {
 public:
   typedef std::function<void(int sockfd)> NewConnectionCallback;
+  typedef std::function<void()> ConnectFailedCallback;
 
   Connector(EventLoop *loop, const InetAddress &serverAddr);
   ~Connector();
@@ -23,9 +49,32 @@ public:
     newConnectionCallback_ = cb;
   }
 
+  /// Called in loop thread when the connector gives up: the retry budget is
+  /// used up, or connect() failed with an error that retrying cannot fix.
+  /// Always queued, never runs inside start(), so the caller may hold a lock
+  /// that the callback takes. Not called if stop() comes first.
+  void setConnectFailedCallback(const ConnectFailedCallback &cb)
+  {
+    connectFailedCallback_ = cb;
+  }
+
+  /// An attempt still in progress after this many seconds is abandoned and
+  /// retried, instead of waiting for the kernel's SYN timeout (~2 minutes).
+  /// 0 (default) disables it. Call before start().
+  void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+
+  /// Retries allowed after failed attempts before giving up, counted from
+  /// start()/restart(); -1 (default) retries forever. Call before start().
+  /// This limit is per connector, see setRetryBudget() for a shared one.
+  void setMaxRetries(int retries) { maxRetries_ = retries; }
+
+  /// Every retry also takes one from budget, the connector gives up when it
+  /// is used up. Null (default) means no shared limit. Call before start().
+  void setRetryBudget(const RetryBudgetPtr &budget) { retryBudget_ = budget; }
+
   void start();   // can be called in any thread
   void restart(); // must be called in loop thread
-  void stop();    // can be called in any thread
+  void stop();    // can be called in any thread, cancels a pending retry
 
   const InetAddress &serverAddress() const { return serverAddr_; }
 
@@ -46,15 +95,27 @@ private:
   void connecting(int sockfd);
   void handleWrite();
   void handleError();
+  void handleTimeout();
   void retry(int sockfd);
+  void fail();
   int removeAndResetChannel();
   void resetChannel();
 
   EventLoop *loop_;
   InetAddress serverAddr_;
   bool connect_; // atomic
+  bool stopped_;  // stop() called since the last start()/restart()
   States state_; // FIXME: use atomic variable
   std::unique_ptr<Channel> channel_;
   NewConnectionCallback newConnectionCallback_;
-  int retryDelayMs_;
+  ConnectFailedCallback connectFailedCallback_;
+  int retryDelayMs_; // ceiling of the next backoff, the actual delay is drawn from [0, retryDelayMs_]
+  double connectTimeout_;
+  int maxRetries_;
+  int retries_;
+  RetryBudgetPtr retryBudget_;
+  TimerId retryTimer_;
+  TimerId timeoutTimer_;
 };
+
+typedef std::shared_ptr<Connector> ConnectorPtr;
@@ -5,6 +5,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <strings.h>
+#include <algorithm>
 
 // channel未添加到poller中
 const int kNew = -1; // channel的成员
@@ -32,7 +33,7 @@ EpollPoller::~EpollPoller()
 Timestamp EpollPoller::poll(int timeoutMs, ChannelList *activateChannels)
 {
     // 使用debug更为合理
-    LOG_DEBUG("func=%s => fd total count:%d\n", __FUNCTION__, static_cast<int>(channels_.size()));
+    LOG_DEBUG("func=%s => channel table size:%d\n", __FUNCTION__, static_cast<int>(channels_.size()));
 
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
     int saveErrno = errno;
@@ -74,7 +75,11 @@ void EpollPoller::updateChannel(Channel *channel)
     {
         if (index == kNew)
         {
-            int fd = channel->fd();
+            size_t fd = static_cast<size_t>(channel->fd());
+            if (fd >= channels_.size())
+            {
+                channels_.resize(std::max(fd + 1, channels_.size() * 2));
+            }
             channels_[fd] = channel;
         }
         channel->set_index(kAdded);
@@ -99,7 +104,7 @@ void EpollPoller::updateChannel(Channel *channel)
 void EpollPoller::removeChannel(Channel *channel)
 {
     int fd = channel->fd();
-    channels_.erase(fd);
+    channels_[fd] = nullptr;
 
     LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
 
@@ -2,6 +2,9 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "Metrics.h"
+#include "StallDetector.h"
+#include "Probes.h"
 
 #include <sys/eventfd.h>
 #include <unistd.h>
@@ -15,6 +18,18 @@ __thread EventLoop *t_loopInThisThread = nullptr;
 // 定义默认的poller IO复用接口超时时间
 const int kPollTimeMs = 10000;
 
+namespace
+{
+    Counter &g_loopIterations = MetricsRegistry::instance().counter(
+        "swiftnet_eventloop_iterations_total", "Number of poll iterations across all event loops");
+    Counter &g_activeChannels = MetricsRegistry::instance().counter(
+        "swiftnet_eventloop_active_channels_total", "Number of channel events dispatched by event loops");
+    Counter &g_functorsRun = MetricsRegistry::instance().counter(
+        "swiftnet_eventloop_functors_total", "Number of pending functors executed by event loops");
+    Gauge &g_pendingFunctors = MetricsRegistry::instance().gauge(
+        "swiftnet_eventloop_pending_functors", "Number of functors queued but not yet executed");
+}
+
 int createEventfd()
 {
     int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
@@ -32,7 +47,10 @@ EventLoop::EventLoop()
       threadId_(CurrentThread::tid()),
       poller_(Poller::newDefaultPoller(this)),
       wakeupFd_(createEventfd()),
-      wakeupChannel_(new Channel(this, wakeupFd_))
+      wakeupChannel_(new Channel(this, wakeupFd_)),
+      eventHandling_(false),
+      timerQueue_(new TimerQueue(this)),
+      slowThresholdMicros_(0)
 {
     LOG_DEBUG("EventLoop create %p in thread %d \n", this, threadId_);
     if (t_loopInThisThread)
@@ -52,6 +70,10 @@ EventLoop::EventLoop()
 
 EventLoop::~EventLoop()
 {
+    if (stackSample_)
+    {
+        StallDetector::instance().remove(stackSample_.get());
+    }
     wakeupChannel_->disableAll();
     wakeupChannel_->remove();
     ::close(wakeupFd_);
@@ -64,16 +86,32 @@ void EventLoop::loop()
     quit_ = false;
 
     LOG_INFO("Eventloop %p start looping \n", this);
+    if (stackSample_)
+    {
+        StallDetector::bindCurrentThread(stackSample_.get());
+    }
 
     while (!quit_)
     {
         activateChannels_.clear();
+        int64_t pollStart = monotonicNanos();
         pollReturnTime_ = poller_->poll(kPollTimeMs, &activateChannels_);
+        pollLatency_.record((monotonicNanos() - pollStart) / 1000);
+        SWIFTNET_PROBE2(poll_wakeup, this, activateChannels_.size());
+        g_loopIterations.inc();
+        g_activeChannels.add(activateChannels_.size());
+        eventHandling_ = true;
         for (Channel *channel : activateChannels_)
         {
-
+            int fd = channel->fd();
+            int64_t start = monotonicNanos();
+            if (stackSample_)
+            {
+                stackSample_->callbackStartNs.store(start, std::memory_order_release);
+            }
             // Poller监听哪些channel发生时间了，然后通知EventLoop,EventLoop通知channel处理相应事件
             channel->handleEvent(pollReturnTime_);
+            finishCallback(kHandleEvent, &handleEventLatency_, channel, fd, start);
         }
 
         // 执行当前EventLoop事件循环需要处理的回调操作
@@ -82,6 +120,8 @@ void EventLoop::loop()
          * mainloop事先注册一个回调cb 需要subloop来执行 wakeup subloop后执行之前mainloop注册的cb操作
          */
         doPendingFunctors();
+        eventHandling_ = false;
+        doIterationEndFunctors();
     }
 
     LOG_INFO("EventLoop %p stop looping. \n", this);
@@ -106,7 +146,7 @@ void EventLoop::runInLoop(Functor cb)
     }
     else
     { // 在非当前loop线程中执行cb
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 // 把cb放入队列中，唤醒loop所在的线程，执行cb
@@ -115,12 +155,15 @@ void EventLoop::queueInLoop(Functor cb)
 {
     {
         std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
+        pendingFunctors_.emplace_back(std::move(cb));
+        g_pendingFunctors.inc();
     }
 
     // 唤醒相应的需要执行上面回调操作的Loop的线程了
     // || callingPendingFunctors_ 的意思是: 当前loop正在执行回调，但是loop又有了新的回调
-    if (!isInLoopThread() || callingPendingFunctors_)
+    // || !eventHandling_: 已经过了本轮的doPendingFunctors(例如在runAfterIteration的回调里),
+    //    不唤醒的话要等下一次poll返回, 空闲的loop上最长kPollTimeMs
+    if (!isInLoopThread() || callingPendingFunctors_ || !eventHandling_)
     {
         wakeup(); // 唤醒loop所在的线程
     }
@@ -161,20 +204,123 @@ bool EventLoop::hasChannel(Channel *channel)
     return poller_->hasChannel(channel);
 }
 
+void EventLoop::runAfterIteration(Functor cb)
+{
+    iterationEndFunctors_.push_back(std::move(cb));
+}
+
+void EventLoop::doIterationEndFunctors()
+{
+    if (iterationEndFunctors_.empty())
+    {
+        return;
+    }
+    std::vector<Functor> functors;
+    functors.swap(iterationEndFunctors_);
+    for (const Functor &functor : functors)
+    {
+        functor();
+    }
+    // 把容量还回去, 下一轮不用重新分配
+    functors.clear();
+    if (iterationEndFunctors_.empty())
+    {
+        iterationEndFunctors_.swap(functors);
+    }
+}
+
 void EventLoop::doPendingFunctors()
 {
     std::vector<Functor> functors;
     callingPendingFunctors_ = true;
+    int64_t start = monotonicNanos();
+    if (stackSample_)
+    {
+        stackSample_->callbackStartNs.store(start, std::memory_order_release);
+    }
 
     {
         std::unique_lock<std::mutex> lock(mutex_);
         functors.swap(pendingFunctors_);
     }
+    SWIFTNET_PROBE2(functors_run, this, functors.size());
     for (const Functor &functor : functors)
     {
         functor(); // 执行当前loop需要执行的回调操作
     }
+    g_functorsRun.add(functors.size());
+    g_pendingFunctors.sub(functors.size());
+    // 把容量还回去, 否则每轮第一次queueInLoop都要重新分配
+    functors.clear();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (pendingFunctors_.empty())
+        {
+            pendingFunctors_.swap(functors);
+        }
+    }
     callingPendingFunctors_ = false;
+    finishCallback(kPendingFunctors, &pendingFunctorsLatency_, nullptr, -1, start);
+}
+
+void EventLoop::setSlowCallback(int64_t thresholdMicros, SlowCallback cb)
+{
+    slowThresholdMicros_ = thresholdMicros;
+    slowCallback_ = std::move(cb);
+}
+
+void EventLoop::enableStackSampling()
+{
+    if (stackSample_ || slowThresholdMicros_ <= 0)
+    {
+        LOG_ERROR("EventLoop::enableStackSampling needs a slow callback threshold \n");
+        return;
+    }
+    stackSample_.reset(new StackSample(threadId_, slowThresholdMicros_ * 1000));
+    if (isInLoopThread())
+    {
+        StallDetector::bindCurrentThread(stackSample_.get());
+    }
+    StallDetector::instance().add(stackSample_.get());
+}
+
+void EventLoop::finishCallback(CallbackPhase phase, Histogram *histogram,
+                               Channel *channel, int fd, int64_t startNs)
+{
+    int64_t elapsedMicros = (monotonicNanos() - startNs) / 1000;
+    histogram->record(elapsedMicros);
+
+    // 定时器回调嵌套在timerfd的handleEvent里, 栈采样归外层回调
+    std::vector<std::string> stack;
+    if (stackSample_ && phase != kTimer)
+    {
+        stackSample_->callbackStartNs.store(0, std::memory_order_release);
+        stackSample_->take(&stack);
+    }
+
+    if (slowThresholdMicros_ > 0 && elapsedMicros >= slowThresholdMicros_)
+    {
+        SlowCallbackInfo info;
+        info.phase = phase;
+        info.fd = fd;
+        info.name = channel ? channel->name() : std::string();
+        info.elapsedMicros = elapsedMicros;
+        info.stack.swap(stack);
+        if (slowCallback_)
+        {
+            slowCallback_(info);
+        }
+        else
+        {
+            LOG_WARN("EventLoop %p slow callback phase=%d fd=%d name=%s took %lld us, stack frames=%d \n",
+                     this, static_cast<int>(phase), fd, info.name.c_str(),
+                     static_cast<long long>(elapsedMicros), static_cast<int>(info.stack.size()));
+            for (const std::string &frame : info.stack)
+            {
+                LOG_WARN("    %s", frame.c_str());
+            }
+        }
+    }
 }
 
 TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
@@ -186,4 +332,9 @@ TimerId EventLoop::runAfter(double delay, TimerCallback cb)
 {
     Timestamp time(addTime(Timestamp::now(), delay));
     return runAt(time, std::move(cb));
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
 }
\ No newline at end of file
@@ -6,15 +6,18 @@
 #include "TimerId.h"
 #include "TimerQueue.h"
 #include "Callback.h"
+#include "Histogram.h"
 
 #include <functional>
 #include <vector>
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <string>
 
 class Channel;
 class Poller;
+struct StackSample;
 
 // 事件循环
 class EventLoop : noncopyable
@@ -22,6 +25,24 @@ class EventLoop : noncopyable
 public:
     using Functor = std::function<void()>;
 
+    enum CallbackPhase
+    {
+        kHandleEvent,     // Channel::handleEvent
+        kPendingFunctors, // 一轮doPendingFunctors
+        kTimer,           // 单个定时器回调
+    };
+
+    // 慢回调的现场信息
+    struct SlowCallbackInfo
+    {
+        CallbackPhase phase;
+        int fd;                         // kPendingFunctors时为-1
+        std::string name;               // channel所属对象的名字, 例如连接名
+        int64_t elapsedMicros;
+        std::vector<std::string> stack; // 开启栈采样并且采到时非空
+    };
+    using SlowCallback = std::function<void(const SlowCallbackInfo &)>;
+
     EventLoop();
     ~EventLoop();
 
@@ -37,10 +58,18 @@ public:
     // 把cb放入队列中，唤醒loop所在的线程，执行cb
     void queueInLoop(Functor cb);
 
+    // 在本轮循环处理完所有事件和pending functors之后执行cb, 只能在loop线程调用
+    // 用来把一轮里的多次操作合并成一次, 比如TcpConnection的写合并
+    void runAfterIteration(Functor cb);
+    // 当前是否正在分发本轮的事件或pending functors
+    bool eventHandling() const { return eventHandling_; }
+
     TimerId runAt(Timestamp time, TimerCallback cb);
 
     TimerId runAfter(double delay, TimerCallback cb);
 
+    void cancel(TimerId timerId);
+
     // 用来唤醒loop所在的线程
     void wakeup();
 
@@ -52,9 +81,28 @@ public:
     // 判断EventLoop是否在自己的线程里
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
 
+    // 各阶段耗时直方图(微秒), 可以在任意线程读取
+    const Histogram &pollLatency() const { return pollLatency_; }
+    const Histogram &handleEventLatency() const { return handleEventLatency_; }
+    const Histogram &pendingFunctorsLatency() const { return pendingFunctorsLatency_; }
+    const Histogram &timerLatency() const { return timerLatency_; }
+
+    // 单次回调耗时超过thresholdMicros时在loop线程中调用cb, cb为空时打WARN日志
+    // 需要在loop()之前或者loop线程中设置
+    void setSlowCallback(int64_t thresholdMicros, SlowCallback cb);
+    // 回调超过阈值仍未返回时, 由看门狗线程给本线程发信号采集调用栈, 随慢回调一起上报
+    void enableStackSampling();
+
 private:
+    friend class TimerQueue;
+
     void handleRead();        // wake up
     void doPendingFunctors(); // 执行回调
+    void doIterationEndFunctors();
+
+    // 记录一次回调的耗时, 超过阈值时上报慢回调
+    void finishCallback(CallbackPhase phase, Histogram *histogram,
+                        Channel *channel, int fd, int64_t startNs);
 
     using ChannelList = std::vector<Channel *>;
 
@@ -72,5 +120,15 @@ private:
     std::atomic_bool callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
     std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的所有回调操作
     std::mutex mutex_;                        // 互斥锁，用来保护上面vector容器的线程安全操作
+    bool eventHandling_;
+    std::vector<Functor> iterationEndFunctors_; // 只在loop线程访问, 不需要加锁
     std::unique_ptr<TimerQueue> timerQueue_;
+
+    Histogram pollLatency_;
+    Histogram handleEventLatency_;
+    Histogram pendingFunctorsLatency_;
+    Histogram timerLatency_;
+    int64_t slowThresholdMicros_;
+    SlowCallback slowCallback_;
+    std::unique_ptr<StackSample> stackSample_;
 };
\ No newline at end of file
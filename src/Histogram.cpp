@@ -0,0 +1,128 @@
+#include "Histogram.h"
+
+#include <stdio.h>
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+int Histogram::bucketIndex(int64_t value)
+{
+    if (value < kSubBucketCount)
+    {
+        return value < 0 ? 0 : static_cast<int>(value);
+    }
+    int msb = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+    int shift = msb - kSubBucketBits;
+    return kSubBucketCount * (shift + 1) + static_cast<int>(value >> shift) - kSubBucketCount;
+}
+
+int64_t Histogram::bucketUpperBound(int index)
+{
+    if (index < kSubBucketCount)
+    {
+        return index;
+    }
+    int shift = index / kSubBucketCount - 1;
+    int64_t sub = index % kSubBucketCount + kSubBucketCount;
+    return (sub << shift) + (static_cast<int64_t>(1) << shift) - 1;
+}
+
+void Histogram::record(int64_t value)
+{
+    addToBucket(bucketIndex(value), 1);
+    total_.store(total_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    if (value > max_.load(std::memory_order_relaxed))
+    {
+        max_.store(value, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::recordCorrected(int64_t value, int64_t expectedInterval)
+{
+    record(value);
+    if (expectedInterval <= 0)
+    {
+        return;
+    }
+    for (int64_t missing = value - expectedInterval; missing >= expectedInterval; missing -= expectedInterval)
+    {
+        record(missing);
+    }
+}
+
+void Histogram::merge(const Histogram &other)
+{
+    for (int i = 0; i < kBucketCount; ++i)
+    {
+        int64_t n = other.counts_[i].load(std::memory_order_relaxed);
+        if (n != 0)
+        {
+            addToBucket(i, n);
+        }
+    }
+    total_.store(count() + other.count(), std::memory_order_relaxed);
+    sum_.store(sum_.load(std::memory_order_relaxed) + other.sum_.load(std::memory_order_relaxed),
+               std::memory_order_relaxed);
+    if (other.max() > max())
+    {
+        max_.store(other.max(), std::memory_order_relaxed);
+    }
+}
+
+void Histogram::reset()
+{
+    for (std::atomic<int64_t> &count : counts_)
+    {
+        count.store(0, std::memory_order_relaxed);
+    }
+    total_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+double Histogram::mean() const
+{
+    int64_t n = count();
+    return n == 0 ? 0.0 : static_cast<double>(sum_.load(std::memory_order_relaxed)) / n;
+}
+
+int64_t Histogram::percentile(double p) const
+{
+    int64_t total = count();
+    if (total == 0)
+    {
+        return 0;
+    }
+    int64_t rank = static_cast<int64_t>(p / 100.0 * total + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    int64_t seen = 0;
+    for (int i = 0; i < kBucketCount; ++i)
+    {
+        seen += counts_[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+        {
+            int64_t upper = bucketUpperBound(i);
+            return upper < max() ? upper : max();
+        }
+    }
+    return max();
+}
+
+std::string Histogram::toString() const
+{
+    char buf[256] = {0};
+    snprintf(buf, sizeof buf, "count=%lld mean=%.1f p50=%lld p90=%lld p99=%lld p99.9=%lld max=%lld",
+             static_cast<long long>(count()), mean(),
+             static_cast<long long>(percentile(50)),
+             static_cast<long long>(percentile(90)),
+             static_cast<long long>(percentile(99)),
+             static_cast<long long>(percentile(99.9)),
+             static_cast<long long>(max()));
+    return buf;
+}
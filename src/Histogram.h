@@ -0,0 +1,53 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+/**
+ * HDR风格的对数线性直方图: 每个2的幂区间再均分成32个子桶, 相对误差约3%
+ * 只允许一个线程写入(record/merge/reset), 任意线程都可以读取, 读到的是近似一致的快照
+ */
+class Histogram : noncopyable
+{
+public:
+    Histogram();
+
+    // 记录一个值, 本库统一使用微秒
+    void record(int64_t value);
+    // 按固定间隔补齐被阻塞期间"应该发生"的样本, 用于修正协调遗漏(coordinated omission)
+    void recordCorrected(int64_t value, int64_t expectedInterval);
+    // 合并另一个直方图, 用于汇总多个loop/线程的数据
+    void merge(const Histogram &other);
+    void reset();
+
+    int64_t count() const { return total_.load(std::memory_order_relaxed); }
+    int64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const;
+    // p取值[0, 100], 返回该分位所在桶的上界
+    int64_t percentile(double p) const;
+
+    // count=.. mean=.. p50=.. p90=.. p99=.. p99.9=.. max=..
+    std::string toString() const;
+
+private:
+    static const int kSubBucketBits = 5;
+    static const int kSubBucketCount = 1 << kSubBucketBits;
+    static const int kBucketCount = kSubBucketCount * (64 - kSubBucketBits);
+
+    static int bucketIndex(int64_t value);
+    static int64_t bucketUpperBound(int index);
+
+    void addToBucket(int index, int64_t n)
+    {
+        counts_[index].store(counts_[index].load(std::memory_order_relaxed) + n,
+                             std::memory_order_relaxed);
+    }
+
+    std::atomic<int64_t> counts_[kBucketCount];
+    std::atomic<int64_t> total_;
+    std::atomic<int64_t> sum_;
+    std::atomic<int64_t> max_;
+};
@@ -1,30 +1,98 @@
 #include "InetAddress.h"
 
+#include <stddef.h>
 #include <strings.h>
 #include <string.h>
 
 InetAddress::InetAddress()
 {
-
+    bzero(&unix_, sizeof unix_);
+    len_ = sizeof addr_;
 }
 
 InetAddress::InetAddress(uint16_t port, std::string ip)
 {
-    bzero(&addr_, sizeof addr_);
+    bzero(&unix_, sizeof unix_);
     addr_.sin_family = AF_INET;
     addr_.sin_port = htons(port);
     addr_.sin_addr.s_addr = inet_addr(ip.c_str());
+    len_ = sizeof addr_;
 };
 
+InetAddress::InetAddress(const sockaddr_in &addr)
+{
+    bzero(&unix_, sizeof unix_);
+    addr_ = addr;
+    len_ = sizeof addr_;
+}
+
+InetAddress::InetAddress(const sockaddr *addr, socklen_t len)
+{
+    bzero(&unix_, sizeof unix_);
+    if (len > sizeof unix_)
+    {
+        len = sizeof unix_;
+    }
+    ::memcpy(&unix_, addr, len);
+    len_ = len;
+}
+
+InetAddress InetAddress::fromUnixPath(const std::string &path)
+{
+    InetAddress result;
+    result.unix_.sun_family = AF_UNIX;
+    // 抽象命名空间的名字不以'\0'结尾, 长度必须精确
+    bool abstract = !path.empty() && path[0] == '@';
+    if (path.empty() || path.size() >= sizeof result.unix_.sun_path)
+    {
+        result.unix_.sun_family = AF_UNSPEC;
+        return result;
+    }
+    ::memcpy(result.unix_.sun_path, path.data(), path.size());
+    if (abstract)
+    {
+        result.unix_.sun_path[0] = '\0';
+        result.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+    }
+    else
+    {
+        result.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+    }
+    return result;
+}
+
+void InetAddress::setSockAddr(const sockaddr_in &addr)
+{
+    bzero(&unix_, sizeof unix_);
+    addr_ = addr;
+    len_ = sizeof addr_;
+}
 
 std::string InetAddress::toIp() const
 {
+    if (isUnix())
+    {
+        size_t pathLen = len_ > offsetof(sockaddr_un, sun_path) ? len_ - offsetof(sockaddr_un, sun_path) : 0;
+        if (pathLen == 0)
+        {
+            return std::string();
+        }
+        if (unix_.sun_path[0] == '\0')
+        {
+            return "@" + std::string(unix_.sun_path + 1, pathLen - 1);
+        }
+        return std::string(unix_.sun_path, strnlen(unix_.sun_path, pathLen));
+    }
     char buf[64] = {0};
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
     return buf;
 };
 std::string InetAddress::toIpPort() const
 {
+    if (isUnix())
+    {
+        return "unix:" + toIp();
+    }
     char buf[64] = {0};
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
     size_t end = strlen(buf);
@@ -36,7 +104,7 @@ std::string InetAddress::toIpPort() const
 };
 uint16_t InetAddress::toPort() const
 {
-    return ntohs(addr_.sin_port);
+    return isUnix() ? 0 : ntohs(addr_.sin_port);
 };
 
 // int main(){
@@ -44,4 +112,3 @@ uint16_t InetAddress::toPort() const
 //     std::cout << addr.toIpPort() << std::endl;
 //     return 0;
 // }
-
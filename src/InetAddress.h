@@ -3,25 +3,41 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <string>
+#include <sys/un.h>
 
+// 套接字地址: IPv4, 或者AF_UNIX流式套接字的路径
+// TcpServer/TcpClient/HttpServer等只通过family()/getSockAddr()/getSockLen()使用它, 不关心具体类型
 class InetAddress
 {
 public:
     InetAddress();
     explicit InetAddress(uint16_t port, std::string ip = "127.0.0.1");
-    explicit InetAddress(const sockaddr_in &addr)
-        : addr_(addr)
-    {
-    }
+    explicit InetAddress(const sockaddr_in &addr);
+    // accept/getsockname/getpeername得到的地址, len为内核返回的长度
+    InetAddress(const sockaddr *addr, socklen_t len);
+
+    // AF_UNIX地址: 以'@'开头的是抽象命名空间(不在文件系统里创建文件), 否则是文件路径
+    // 路径超过sun_path长度时返回的地址family()为AF_UNSPEC
+    static InetAddress fromUnixPath(const std::string &path);
 
     sa_family_t family() const { return addr_.sin_family; }
+    bool isUnix() const { return family() == AF_UNIX; }
+    // IPv4返回ip, AF_UNIX返回路径(抽象命名空间以'@'开头, 未绑定的客户端为空)
     std::string toIp() const;
+    // IPv4返回ip:port, AF_UNIX返回unix:路径
     std::string toIpPort() const;
     uint16_t toPort() const;
 
+    const sockaddr *getSockAddr() const { return reinterpret_cast<const sockaddr *>(&addr_); }
+    socklen_t getSockLen() const { return len_; }
     const sockaddr_in *getSocketAddr() const { return &addr_; }
-    void setSockAddr(const sockaddr_in &addr) { addr_ = addr; };
+    void setSockAddr(const sockaddr_in &addr);
 
 private:
-    struct sockaddr_in addr_;
-};
\ No newline at end of file
+    union
+    {
+        struct sockaddr_in addr_;
+        struct sockaddr_un unix_;
+    };
+    socklen_t len_;
+};
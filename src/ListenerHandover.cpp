@@ -0,0 +1,305 @@
+#include "ListenerHandover.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * 交接协议: 新进程connect之后, 老进程发一条消息, 数据部分是以'\n'结尾的名字列表,
+ * 控制部分是SCM_RIGHTS, fd顺序和名字一一对应; 新进程开始accept之后回一个字节'A'
+ */
+namespace
+{
+    const size_t kMaxListeners = 64;
+    const size_t kMaxPayload = 4096;
+    const char kAck = 'A';
+
+    bool fillAddress(const std::string &path, struct sockaddr_un *addr)
+    {
+        ::memset(addr, 0, sizeof *addr);
+        addr->sun_family = AF_UNIX;
+        if (path.size() >= sizeof addr->sun_path)
+        {
+            LOG_ERROR("handover path too long: %s \n", path.c_str());
+            return false;
+        }
+        ::memcpy(addr->sun_path, path.data(), path.size());
+        return true;
+    }
+}
+
+ListenerHandoverServer::ListenerHandoverServer(EventLoop *loop, const std::string &path)
+    : loop_(loop),
+      path_(path),
+      listenFd_(-1),
+      peerFd_(-1),
+      handedOver_(false)
+{
+}
+
+ListenerHandoverServer::~ListenerHandoverServer()
+{
+    closePeer();
+    if (listenFd_ >= 0)
+    {
+        listenChannel_->disableAll();
+        listenChannel_->remove();
+        ::close(listenFd_);
+    }
+    // 不unlink path_: 交接之后这个路径已经属于新进程了
+}
+
+void ListenerHandoverServer::addListener(const std::string &name, int fd)
+{
+    if (listeners_.size() >= kMaxListeners)
+    {
+        LOG_ERROR("ListenerHandoverServer too many listeners, %s dropped \n", name.c_str());
+        return;
+    }
+    listeners_.emplace_back(name, fd);
+}
+
+void ListenerHandoverServer::start()
+{
+    struct sockaddr_un addr;
+    if (!fillAddress(path_, &addr))
+    {
+        return;
+    }
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0)
+    {
+        LOG_FATAL("ListenerHandoverServer socket err:%d \n", errno);
+    }
+    // 上一个进程留下的socket文件
+    ::unlink(path_.c_str());
+    if (::bind(listenFd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0 ||
+        ::listen(listenFd_, 4) < 0)
+    {
+        LOG_FATAL("ListenerHandoverServer bind %s err:%d \n", path_.c_str(), errno);
+    }
+    listenChannel_.reset(new Channel(loop_, listenFd_));
+    listenChannel_->setReadCallback(std::bind(&ListenerHandoverServer::handleAccept, this));
+    listenChannel_->enableReading();
+}
+
+void ListenerHandoverServer::handleAccept()
+{
+    // 对端只收一条很短的消息, 用阻塞socket直接发
+    int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("ListenerHandoverServer accept err:%d \n", errno);
+        return;
+    }
+    if (peerFd_ >= 0 || handedOver_)
+    {
+        LOG_ERROR("ListenerHandoverServer handover already in progress \n");
+        ::close(fd);
+        return;
+    }
+
+    std::string names;
+    std::vector<int> fds;
+    for (const auto &listener : listeners_)
+    {
+        names += listener.first;
+        names += '\n';
+        fds.push_back(listener.second);
+    }
+    if (names.empty())
+    {
+        names = "\n"; // 至少要有一个字节的数据, 控制消息才能带过去
+    }
+
+    struct iovec iov;
+    iov.iov_base = &names[0];
+    iov.iov_len = names.size();
+    char control[CMSG_SPACE(sizeof(int) * kMaxListeners)];
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (!fds.empty())
+    {
+        ::memset(control, 0, sizeof control);
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        ::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+    if (::sendmsg(fd, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(names.size()))
+    {
+        LOG_ERROR("ListenerHandoverServer sendmsg err:%d \n", errno);
+        ::close(fd);
+        return;
+    }
+    LOG_INFO("ListenerHandoverServer sent %d listen fds, waiting for ack \n", static_cast<int>(fds.size()));
+
+    peerFd_ = fd;
+    peerChannel_.reset(new Channel(loop_, peerFd_));
+    peerChannel_->setReadCallback(std::bind(&ListenerHandoverServer::handleAck, this));
+    peerChannel_->enableReading();
+}
+
+void ListenerHandoverServer::handleAck()
+{
+    char ack = 0;
+    ssize_t n = ::read(peerFd_, &ack, 1);
+    closePeer();
+    if (n != 1 || ack != kAck)
+    {
+        // 新进程没起来, 老进程继续服务, 等下一次交接
+        LOG_ERROR("ListenerHandoverServer new process went away without ack \n");
+        return;
+    }
+
+    LOG_INFO("ListenerHandoverServer handover to new process finished \n");
+    handedOver_ = true;
+    listenChannel_->disableAll();
+    listenChannel_->remove();
+    ::close(listenFd_);
+    listenFd_ = -1;
+    if (handoverCallback_)
+    {
+        handoverCallback_();
+    }
+}
+
+void ListenerHandoverServer::closePeer()
+{
+    if (peerFd_ >= 0)
+    {
+        peerChannel_->disableAll();
+        peerChannel_->remove();
+        ::close(peerFd_);
+        peerFd_ = -1;
+    }
+}
+
+ListenerHandoverClient::ListenerHandoverClient(const std::string &path)
+    : path_(path),
+      fd_(-1)
+{
+}
+
+ListenerHandoverClient::~ListenerHandoverClient()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+bool ListenerHandoverClient::fetch(std::map<std::string, int> *fds)
+{
+    struct sockaddr_un addr;
+    if (!fillAddress(path_, &addr))
+    {
+        return false;
+    }
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0)
+    {
+        LOG_ERROR("ListenerHandoverClient socket err:%d \n", errno);
+        return false;
+    }
+    if (::connect(fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        // ENOENT/ECONNREFUSED: 没有老进程, 正常启动
+        LOG_INFO("ListenerHandoverClient no process to take over from at %s \n", path_.c_str());
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    // 老进程卡住时不要让新进程一直等下去
+    struct timeval timeout = {5, 0};
+    ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+    char payload[kMaxPayload];
+    struct iovec iov;
+    iov.iov_base = payload;
+    iov.iov_len = sizeof payload;
+    char control[CMSG_SPACE(sizeof(int) * kMaxListeners)];
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    ssize_t n = ::recvmsg(fd_, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0)
+    {
+        LOG_ERROR("ListenerHandoverClient recvmsg err:%d \n", errno);
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    std::vector<int> received;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *data = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+            received.insert(received.end(), data, data + count);
+        }
+    }
+
+    std::vector<std::string> names;
+    const char *start = payload;
+    const char *end = payload + n;
+    for (const char *p = start; p < end; ++p)
+    {
+        if (*p == '\n')
+        {
+            if (p > start)
+            {
+                names.emplace_back(start, p);
+            }
+            start = p + 1;
+        }
+    }
+    if ((msg.msg_flags & (MSG_CTRUNC | MSG_TRUNC)) || names.size() != received.size())
+    {
+        LOG_ERROR("ListenerHandoverClient malformed handover message: %d names, %d fds \n",
+                  static_cast<int>(names.size()), static_cast<int>(received.size()));
+        for (int fd : received)
+        {
+            ::close(fd);
+        }
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        (*fds)[names[i]] = received[i];
+    }
+    LOG_INFO("ListenerHandoverClient took over %d listen fds \n", static_cast<int>(received.size()));
+    return true;
+}
+
+void ListenerHandoverClient::ack()
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+    if (::write(fd_, &kAck, 1) != 1)
+    {
+        LOG_ERROR("ListenerHandoverClient ack err:%d \n", errno);
+    }
+    ::close(fd_);
+    fd_ = -1;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+class Channel;
+
+/**
+ * 热升级: 老进程通过Unix domain socket(SCM_RIGHTS)把监听fd交给新进程, 两个进程共用同一个监听socket,
+ * 交接期间始终有进程在accept, 不会出现连接被拒绝
+ *
+ * 老进程:
+ *   ListenerHandoverServer handover(&loop, "/run/app.handover");
+ *   handover.addListener("http", server.listenFd());
+ *   handover.setHandoverCallback([&] {
+ *       server.setListenerHandedOver(); // backlog里的连接留给新进程
+ *       server.drain(30, [&] { loop.quit(); });
+ *   });
+ *   handover.start();
+ *
+ * 新进程(在loop开始之前):
+ *   ListenerHandoverClient client("/run/app.handover");
+ *   std::map<std::string, int> fds;
+ *   if (client.fetch(&fds)) -> TcpServer(&loop, fds["http"], name) 接管, 否则正常bind/listen
+ *   所有server start()之后 client.ack(), 老进程收到ack才开始drain
+ */
+class ListenerHandoverServer : noncopyable
+{
+public:
+    using HandoverCallback = std::function<void()>;
+
+    ListenerHandoverServer(EventLoop *loop, const std::string &path);
+    ~ListenerHandoverServer();
+
+    // fd的所有权不转移, 调用者保证交接完成前fd有效
+    void addListener(const std::string &name, int fd);
+    // 新进程ack之后在loop中调用, 一般用来drain
+    void setHandoverCallback(const HandoverCallback &cb) { handoverCallback_ = cb; }
+
+    // 删除旧的socket文件并开始监听path, 只能在loop线程调用
+    void start();
+
+private:
+    void handleAccept();
+    void handleAck();
+    void closePeer();
+
+    EventLoop *loop_;
+    const std::string path_;
+    int listenFd_;
+    std::unique_ptr<Channel> listenChannel_;
+    int peerFd_; // 正在交接的新进程, 同一时间只有一个
+    std::unique_ptr<Channel> peerChannel_;
+    std::vector<std::pair<std::string, int>> listeners_;
+    HandoverCallback handoverCallback_;
+    bool handedOver_;
+};
+
+class ListenerHandoverClient : noncopyable
+{
+public:
+    explicit ListenerHandoverClient(const std::string &path);
+    ~ListenerHandoverClient();
+
+    // 连接老进程取回监听fd(name -> fd), 没有老进程在等待交接时返回false
+    bool fetch(std::map<std::string, int> *fds);
+    // 通知老进程新进程已经开始accept, 之后老进程可以停止accept了
+    void ack();
+
+private:
+    const std::string path_;
+    int fd_;
+};
@@ -7,10 +7,13 @@
 #define MUDEBUG
 
 // LOG_INFO("%s %d", arg1, arg2)
+// 低于minLogLevel的日志直接跳过, 参数不会被求值
 #define LOG_INFO(logmsgFormat, ...)                       \
     do                                                    \
     {                                                     \
         Logger &logger = Logger::instance();              \
+        if (logger.minLogLevel() > INFO)                  \
+            break;                                        \
         logger.setLogLevel(INFO);                         \
         char buf[1024] = {0};                             \
         snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
@@ -21,6 +24,8 @@
     do                                                    \
     {                                                     \
         Logger &logger = Logger::instance();              \
+        if (logger.minLogLevel() > WARN)                  \
+            break;                                        \
         logger.setLogLevel(WARN);                         \
         char buf[1024] = {0};                             \
         snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
@@ -31,6 +36,8 @@
     do                                                    \
     {                                                     \
         Logger &logger = Logger::instance();              \
+        if (logger.minLogLevel() > ERROR)                 \
+            break;                                        \
         logger.setLogLevel(ERROR);                        \
         char buf[1024] = {0};                             \
         snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
@@ -53,6 +60,8 @@
     do                                                    \
     {                                                     \
         Logger &logger = Logger::instance();              \
+        if (logger.minLogLevel() > DEBUG)                 \
+            break;                                        \
         logger.setLogLevel(DEBUG);                        \
         char buf[1024] = {0};                             \
         snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
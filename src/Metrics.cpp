@@ -0,0 +1,119 @@
+#include "Metrics.h"
+#include "Logger.h"
+
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace metrics
+{
+    __thread int t_shardIndex = -1;
+
+    static std::atomic<int> s_nextShard(0);
+
+    int assignShardIndex()
+    {
+        t_shardIndex = s_nextShard.fetch_add(1, std::memory_order_relaxed) % kNumShards;
+        return t_shardIndex;
+    }
+}
+
+Metric::Metric(Type type, const std::string &name, const std::string &help)
+    : type_(type),
+      name_(name),
+      help_(help)
+{
+    for (Shard &shard : shards_)
+    {
+        shard.value.store(0, std::memory_order_relaxed);
+    }
+}
+
+void *Metric::operator new(size_t size)
+{
+    void *p = nullptr;
+    if (::posix_memalign(&p, metrics::kCacheLineSize, size) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void Metric::operator delete(void *p)
+{
+    ::free(p);
+}
+
+int64_t Metric::value() const
+{
+    int64_t sum = 0;
+    for (const Shard &shard : shards_)
+    {
+        sum += shard.value.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+MetricsRegistry &MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+Metric *MetricsRegistry::find(const std::string &name) const
+{
+    auto it = metrics_.find(name);
+    return it == metrics_.end() ? nullptr : it->second.get();
+}
+
+Counter &MetricsRegistry::counter(const std::string &name, const std::string &help)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Metric *metric = find(name);
+    if (metric == nullptr)
+    {
+        metric = new Counter(name, help);
+        metrics_[name].reset(metric);
+    }
+    else if (metric->type() != Metric::kCounter)
+    {
+        LOG_FATAL("metric %s already registered as another type \n", name.c_str());
+    }
+    return *static_cast<Counter *>(metric);
+}
+
+Gauge &MetricsRegistry::gauge(const std::string &name, const std::string &help)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Metric *metric = find(name);
+    if (metric == nullptr)
+    {
+        metric = new Gauge(name, help);
+        metrics_[name].reset(metric);
+    }
+    else if (metric->type() != Metric::kGauge)
+    {
+        LOG_FATAL("metric %s already registered as another type \n", name.c_str());
+    }
+    return *static_cast<Gauge *>(metric);
+}
+
+void MetricsRegistry::writePrometheus(std::string *out) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    char buf[32];
+    for (const auto &item : metrics_)
+    {
+        const Metric &metric = *item.second;
+        out->append("# HELP ");
+        out->append(metric.name());
+        out->append(" ");
+        out->append(metric.help());
+        out->append("\n# TYPE ");
+        out->append(metric.name());
+        out->append(metric.type() == Metric::kCounter ? " counter\n" : " gauge\n");
+        out->append(metric.name());
+        snprintf(buf, sizeof buf, " %lld\n", static_cast<long long>(metric.value()));
+        out->append(buf);
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace metrics
+{
+    // 每个指标按线程分片存储, 写入时只碰自己线程的分片, 读取时再汇总
+    const int kNumShards = 16;
+    const size_t kCacheLineSize = 64;
+
+    extern __thread int t_shardIndex;
+
+    int assignShardIndex();
+
+    inline int shardIndex()
+    {
+        if (__builtin_expect(t_shardIndex < 0, 0))
+        {
+            return assignShardIndex();
+        }
+        return t_shardIndex;
+    }
+}
+
+// 所有指标的公共部分: 名字、说明和分片后的数值
+class Metric : noncopyable
+{
+public:
+    enum Type
+    {
+        kCounter,
+        kGauge,
+    };
+
+    Metric(Type type, const std::string &name, const std::string &help);
+    virtual ~Metric() = default;
+
+    // 分片要求按cache line对齐, C++11的new不保证超过alignof(max_align_t)的对齐, 这里自己分配
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
+
+    Type type() const { return type_; }
+    const std::string &name() const { return name_; }
+    const std::string &help() const { return help_; }
+
+    // 汇总所有分片
+    int64_t value() const;
+
+protected:
+    void addToShard(int64_t n)
+    {
+        shards_[metrics::shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+private:
+    // 每个分片独占一个cache line, 避免不同线程之间的伪共享
+    struct alignas(metrics::kCacheLineSize) Shard
+    {
+        std::atomic<int64_t> value;
+    };
+    static_assert(sizeof(Shard) == metrics::kCacheLineSize, "a shard must fill exactly one cache line");
+
+    const Type type_;
+    const std::string name_;
+    const std::string help_;
+    Shard shards_[metrics::kNumShards];
+};
+
+// 单调递增的计数器
+class Counter : public Metric
+{
+public:
+    Counter(const std::string &name, const std::string &help)
+        : Metric(kCounter, name, help)
+    {
+    }
+
+    void inc() { addToShard(1); }
+    void add(int64_t n) { addToShard(n); }
+};
+
+// 可增可减的瞬时值, 例如连接数、队列长度
+class Gauge : public Metric
+{
+public:
+    Gauge(const std::string &name, const std::string &help)
+        : Metric(kGauge, name, help)
+    {
+    }
+
+    void inc() { addToShard(1); }
+    void dec() { addToShard(-1); }
+    void add(int64_t n) { addToShard(n); }
+    void sub(int64_t n) { addToShard(-n); }
+};
+
+// 全局指标注册表, 指标对象创建后永不销毁, 返回的引用可以长期缓存
+class MetricsRegistry : noncopyable
+{
+public:
+    static MetricsRegistry &instance();
+
+    // 同名指标只会创建一次, 重复获取返回同一个对象
+    Counter &counter(const std::string &name, const std::string &help);
+    Gauge &gauge(const std::string &name, const std::string &help);
+
+    // 以Prometheus文本格式(version 0.0.4)输出所有指标
+    void writePrometheus(std::string *out) const;
+
+private:
+    MetricsRegistry() = default;
+
+    Metric *find(const std::string &name) const;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<Metric>> metrics_;
+};
@@ -0,0 +1,262 @@
+#include "OutputQueue.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+FileRegion::FileRegion(int fd)
+    : fd_(fd)
+{
+}
+
+FileRegion::~FileRegion()
+{
+    ::close(fd_);
+}
+
+void OutputQueue::append(const void *data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    // 队尾已经很大时另起一段, 避免追加时重新分配并拷贝整个大分段;
+    // 被内核zero copy引用的分段也不能再追加, 否则重新分配会改动正在发送的内存
+    if (segments_.size() == sent_ ||
+        segments_.back().kind != Segment::kBytes ||
+        segments_.back().bytes.size() >= kCoalesceBytes ||
+        segments_.back().zeroCopy)
+    {
+        segments_.push_back(Segment(Segment::kBytes));
+    }
+    Segment &seg = segments_.back();
+    seg.bytes.append(static_cast<const char *>(data), len);
+    seg.length += len;
+    bytes_ += len;
+}
+
+void OutputQueue::append(std::string &&data)
+{
+    if (data.size() < kCoalesceBytes)
+    {
+        append(data.data(), data.size());
+        return;
+    }
+    Segment seg(Segment::kBytes);
+    seg.length = data.size();
+    seg.bytes = std::move(data);
+    bytes_ += seg.length;
+    segments_.push_back(std::move(seg));
+}
+
+void OutputQueue::append(const BlobPtr &blob, size_t offset)
+{
+    if (!blob || offset >= blob->size())
+    {
+        return;
+    }
+    size_t len = blob->size() - offset;
+    if (len < kCoalesceBytes)
+    {
+        append(blob->data() + offset, len);
+        return;
+    }
+    Segment seg(Segment::kBlob);
+    seg.blob = blob;
+    seg.offset = offset;
+    seg.length = blob->size();
+    bytes_ += len;
+    segments_.push_back(std::move(seg));
+}
+
+void OutputQueue::append(const FileRegionPtr &file, off_t offset, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    Segment seg(Segment::kFile);
+    seg.file = file;
+    seg.fileOffset = offset;
+    seg.length = len;
+    bytes_ += len;
+    segments_.push_back(std::move(seg));
+}
+
+ssize_t OutputQueue::writeFd(int fd, int *savedErrno)
+{
+    ssize_t total = 0;
+    while (bytes_ > 0)
+    {
+        size_t attempted = 0;
+        ssize_t n = writeOnce(fd, &attempted);
+        if (n < 0)
+        {
+            *savedErrno = errno;
+            return total > 0 ? total : -1;
+        }
+        if (n == 0 && attempted > 0 && firstUnsent()->kind == Segment::kFile)
+        {
+            // 文件在发送前被截断, sendfile读到文件末尾只会一直返回0, 继续等可写事件会空转
+            // 先把已经写出的字节数报告给调用方, 下一次调用再丢掉这个分段并报错
+            if (total > 0)
+            {
+                break;
+            }
+            consume(firstUnsent()->remaining());
+            *savedErrno = EIO;
+            return -1;
+        }
+        consume(n);
+        total += n;
+        // 没有写完说明内核发送缓冲区已满, 等下一次可写事件
+        if (static_cast<size_t>(n) < attempted)
+        {
+            break;
+        }
+    }
+    return total;
+}
+
+ssize_t OutputQueue::writeOnce(int fd, size_t *attempted)
+{
+    Segment &front = *firstUnsent();
+    if (front.kind == Segment::kFile)
+    {
+        off_t offset = front.fileOffset + static_cast<off_t>(front.offset);
+        *attempted = front.remaining();
+        return ::sendfile(fd, front.file->fd(), &offset, *attempted);
+    }
+
+    struct iovec iov[IOV_MAX];
+    int iovcnt = 0;
+    size_t len = 0;
+    for (std::deque<Segment>::iterator it = segments_.begin() + sent_;
+         it != segments_.end() && iovcnt < IOV_MAX && it->kind != Segment::kFile;
+         ++it)
+    {
+        const char *base = it->kind == Segment::kBytes ? it->bytes.data() : it->blob->data();
+        iov[iovcnt].iov_base = const_cast<char *>(base + it->offset);
+        iov[iovcnt].iov_len = it->remaining();
+        len += iov[iovcnt].iov_len;
+        ++iovcnt;
+    }
+    *attempted = len;
+
+    if (zeroCopyThreshold_ > 0 && len >= zeroCopyThreshold_)
+    {
+        ssize_t n = writeZeroCopy(fd, iov, iovcnt);
+        // optmem不够时内核返回ENOBUFS, 这一次退回普通的拷贝发送
+        if (n >= 0 || errno != ENOBUFS)
+        {
+            return n;
+        }
+    }
+    if (iovcnt == 1)
+    {
+        return ::write(fd, iov[0].iov_base, iov[0].iov_len);
+    }
+    return ::writev(fd, iov, iovcnt);
+}
+
+ssize_t OutputQueue::writeZeroCopy(int fd, struct iovec *iov, int iovcnt)
+{
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    ssize_t n = ::sendmsg(fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (n > 0)
+    {
+        // 这次写出的数据所在的分段都要保留到内核通知完成
+        uint32_t id = nextZeroCopyId_++;
+        size_t covered = 0;
+        for (std::deque<Segment>::iterator it = segments_.begin() + sent_;
+             it != segments_.end() && covered < static_cast<size_t>(n);
+             ++it)
+        {
+            it->zeroCopy = true;
+            it->zeroCopyId = id;
+            covered += it->remaining();
+        }
+    }
+    return n;
+}
+
+void OutputQueue::completeZeroCopy(uint32_t lo, uint32_t hi)
+{
+    (void)lo;
+    // TCP上的完成通知是按序的, hi之前的发送都已经完成
+    if (static_cast<int32_t>(hi + 1 - zeroCopyCompleted_) > 0)
+    {
+        zeroCopyCompleted_ = hi + 1;
+    }
+    releaseCompleted();
+}
+
+void OutputQueue::releaseCompleted()
+{
+    while (sent_ > 0 && zeroCopyDone(segments_.front()))
+    {
+        segments_.pop_front();
+        --sent_;
+    }
+}
+
+void OutputQueue::moveInFlightTo(OutputQueue *dst)
+{
+    clear();
+    // deque的移动赋值直接接管内存块, 不会移动元素
+    dst->segments_ = std::move(segments_);
+    dst->sent_ = sent_;
+    dst->bytes_ = 0;
+    dst->zeroCopyThreshold_ = zeroCopyThreshold_;
+    dst->nextZeroCopyId_ = nextZeroCopyId_;
+    dst->zeroCopyCompleted_ = zeroCopyCompleted_;
+    segments_.clear();
+    sent_ = 0;
+}
+
+void OutputQueue::consume(size_t n)
+{
+    bytes_ -= n;
+    while (n > 0)
+    {
+        Segment &seg = segments_[sent_];
+        size_t remaining = seg.remaining();
+        if (n < remaining)
+        {
+            seg.offset += n;
+            return;
+        }
+        n -= remaining;
+        seg.offset = seg.length;
+        if (sent_ == 0 && zeroCopyDone(seg))
+        {
+            segments_.pop_front();
+        }
+        else
+        {
+            ++sent_; // 内核还可能在引用, 留在原地等完成通知
+        }
+    }
+}
+
+void OutputQueue::clear()
+{
+    // 只有第一个待发送的分段可能被部分写出并被内核引用, 其余的从队尾删除不会移动留下的元素
+    Segment *seg = firstUnsent();
+    if (seg != nullptr && !zeroCopyDone(*seg))
+    {
+        seg->offset = seg->length;
+        ++sent_;
+    }
+    segments_.erase(segments_.begin() + sent_, segments_.end());
+    bytes_ = 0;
+    releaseCompleted();
+}
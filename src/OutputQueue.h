@@ -0,0 +1,133 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Blob.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+
+// 文件描述符的所有权, 析构时关闭, 同一个文件可以被多个分段共享
+class FileRegion : noncopyable
+{
+public:
+    explicit FileRegion(int fd);
+    ~FileRegion();
+
+    int fd() const { return fd_; }
+
+private:
+    const int fd_;
+};
+
+using FileRegionPtr = std::shared_ptr<FileRegion>;
+
+/**
+ * TcpConnection的发送队列, 由不同类型的分段组成:
+ *   自有字节(小块数据合并到队尾, std::string直接移入), 共享的不可变Blob, 文件区间
+ * 内存分段一次writev最多发送IOV_MAX段, 文件区间用sendfile发送, 都不需要先拷贝到连接的缓冲区
+ * 开启zero copy后, 一次不少于阈值字节的writev改用MSG_ZEROCOPY发送, 写完的分段原地留在队头
+ * (不能移动, 短字符串的数据就在分段对象里), 直到内核通过错误队列通知完成才释放.
+ * 连接在通知到达之前销毁时, 用moveInFlightTo把这些分段交给一个活得更久的队列, 由它继续等完成通知
+ * 只能在loop线程中使用
+ */
+struct iovec;
+
+class OutputQueue : noncopyable
+{
+public:
+    // 小于这个长度的数据拷贝合并到队尾的字节分段, 避免产生大量很小的分段
+    static const size_t kCoalesceBytes = 4096;
+
+    OutputQueue()
+        : sent_(0),
+          bytes_(0),
+          zeroCopyThreshold_(0),
+          nextZeroCopyId_(0),
+          zeroCopyCompleted_(0)
+    {
+    }
+
+    size_t readableBytes() const { return bytes_; }
+    bool empty() const { return bytes_ == 0; }
+
+    void append(const void *data, size_t len);
+    void append(std::string &&data);
+    void append(const BlobPtr &blob, size_t offset = 0);
+    void append(const FileRegionPtr &file, off_t offset, size_t len);
+
+    // 写到fd直到队列为空或内核发送缓冲区写满, 返回写出的字节数, 出错且没有写出任何数据时返回-1
+    // 文件区间没发完文件就被截断时丢掉该分段, 返回-1并置EIO, 此时字节流已经不完整, 调用方应关闭连接
+    ssize_t writeFd(int fd, int *savedErrno);
+
+    void clear();
+
+    // 0表示关闭, socket需要已经设置了SO_ZEROCOPY
+    void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+    bool zeroCopyEnabled() const { return zeroCopyThreshold_ > 0; }
+    // 内核通知[lo, hi]这些MSG_ZEROCOPY发送已经完成
+    void completeZeroCopy(uint32_t lo, uint32_t hi);
+    // 已经写出但内核还在引用的分段数
+    size_t zeroCopyInFlight() const { return sent_; }
+    // 丢掉还没发送的数据, 把内核还在引用的分段整体移到空队列dst里, 分段对象的地址不变
+    void moveInFlightTo(OutputQueue *dst);
+
+private:
+    struct Segment
+    {
+        enum Kind
+        {
+            kBytes,
+            kBlob,
+            kFile
+        };
+
+        Segment(Kind k)
+            : kind(k),
+              offset(0),
+              length(0),
+              zeroCopy(false),
+              zeroCopyId(0)
+        {
+        }
+
+        size_t remaining() const { return length - offset; }
+
+        Kind kind;
+        std::string bytes;
+        BlobPtr blob;
+        FileRegionPtr file;
+        off_t fileOffset; // kFile: 文件中的起始位置
+        size_t offset;    // 已经写出的字节数
+        size_t length;
+        bool zeroCopy;       // 有部分数据用MSG_ZEROCOPY发送过
+        uint32_t zeroCopyId; // 最后一次MSG_ZEROCOPY发送的序号
+    };
+
+    // 一次系统调用, *attempted返回本次尝试写出的字节数
+    ssize_t writeOnce(int fd, size_t *attempted);
+    ssize_t writeZeroCopy(int fd, struct iovec *iov, int iovcnt);
+    void consume(size_t n);
+    // 内核不再引用这个分段: 没有用MSG_ZEROCOPY发送过, 或者最后一次发送已经完成
+    bool zeroCopyDone(const Segment &seg) const
+    {
+        return !seg.zeroCopy || static_cast<int32_t>(seg.zeroCopyId - zeroCopyCompleted_) < 0;
+    }
+    // 释放队头已经完成的分段
+    void releaseCompleted();
+
+    Segment *firstUnsent() { return sent_ < segments_.size() ? &segments_[sent_] : nullptr; }
+
+    // [0, sent_)是已经写完但还要等zero copy完成通知的分段, 之后是待发送的分段
+    // deque只在两端插入删除, 元素的地址保持不变
+    std::deque<Segment> segments_;
+    size_t sent_;
+    size_t bytes_;
+    size_t zeroCopyThreshold_;
+    uint32_t nextZeroCopyId_; // 内核为每次成功的MSG_ZEROCOPY发送分配的序号, 从0开始
+    // 序号小于它的发送都已经完成. 部分写出的分段可能在还没发完时就收到完成通知,
+    // 靠这个水位而不是它在队列里的位置判断能不能释放
+    uint32_t zeroCopyCompleted_;
+};
@@ -9,12 +9,8 @@ Poller::Poller(EventLoop *loop)
 
 bool Poller::hasChannel(Channel *channel) const
 {
-    auto it = channels_.find(channel->fd());
-    if(it != channels_.end() && it->second == channel){
-        return true;
-    }else { 
-        return false; 
-    }
+    size_t fd = static_cast<size_t>(channel->fd());
+    return fd < channels_.size() && channels_[fd] == channel;
 }
 
 // Poller* Poller::newDefaultPoller(EventLoop *loop) 
@@ -6,7 +6,6 @@
 
 
 #include <vector>
-#include <unordered_map>
 
 class EventLoop;
 
@@ -32,8 +31,8 @@ public:
 
 protected:
 
-    // map的key: sockfd value: sockfd所属的channel通道类型
-    using ChannelMap = std::unordered_map<int, Channel*>;
+    // 下标: sockfd value: sockfd所属的channel通道类型, fd是小整数, 用数组代替哈希表, 注册新连接不用分配节点
+    using ChannelMap = std::vector<Channel*>;
     ChannelMap channels_;
 private:
 EventLoop *ownerLoop_;
@@ -0,0 +1,44 @@
+#pragma once
+
+/**
+ * 静态探针(USDT), 供perf/bpftrace在生产环境挂载, provider名为swiftnet
+ * cmake -DSWIFTNET_ENABLE_USDT=ON 且系统有<sys/sdt.h>(systemtap-sdt-dev)时生效,
+ * 此时每个探针只是一条nop指令, 没有挂载时不产生开销; 否则全部展开为空
+ *
+ * 探针列表(参数依次为arg0, arg1, ...):
+ *   conn_accept(fd)                   Acceptor接受新连接
+ *   conn_establish(conn, fd)          TcpConnection::connectEstablished
+ *   conn_destroy(conn, fd)            TcpConnection::connectDestroyed
+ *   read(conn, fd, bytes)             读socket, bytes<0表示出错
+ *   write(conn, fd, bytes)            写socket, bytes<0表示出错
+ *   poll_wakeup(loop, events)         epoll_wait返回
+ *   functors_run(loop, count)         执行一轮pending functors之前
+ *   timer_fire(timer, sequence)       执行定时器回调之前
+ *   http_request_start(conn)          开始解析一个新的http请求
+ *   http_request_end(conn, status)    响应已交给TcpConnection发送
+ */
+
+#ifdef SWIFTNET_USDT
+
+#include <sys/sdt.h>
+
+#define SWIFTNET_PROBE1(name, a1) DTRACE_PROBE1(swiftnet, name, a1)
+#define SWIFTNET_PROBE2(name, a1, a2) DTRACE_PROBE2(swiftnet, name, a1, a2)
+#define SWIFTNET_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(swiftnet, name, a1, a2, a3)
+
+#else
+
+#define SWIFTNET_PROBE1(name, a1) \
+    do                            \
+    {                             \
+    } while (0)
+#define SWIFTNET_PROBE2(name, a1, a2) \
+    do                                \
+    {                                 \
+    } while (0)
+#define SWIFTNET_PROBE3(name, a1, a2, a3) \
+    do                                    \
+    {                                     \
+    } while (0)
+
+#endif
@@ -7,15 +7,49 @@
 #include <sys/socket.h>
 #include <strings.h>
 #include <netinet/tcp.h>
+#include <stdio.h>
 
 Socket::~Socket()
 {
     close(sockfd_);
 }
 
+bool Socket::getTcpInfo(struct tcp_info *tcpi) const
+{
+    socklen_t len = sizeof(*tcpi);
+    bzero(tcpi, len);
+    return ::getsockopt(sockfd_, SOL_TCP, TCP_INFO, tcpi, &len) == 0;
+}
+
+bool Socket::getTcpInfoString(char *buf, int len) const
+{
+    struct tcp_info tcpi;
+    bool ok = getTcpInfo(&tcpi);
+    if (ok)
+    {
+        snprintf(buf, len, "unrecovered=%u "
+                           "rto=%u ato=%u snd_mss=%u rcv_mss=%u "
+                           "lost=%u retrans=%u rtt=%u rttvar=%u "
+                           "sshthresh=%u cwnd=%u total_retrans=%u",
+                 tcpi.tcpi_retransmits, // Number of unrecovered [RTO] timeouts
+                 tcpi.tcpi_rto,         // Retransmit timeout in usec
+                 tcpi.tcpi_ato,         // Predicted tick of soft clock in usec
+                 tcpi.tcpi_snd_mss,
+                 tcpi.tcpi_rcv_mss,
+                 tcpi.tcpi_lost,    // Lost packets
+                 tcpi.tcpi_retrans, // Retransmitted packets out
+                 tcpi.tcpi_rtt,     // Smoothed round trip time in usec
+                 tcpi.tcpi_rttvar,  // Medium deviation
+                 tcpi.tcpi_snd_ssthresh,
+                 tcpi.tcpi_snd_cwnd,
+                 tcpi.tcpi_total_retrans); // Total retransmits for entire connection
+    }
+    return ok;
+}
+
 void Socket::bindAddress(const InetAddress &localaddr)
 {
-    if (0 != bind(sockfd_, (sockaddr *)localaddr.getSocketAddr(), sizeof(sockaddr_in)))
+    if (0 != bind(sockfd_, localaddr.getSockAddr(), localaddr.getSockLen()))
     {
         LOG_FATAL("bind sockfd:%d fail \n", sockfd_);
     }
@@ -30,13 +64,13 @@ void Socket::listen()
 
 int Socket::accept(InetAddress *peeraddr)
 {
-    sockaddr_in addr;
+    sockaddr_storage addr;
     socklen_t len = sizeof addr;
     bzero(&addr, sizeof addr);
     int connfd = ::accept4(sockfd_, (sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd >= 0)
     {
-        peeraddr->setSockAddr(addr);
+        *peeraddr = InetAddress((sockaddr *)&addr, len);
     }
     return connfd;
 }
@@ -68,4 +102,10 @@ void Socket::setKeepAlive(bool on)
 {
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof optval);
-}
\ No newline at end of file
+}
+
+bool Socket::setZeroCopy(bool on)
+{
+    int optval = on ? 1 : 0;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof optval) == 0;
+}
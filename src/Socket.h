@@ -3,6 +3,7 @@
 #include "noncopyable.h"
 
 class InetAddress;
+struct tcp_info;
 
 class Socket : noncopyable
 {
@@ -14,6 +15,9 @@ public:
     ~Socket();
 
     int fd() const { return sockfd_; }
+    // 获取内核的TCP_INFO, 失败返回false
+    bool getTcpInfo(struct tcp_info *tcpi) const;
+    bool getTcpInfoString(char *buf, int len) const;
     void bindAddress(const InetAddress &localaddr);
     void listen();
     int accept(InetAddress *peeraddr);
@@ -24,6 +28,8 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    // SO_ZEROCOPY, 内核不支持时返回false
+    bool setZeroCopy(bool on);
 
 private:
     const int sockfd_;
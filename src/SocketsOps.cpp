@@ -12,6 +12,7 @@
 #include "Types.h"
 #include "Endian.h"
 
+#include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h> // snprintf
@@ -63,7 +64,7 @@ const struct sockaddr_in *sockets::sockaddr_in_cast(const struct sockaddr *addr)
 int sockets::createNonblockingOrDie(sa_family_t family)
 {
 #if VALGRIND
-  int sockfd = ::socket(family, SOCK_STREAM, IPPROTO_TCP);
+  int sockfd = ::socket(family, SOCK_STREAM, 0);
   if (sockfd < 0)
   {
     LOG_SYSFATAL << "sockets::createNonblockingOrDie";
@@ -71,7 +72,8 @@ int sockets::createNonblockingOrDie(sa_family_t family)
 
   setNonBlockAndCloseOnExec(sockfd);
 #else
-  int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+  // protocol传0, AF_INET得到TCP, AF_UNIX得到流式unix socket
+  int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
   if (sockfd < 0)
   {
     LOG_INFO("sockets::createNonblockingOrDie");
@@ -80,9 +82,9 @@ int sockets::createNonblockingOrDie(sa_family_t family)
   return sockfd;
 }
 
-void sockets::bindOrDie(int sockfd, const struct sockaddr *addr)
+void sockets::bindOrDie(int sockfd, const InetAddress &addr)
 {
-  int ret = ::bind(sockfd, addr, static_cast<socklen_t>(sizeof(struct sockaddr_in)));
+  int ret = ::bind(sockfd, addr.getSockAddr(), addr.getSockLen());
   if (ret < 0)
   {
     LOG_INFO("sockets::bindOrDie");
@@ -142,9 +144,9 @@ int sockets::accept(int sockfd, struct sockaddr_in *addr)
   return connfd;
 }
 
-int sockets::connect(int sockfd, const struct sockaddr *addr)
+int sockets::connect(int sockfd, const InetAddress &addr)
 {
-  return ::connect(sockfd, addr, static_cast<socklen_t>(sizeof(struct sockaddr_in)));
+  return ::connect(sockfd, addr.getSockAddr(), addr.getSockLen());
 }
 
 ssize_t sockets::read(int sockfd, void *buf, size_t count)
@@ -243,38 +245,38 @@ int sockets::getSocketError(int sockfd)
   }
 }
 
-struct sockaddr_in sockets::getLocalAddr(int sockfd)
+InetAddress sockets::getLocalAddr(int sockfd)
 {
-  struct sockaddr_in localaddr;
+  struct sockaddr_storage localaddr;
   memZero(&localaddr, sizeof localaddr);
   socklen_t addrlen = static_cast<socklen_t>(sizeof localaddr);
-  if (::getsockname(sockfd, sockaddr_cast(&localaddr), &addrlen) < 0)
+  if (::getsockname(sockfd, reinterpret_cast<struct sockaddr *>(&localaddr), &addrlen) < 0)
   {
     LOG_INFO("sockets::getLocalAddr");
   }
-  return localaddr;
+  return InetAddress(reinterpret_cast<struct sockaddr *>(&localaddr), addrlen);
 }
 
-struct sockaddr_in sockets::getPeerAddr(int sockfd)
+InetAddress sockets::getPeerAddr(int sockfd)
 {
-  struct sockaddr_in peeraddr;
+  struct sockaddr_storage peeraddr;
   memZero(&peeraddr, sizeof peeraddr);
   socklen_t addrlen = static_cast<socklen_t>(sizeof peeraddr);
-  if (::getpeername(sockfd, sockaddr_cast(&peeraddr), &addrlen) < 0)
+  if (::getpeername(sockfd, reinterpret_cast<struct sockaddr *>(&peeraddr), &addrlen) < 0)
   {
     LOG_INFO("sockets::getPeerAddr");
   }
-  return peeraddr;
+  return InetAddress(reinterpret_cast<struct sockaddr *>(&peeraddr), addrlen);
 }
 
 bool sockets::isSelfConnect(int sockfd)
 {
-  struct sockaddr_in localaddr = getLocalAddr(sockfd);
-  struct sockaddr_in peeraddr = getPeerAddr(sockfd);
-  if (localaddr.sin_family == AF_INET)
+  InetAddress localaddr = getLocalAddr(sockfd);
+  InetAddress peeraddr = getPeerAddr(sockfd);
+  if (localaddr.family() == AF_INET)
   {
-    const struct sockaddr_in *laddr4 = reinterpret_cast<struct sockaddr_in *>(&localaddr);
-    const struct sockaddr_in *raddr4 = reinterpret_cast<struct sockaddr_in *>(&peeraddr);
+    const struct sockaddr_in *laddr4 = localaddr.getSocketAddr();
+    const struct sockaddr_in *raddr4 = peeraddr.getSocketAddr();
     return laddr4->sin_port == raddr4->sin_port && laddr4->sin_addr.s_addr == raddr4->sin_addr.s_addr;
   }
 
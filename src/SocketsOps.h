@@ -1,5 +1,7 @@
 #pragma once
 
+#include "InetAddress.h"
+
 #include <arpa/inet.h>
 
 namespace sockets
@@ -10,8 +12,8 @@ namespace sockets
     /// abort if any error.
     int createNonblockingOrDie(sa_family_t family);
 
-    int connect(int sockfd, const struct sockaddr *addr);
-    void bindOrDie(int sockfd, const struct sockaddr *addr);
+    int connect(int sockfd, const InetAddress &addr);
+    void bindOrDie(int sockfd, const InetAddress &addr);
     void listenOrDie(int sockfd);
     int accept(int sockfd, struct sockaddr_in *addr);
     ssize_t read(int sockfd, void *buf, size_t count);
@@ -38,8 +40,8 @@ namespace sockets
     const struct sockaddr_in *sockaddr_in_cast(const struct sockaddr *addr);
     const struct sockaddr_in *sockaddr_in_cast(const struct sockaddr *addr);
 
-    struct sockaddr_in getLocalAddr(int sockfd);
-    struct sockaddr_in getPeerAddr(int sockfd);
+    InetAddress getLocalAddr(int sockfd);
+    InetAddress getPeerAddr(int sockfd);
     bool isSelfConnect(int sockfd);
 
 } // namespace sockets
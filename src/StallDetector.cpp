@@ -0,0 +1,176 @@
+#include "StallDetector.h"
+#include "Timestamp.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <execinfo.h>
+#include <mutex>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    __thread StackSample *t_stackSample = nullptr;
+
+    const int64_t kMinPeriodNs = 1000 * 1000;
+
+    std::once_flag g_installOnce;
+    // 安装之前的SIGURG处理方式, 不是看门狗发来的信号交给它处理(比如TCP带外数据的通知)
+    struct sigaction g_previousAction;
+
+    void chainToPrevious(int signo, siginfo_t *info, void *context)
+    {
+        if (g_previousAction.sa_flags & SA_SIGINFO)
+        {
+            if (g_previousAction.sa_sigaction != nullptr)
+            {
+                g_previousAction.sa_sigaction(signo, info, context);
+            }
+        }
+        else if (g_previousAction.sa_handler != SIG_DFL && g_previousAction.sa_handler != SIG_IGN)
+        {
+            g_previousAction.sa_handler(signo);
+        }
+    }
+
+    void stackSampleHandler(int signo, siginfo_t *info, void *context)
+    {
+        int savedErrno = errno;
+        StackSample *sample = t_stackSample;
+        // 看门狗用tgkill发信号, si_code为SI_TKILL且来自本进程; 内核发的带外数据通知是SI_KERNEL
+        bool fromWatchdog = info != nullptr && info->si_code == SI_TKILL && info->si_pid == ::getpid();
+        if (fromWatchdog && sample != nullptr &&
+            sample->depth.load(std::memory_order_relaxed) == 0 &&
+            sample->callbackStartNs.load(std::memory_order_relaxed) == sample->targetNs.load(std::memory_order_relaxed))
+        {
+            int n = ::backtrace(sample->frames, StackSample::kMaxFrames);
+            sample->depth.store(n, std::memory_order_release);
+        }
+        else if (!fromWatchdog)
+        {
+            chainToPrevious(signo, info, context);
+        }
+        errno = savedErrno;
+    }
+
+    void installSignalHandler()
+    {
+        // backtrace()第一次调用会加载libgcc, 不能发生在信号处理函数里
+        void *dummy[1];
+        ::backtrace(dummy, 1);
+
+        struct sigaction sa;
+        ::memset(&sa, 0, sizeof sa);
+        sa.sa_sigaction = stackSampleHandler;
+        sa.sa_flags = SA_RESTART | SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+        if (::sigaction(SIGURG, &sa, &g_previousAction) < 0)
+        {
+            LOG_ERROR("StallDetector sigaction error:%d \n", errno);
+        }
+    }
+}
+
+bool StackSample::take(std::vector<std::string> *stack)
+{
+    int n = depth.load(std::memory_order_acquire);
+    if (n <= 0)
+    {
+        return false;
+    }
+    char **symbols = ::backtrace_symbols(frames, n);
+    if (symbols != nullptr)
+    {
+        // 跳过信号处理函数本身和内核的信号跳板
+        for (int i = 2; i < n; ++i)
+        {
+            stack->push_back(symbols[i]);
+        }
+        ::free(symbols);
+    }
+    depth.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+StallDetector &StallDetector::instance()
+{
+    static StallDetector detector;
+    return detector;
+}
+
+StallDetector::StallDetector()
+    : periodNs_(0),
+      running_(true)
+{
+    std::call_once(g_installOnce, installSignalHandler);
+    thread_ = std::thread(&StallDetector::threadFunc, this);
+}
+
+StallDetector::~StallDetector()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void StallDetector::add(StackSample *sample)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_.push_back(sample);
+        // 采样周期取最小阈值的一半, 保证超时后最多再过半个阈值就能采到栈
+        int64_t period = std::max(sample->thresholdNs / 2, kMinPeriodNs);
+        if (periodNs_ == 0 || period < periodNs_)
+        {
+            periodNs_ = period;
+        }
+    }
+    cond_.notify_all();
+}
+
+void StallDetector::remove(StackSample *sample)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples_.erase(std::remove(samples_.begin(), samples_.end(), sample), samples_.end());
+}
+
+void StallDetector::bindCurrentThread(StackSample *sample)
+{
+    t_stackSample = sample;
+}
+
+void StallDetector::threadFunc()
+{
+    pid_t pid = ::getpid();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+        if (samples_.empty())
+        {
+            cond_.wait(lock);
+            continue;
+        }
+        cond_.wait_for(lock, std::chrono::nanoseconds(periodNs_));
+
+        int64_t now = monotonicNanos();
+        for (StackSample *sample : samples_)
+        {
+            int64_t start = sample->callbackStartNs.load(std::memory_order_acquire);
+            if (start != 0 &&
+                now - start >= sample->thresholdNs &&
+                sample->targetNs.load(std::memory_order_relaxed) != start)
+            {
+                sample->targetNs.store(start, std::memory_order_relaxed);
+                ::syscall(SYS_tgkill, pid, sample->tid, SIGURG);
+            }
+        }
+    }
+}
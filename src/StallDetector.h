@@ -0,0 +1,69 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+// 一个loop线程的栈采样槽, 由loop线程、看门狗线程和信号处理函数共同访问
+struct StackSample
+{
+    static const int kMaxFrames = 64;
+
+    StackSample(pid_t threadId, int64_t thresholdNs)
+        : tid(threadId),
+          thresholdNs(thresholdNs),
+          callbackStartNs(0),
+          targetNs(0),
+          depth(0)
+    {
+    }
+
+    // 取出已采到的栈并符号化, 只能在loop线程调用
+    bool take(std::vector<std::string> *stack);
+
+    const pid_t tid;
+    const int64_t thresholdNs;
+    std::atomic<int64_t> callbackStartNs; // 当前回调的开始时间, 0表示loop空闲
+    std::atomic<int64_t> targetNs;        // 看门狗已经发过信号的那次回调
+    std::atomic<int> depth;
+    void *frames[kMaxFrames];
+};
+
+/**
+ * 看门狗线程: 定期检查已注册loop的当前回调执行了多久, 超过阈值时向该loop线程发送SIGURG,
+ * 由信号处理函数在被阻塞的线程上调用backtrace(), 回调结束后loop线程再把栈交给慢回调钩子
+ * 注意: 信号使用SA_RESTART, 但nanosleep/epoll_wait这类调用仍会被打断提前返回EINTR
+ * SIGURG的处理函数是进程级的, 第一次创建看门狗时安装且只安装一次. 安装前已有的处理函数会被保存,
+ * 不是看门狗用tgkill发来的SIGURG(比如TCP带外数据到达时内核发的)转交给它, 所以应用自己的
+ * SIGURG处理函数应当在启用栈采样之前安装, 之后再安装会把采样的处理函数覆盖掉
+ */
+class StallDetector : noncopyable
+{
+public:
+    static StallDetector &instance();
+
+    void add(StackSample *sample);
+    void remove(StackSample *sample);
+
+    // 把采样槽绑定到当前线程, 信号处理函数通过它找到要写入的位置
+    static void bindCurrentThread(StackSample *sample);
+
+private:
+    StallDetector();
+    ~StallDetector();
+
+    void threadFunc();
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<StackSample *> samples_;
+    int64_t periodNs_;
+    bool running_;
+    std::thread thread_;
+};
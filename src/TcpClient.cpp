@@ -55,7 +55,6 @@ TcpClient::TcpClient(EventLoop *loop,
 {
   connector_->setNewConnectionCallback(
       std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
-  // FIXME setConnectFailedCallback
   LOG_INFO("TcpClient::TcpClient[%s] - connector %p", name_.c_str(), get_pointer(connector_));
 }
 
@@ -87,6 +86,26 @@ TcpClient::~TcpClient()
   }
 }
 
+void TcpClient::setConnectFailedCallback(const std::function<void()> &cb)
+{
+  connector_->setConnectFailedCallback(cb);
+}
+
+void TcpClient::setConnectTimeout(double seconds)
+{
+  connector_->setConnectTimeout(seconds);
+}
+
+void TcpClient::setMaxConnectRetries(int retries)
+{
+  connector_->setMaxRetries(retries);
+}
+
+void TcpClient::setRetryBudget(const RetryBudgetPtr &budget)
+{
+  connector_->setRetryBudget(budget);
+}
+
 void TcpClient::connect()
 {
   // FIXME: check state
@@ -117,7 +136,7 @@ void TcpClient::stop()
 void TcpClient::newConnection(int sockfd)
 {
   InetAddress peerAddr(sockets::getPeerAddr(sockfd));
-  char buf[32];
+  char buf[128]; // AF_UNIX的路径比ip:port长
   snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
   ++nextConnId_;
   std::string connName = name_ + buf;
@@ -135,7 +154,7 @@ void TcpClient::newConnection(int sockfd)
   conn->setMessageCallback(messageCallback_);
   conn->setWriteCompleteCallback(writeCompleteCallback_);
   conn->setCloseCallback(
-      std::bind(&TcpClient::removeConnection, this, conn)); // FIXME: unsafe
+      std::bind(&TcpClient::removeConnection, this, std::placeholders::_1)); // FIXME: unsafe
   {
     std::lock_guard<std::mutex> lock(mutex_);
     connection_ = conn;
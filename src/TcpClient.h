@@ -7,6 +7,8 @@
 
 class Connector;
 typedef std::shared_ptr<Connector> ConnectorPtr;
+class RetryBudget;
+typedef std::shared_ptr<RetryBudget> RetryBudgetPtr;
 
 class TcpClient : noncopyable
 {
@@ -58,6 +60,18 @@ public:
     writeCompleteCallback_ = std::move(cb);
   }
 
+  /// Called in loop thread when connecting gives up, see Connector.
+  /// Not thread safe.
+  void setConnectFailedCallback(const std::function<void()> &cb);
+
+  /// See Connector::setConnectTimeout() and Connector::setMaxRetries().
+  /// Not thread safe, call before connect().
+  void setConnectTimeout(double seconds);
+  void setMaxConnectRetries(int retries);
+  /// See Connector::setRetryBudget(). Pass the same budget to several clients
+  /// to limit their retries together. Not thread safe, call before connect().
+  void setRetryBudget(const RetryBudgetPtr &budget);
+
 private:
   /// Not thread safe, but in loop
   void newConnection(int sockfd);
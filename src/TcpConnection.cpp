@@ -3,15 +3,148 @@
 #include "Channel.h"
 #include "Socket.h"
 #include "EventLoop.h"
+#include "Metrics.h"
+#include "Probes.h"
 
 #include <functional>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <strings.h>
+#include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <linux/errqueue.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <limits.h>
 #include <string>
+#include <algorithm>
+
+namespace
+{
+    Counter &g_bytesRead = MetricsRegistry::instance().counter(
+        "swiftnet_tcp_bytes_read_total", "Bytes read from all tcp connections");
+    Counter &g_bytesWritten = MetricsRegistry::instance().counter(
+        "swiftnet_tcp_bytes_written_total", "Bytes written to all tcp connections");
+    Gauge &g_connections = MetricsRegistry::instance().gauge(
+        "swiftnet_tcp_connections", "Number of established tcp connections");
+    Gauge &g_outputBufferBytes = MetricsRegistry::instance().gauge(
+        "swiftnet_tcp_output_buffer_bytes", "Bytes waiting in tcp connection output buffers");
+    Counter &g_zeroCopyCompletions = MetricsRegistry::instance().counter(
+        "swiftnet_tcp_zerocopy_completions_total", "MSG_ZEROCOPY sends completed by the kernel");
+    Counter &g_zeroCopyCopied = MetricsRegistry::instance().counter(
+        "swiftnet_tcp_zerocopy_copied_total", "MSG_ZEROCOPY sends the kernel completed by copying");
+    Counter &g_inputPauses = MetricsRegistry::instance().counter(
+        "swiftnet_tcp_input_pauses_total", "Times reading was paused by the input high water mark");
+    Gauge &g_zeroCopyLingering = MetricsRegistry::instance().gauge(
+        "swiftnet_tcp_zerocopy_lingering", "Closed connections still waiting for MSG_ZEROCOPY completions");
+
+    // 读空socket的错误队列, 把MSG_ZEROCOPY完成通知交给发送队列, 读到过完成通知时返回true
+    bool drainZeroCopyCompletions(int fd, OutputQueue *queue)
+    {
+        bool got = false;
+        while (true)
+        {
+            char control[128];
+            struct msghdr msg;
+            ::memset(&msg, 0, sizeof msg);
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof control;
+            if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
+            {
+                break; // EAGAIN, 错误队列已经读空
+            }
+            for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+            {
+                if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                      (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+                {
+                    continue;
+                }
+                const struct sock_extended_err *serr =
+                    reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+                if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                {
+                    continue;
+                }
+                got = true;
+                uint32_t lo = serr->ee_info;
+                uint32_t hi = serr->ee_data;
+                g_zeroCopyCompletions.add(hi - lo + 1);
+                if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                {
+                    g_zeroCopyCopied.add(hi - lo + 1);
+                }
+                queue->completeZeroCopy(lo, hi);
+            }
+        }
+        return got;
+    }
+
+    /**
+     * 连接销毁时内核还在引用的MSG_ZEROCOPY分段由它接管: 持有dup出来的socket(连接关闭fd之后
+     * 错误队列仍然可读), 在loop里定时读完成通知, 全部完成后才释放分段并关闭socket.
+     * 连接被重置时内核释放skb也会发完成通知, 所以一般总能等到. 超过kDeadline还没等到
+     * (例如对端一直不读也不断开), 用SO_LINGER为0的close重置连接, 内核立即丢掉发送队列, 再释放分段
+     */
+    class ZeroCopyLinger : public std::enable_shared_from_this<ZeroCopyLinger>
+    {
+    public:
+        ZeroCopyLinger(EventLoop *loop, int fd)
+            : loop_(loop), fd_(fd), delay_(kMinDelay), waited_(0)
+        {
+            g_zeroCopyLingering.inc();
+        }
+
+        ~ZeroCopyLinger()
+        {
+            ::close(fd_);
+            g_zeroCopyLingering.dec();
+        }
+
+        OutputQueue *queue() { return &queue_; }
+
+        // 只在loop线程调用, 还有未完成的发送时自己排下一次检查, 定时器持有shared_ptr
+        void poll()
+        {
+            drainZeroCopyCompletions(fd_, &queue_);
+            if (queue_.zeroCopyInFlight() == 0)
+            {
+                return;
+            }
+            if (waited_ >= kDeadline)
+            {
+                LOG_WARN("ZeroCopyLinger fd=%d %zu segments still in flight after %.0fs, resetting \n",
+                         fd_, queue_.zeroCopyInFlight(), waited_);
+                // 析构时先close再释放queue_
+                struct linger abortive = {1, 0};
+                ::setsockopt(fd_, SOL_SOCKET, SO_LINGER, &abortive, sizeof abortive);
+                return;
+            }
+            std::shared_ptr<ZeroCopyLinger> self(shared_from_this());
+            loop_->runAfter(delay_, [self]()
+                            { self->poll(); });
+            waited_ += delay_;
+            delay_ = std::min(delay_ * 2, kMaxDelay);
+        }
+
+    private:
+        static constexpr double kMinDelay = 0.001;
+        static constexpr double kMaxDelay = 0.1;
+        static constexpr double kDeadline = 30.0;
+
+        EventLoop *loop_;
+        const int fd_;
+        double delay_;
+        double waited_;
+        OutputQueue queue_;
+    };
+
+    constexpr double ZeroCopyLinger::kMinDelay;
+    constexpr double ZeroCopyLinger::kMaxDelay;
+    constexpr double ZeroCopyLinger::kDeadline;
+}
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -27,41 +160,100 @@ TcpConnection::TcpConnection(EventLoop *loop,
                              int sockfd,
                              const InetAddress &localAddr,
                              const InetAddress &peerAddr)
+    : TcpConnection(loop, std::make_shared<const std::string>(nameArg), 0, sockfd, localAddr, peerAddr)
+{
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                             const std::shared_ptr<const std::string> &namePrefix,
+                             uint64_t id,
+                             int sockfd,
+                             const InetAddress &localAddr,
+                             const InetAddress &peerAddr,
+                             const std::shared_ptr<ConnectionPool> &pool)
     : loop_(CheckLoopNotNull(loop)),
-      name_(nameArg),
+      id_(id),
+      slot_(0),
+      namePrefix_(namePrefix),
       state_(kConnecting),
       reading_(true),
-      socket_(new Socket(sockfd)),
-      channel_(new Channel(loop, sockfd)),
+      socket_(sockfd),
+      channel_(loop, sockfd),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 * 1024)
+      pool_(pool),
+      highWaterMark_(64 * 1024 * 1024),
+      inputHighWaterMark_(0),
+      inputLowWaterMark_(0),
+      pendingWork_(0),
+      inputPaused_(false),
+      coalesceWrites_(false),
+      flushScheduled_(false),
+      inputBuffer_(pool ? pool->takeBuffer() : std::vector<char>()),
+      createdNs_(monotonicNanos()),
+      statsEnabled_(false)
 {
-    channel_->setReadCallback(
-        std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(
-        std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(
-        std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(
-        std::bind(&TcpConnection::handleError, this));
+    // 只捕获this的lambda可以放进std::function的内部存储, 而std::bind(&成员函数, this)要在堆上分配
+    channel_.setReadCallback([this](Timestamp receiveTime)
+                             { handleRead(receiveTime); });
+    channel_.setWriteCallback([this]()
+                              { handleWrite(); });
+    channel_.setCloseCallback([this]()
+                              { handleClose(); });
+    channel_.setErrorCallback([this]()
+                              { handleError(); });
+    channel_.setNameCallback([this]()
+                             { return name(); });
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name().c_str(), sockfd);
+    socket_.setKeepAlive(true);
 }
 
 TcpConnection::~TcpConnection()
 {
+    g_outputBufferBytes.sub(outputQueue_.readableBytes());
+    // clear()把被内核引用的、只写出一部分的分段也归到在途分段里
+    outputQueue_.clear();
+    if (outputQueue_.zeroCopyInFlight() > 0)
+    {
+        lingerZeroCopy();
+    }
     LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n",
-             name_.c_str(), channel_->fd(), static_cast<int>(state_));
+             name().c_str(), channel_.fd(), static_cast<int>(state_));
+    if (pool_)
+    {
+        pool_->recycleBuffer(inputBuffer_.releaseStorage());
+    }
+}
+
+const std::string &TcpConnection::name() const
+{
+    std::call_once(nameOnce_, [this]()
+                   {
+                       name_ = id_ == 0 ? *namePrefix_ : *namePrefix_ + '#' + std::to_string(id_); });
+    return name_;
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno);
+    SWIFTNET_PROBE3(read, this, channel_.fd(), n);
+    if (statsEnabled_)
+    {
+        bump(stats_.readCalls, 1);
+        if (n > 0)
+        {
+            bump(stats_.bytesRead, n);
+        }
+        else if (n < 0 && savedErrno == EAGAIN)
+        {
+            bump(stats_.eagainCount, 1);
+        }
+    }
     if (n > 0)
     {
+        g_bytesRead.add(n);
         messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
     }
     else if (n == 0)
@@ -78,16 +270,15 @@ void TcpConnection::handleRead(Timestamp receiveTime)
 
 void TcpConnection::handleWrite()
 {
-    if (channel_->isWriting())
+    if (channel_.isWriting())
     {
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+        ssize_t n = writeOutput(&savedErrno);
         if (n > 0)
         {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+            if (outputQueue_.empty())
             {
-                channel_->disableWriting();
+                channel_.disableWriting();
                 if (writeCompleteCallback_)
                 {
                     // 唤醒loop_对应的thread线程，执行回调
@@ -103,19 +294,151 @@ void TcpConnection::handleWrite()
         else
         {
             LOG_ERROR("TcpConnection::handleWrite");
+            if (n < 0 && savedErrno == EIO)
+            {
+                abortOutput();
+            }
         }
     }
     else
     {
-        LOG_ERROR("TcpConnection::handleWrite fd=%d is down, no more writing \n", channel_->fd());
+        LOG_ERROR("TcpConnection::handleWrite fd=%d is down, no more writing \n", channel_.fd());
+    }
+}
+
+// 把发送队列写到socket, 更新统计
+ssize_t TcpConnection::writeOutput(int *savedErrno)
+{
+    size_t queued = outputQueue_.readableBytes();
+    ssize_t n = outputQueue_.writeFd(channel_.fd(), savedErrno);
+    if (n < 0 && *savedErrno == EIO)
+    {
+        // 被截断的文件分段已经从队列里丢掉了
+        g_outputBufferBytes.sub(queued - outputQueue_.readableBytes());
+    }
+    SWIFTNET_PROBE3(write, this, channel_.fd(), n);
+    if (statsEnabled_)
+    {
+        bump(stats_.writeCalls, 1);
+        if (n > 0)
+        {
+            bump(stats_.bytesWritten, n);
+        }
+        else if (n < 0 && *savedErrno == EAGAIN)
+        {
+            bump(stats_.eagainCount, 1);
+        }
+    }
+    if (n > 0)
+    {
+        g_bytesWritten.add(n);
+        g_outputBufferBytes.sub(n);
+        updateOutputStats();
+    }
+    return n;
+}
+
+// 已经把有所有权的数据放进了发送队列, oldLen是放入之前队列的长度
+void TcpConnection::outputQueued(size_t oldLen)
+{
+    g_outputBufferBytes.add(outputQueue_.readableBytes() - oldLen);
+    if (!channel_.isWriting() && !deferWrite() && !flushOutput())
+    {
+        return;
+    }
+
+    size_t newLen = outputQueue_.readableBytes();
+    if (newLen > highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
+    {
+        loop_->queueInLoop(
+            std::bind(highWaterMarkCallback_, shared_from_this(), newLen));
+    }
+    updateOutputStats();
+}
+
+// 没有在等EPOLLOUT时直接发送队列里的数据, 写不完再注册EPOLLOUT事件
+// 返回false表示已经写完或者连接出错, 队列里没有剩余数据
+bool TcpConnection::flushOutput()
+{
+    int savedErrno = 0;
+    ssize_t n = writeOutput(&savedErrno);
+    if (n < 0 && savedErrno != EWOULDBLOCK)
+    {
+        LOG_ERROR("TcpConnecton::flushOutput");
+        if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+        {
+            g_outputBufferBytes.sub(outputQueue_.readableBytes());
+            outputQueue_.clear();
+            updateOutputStats();
+            return false;
+        }
+        if (savedErrno == EIO)
+        {
+            abortOutput();
+            return false;
+        }
+    }
+    if (outputQueue_.empty())
+    {
+        if (writeCompleteCallback_)
+        {
+            loop_->queueInLoop(
+                std::bind(writeCompleteCallback_, shared_from_this()));
+        }
+        return false;
+    }
+    channel_.enableWriting();
+    return true;
+}
+
+// 发送队列里的文件被截断, 对端收到的字节流已经缺了一段, 丢掉剩下的数据并关闭连接
+// 可能在用户的send()里调用, 关闭放到之后执行, 避免在send()内部触发连接回调
+void TcpConnection::abortOutput()
+{
+    LOG_ERROR("TcpConnection::abortOutput [%s] file truncated while sending, closing \n", name().c_str());
+    g_outputBufferBytes.sub(outputQueue_.readableBytes());
+    outputQueue_.clear();
+    updateOutputStats();
+    if (channel_.isWriting())
+    {
+        channel_.disableWriting();
+    }
+    loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+}
+
+// 开启写合并且loop正在分发事件时, 不立即写, 而是在本轮循环结束时合并成一次发送
+bool TcpConnection::deferWrite()
+{
+    if (!coalesceWrites_ || !loop_->eventHandling())
+    {
+        return false;
+    }
+    if (!flushScheduled_)
+    {
+        flushScheduled_ = true;
+        loop_->runAfterIteration(std::bind(&TcpConnection::flushDeferred, shared_from_this()));
+    }
+    return true;
+}
+
+void TcpConnection::flushDeferred()
+{
+    flushScheduled_ = false;
+    if (state_ == kDisconnected || channel_.isWriting() || outputQueue_.empty())
+    {
+        return;
+    }
+    if (!flushOutput() && state_ == kDisconnecting)
+    {
+        shutdownInLoop(); // 推迟期间调用过shutdown
     }
 }
 
 void TcpConnection::handleClose()
 {
-    LOG_INFO("fd=%d state=%d \n", channel_->fd(), static_cast<int>(state_));
+    LOG_INFO("fd=%d state=%d \n", channel_.fd(), static_cast<int>(state_));
     setState(kDisconnected);
-    channel_->disableAll();
+    channel_.disableAll();
 
     TcpConnectionPtr connPtr(shared_from_this());
     connectionCallback_(connPtr); // 执行连接关闭的回调
@@ -124,10 +447,16 @@ void TcpConnection::handleClose()
 
 void TcpConnection::handleError()
 {
+    // 开启zero copy后, 完成通知也通过EPOLLERR报告, 不是真正的错误
+    if (outputQueue_.zeroCopyEnabled() && readZeroCopyCompletions())
+    {
+        return;
+    }
+
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
     {
         err = errno;
     }
@@ -135,24 +464,41 @@ void TcpConnection::handleError()
     {
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:5=%d \n", name_.c_str(), errno);
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:5=%d \n", name().c_str(), errno);
 }
 
-void TcpConnection::send(std::string &buf)
+void TcpConnection::send(const std::string &message)
 {
     if (state_ == kConnected)
     {
         if (loop_->isInLoopThread())
         {
-            sendInLoop(buf.c_str(), buf.size());
+            sendInLoop(message.data(), message.size());
         }
         else
         {
             loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop,
-                this,
-                buf.c_str(),
-                buf.size()));
+                &TcpConnection::sendStringInLoop,
+                shared_from_this(),
+                message));
+        }
+    }
+}
+
+void TcpConnection::send(std::string &&message)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendStringInLoop(message);
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendStringInLoop,
+                shared_from_this(),
+                std::move(message)));
         }
     }
 }
@@ -168,20 +514,169 @@ void TcpConnection::send(Buffer *buf)
         }
         else
         {
-            void (TcpConnection::*fp)(const void *message, size_t len) = &TcpConnection::sendInLoop;
-            loop_->runInLoop(
-                std::bind(fp,
-                          this, // FIXME
-                          buf->peek(),
-                          buf->readableBytes()));
-            // std::forward<string>(message)));
+            // 把数据整个换出来交给loop线程, 调用者的buf不必再保持有效
+            Buffer data(0);
+            data.swap(*buf);
+            send(std::move(data));
         }
     }
 }
 
-// 发送数据, 应用写的快而内核发送慢，需要把发送数据写入缓冲区，且需要设置水位
+void TcpConnection::send(Buffer &&buf)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf.peek(), buf.readableBytes());
+            buf.retrieveAll();
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendBufferInLoop,
+                shared_from_this(),
+                std::move(buf)));
+        }
+    }
+}
+
+void TcpConnection::send(const BlobPtr &blob)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendBlobInLoop(blob);
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendBlobInLoop,
+                shared_from_this(),
+                blob));
+        }
+    }
+}
+
+void TcpConnection::send(BlobList slices)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendSlicesInLoop(slices);
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendSlicesInLoop,
+                shared_from_this(),
+                std::move(slices)));
+        }
+    }
+}
+
+void TcpConnection::sendStringInLoop(std::string &message)
+{
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+    size_t oldLen = outputQueue_.readableBytes();
+    outputQueue_.append(std::move(message));
+    outputQueued(oldLen);
+}
+
+void TcpConnection::sendBufferInLoop(const Buffer &buf)
+{
+    sendInLoop(buf.peek(), buf.readableBytes());
+}
+
+void TcpConnection::sendBlobInLoop(const BlobPtr &blob)
+{
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+    size_t oldLen = outputQueue_.readableBytes();
+    outputQueue_.append(blob);
+    outputQueued(oldLen);
+}
+
+void TcpConnection::sendSlicesInLoop(const BlobList &slices)
+{
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+    size_t oldLen = outputQueue_.readableBytes();
+    for (const BlobPtr &blob : slices)
+    {
+        outputQueue_.append(blob);
+    }
+    outputQueued(oldLen);
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t len)
+{
+    if (state_ == kConnected)
+    {
+        // dup一份, 调用者返回后可以立即关闭自己的fd
+        int fileFd = ::dup(fd);
+        if (fileFd < 0)
+        {
+            LOG_ERROR("TcpConnection::sendFile dup fd=%d errno=%d", fd, errno);
+            return;
+        }
+        FileRegionPtr file = std::make_shared<FileRegion>(fileFd);
+        if (loop_->isInLoopThread())
+        {
+            sendFileInLoop(file, offset, len);
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendFileInLoop,
+                shared_from_this(),
+                file,
+                offset,
+                len));
+        }
+    }
+}
+
+void TcpConnection::sendFileInLoop(const FileRegionPtr &file, off_t offset, size_t len)
+{
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+    size_t oldLen = outputQueue_.readableBytes();
+    outputQueue_.append(file, offset, len);
+    outputQueued(oldLen);
+}
+
 void TcpConnection::sendInLoop(const void *data, size_t len)
 {
+    struct iovec vec;
+    vec.iov_base = const_cast<void *>(data);
+    vec.iov_len = len;
+    sendvInLoop(&vec, 1);
+}
+
+// 发送数据, 应用写的快而内核发送慢，需要把发送数据写入缓冲区，且需要设置水位
+void TcpConnection::sendvInLoop(const struct iovec *iov, int iovcnt)
+{
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        len += iov[i].iov_len;
+    }
     ssize_t nwrote = 0;
     size_t remaining = len;
     bool faultError = false;
@@ -193,11 +688,32 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     }
 
     // channel第一次写数据，且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    if (!channel_.isWriting() && outputQueue_.readableBytes() == 0 && !deferWrite())
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        if (iovcnt == 1)
+        {
+            nwrote = ::write(channel_.fd(), iov[0].iov_base, iov[0].iov_len);
+        }
+        else
+        {
+            nwrote = ::writev(channel_.fd(), iov, std::min(iovcnt, IOV_MAX));
+        }
+        SWIFTNET_PROBE3(write, this, channel_.fd(), nwrote);
+        if (statsEnabled_)
+        {
+            bump(stats_.writeCalls, 1);
+            if (nwrote > 0)
+            {
+                bump(stats_.bytesWritten, nwrote);
+            }
+            else if (nwrote < 0 && errno == EAGAIN)
+            {
+                bump(stats_.eagainCount, 1);
+            }
+        }
         if (nwrote >= 0)
         {
+            g_bytesWritten.add(nwrote);
             remaining = len - nwrote;
             if (remaining == 0 && writeCompleteCallback_)
             {
@@ -228,17 +744,32 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     if (!faultError && remaining > 0)
     {
         // 目前发送缓冲区剩余的待发送数据长度
-        size_t oldLen = outputBuffer_.readableBytes();
+        size_t oldLen = outputQueue_.readableBytes();
         if (oldLen + remaining > highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
         {
             loop_->queueInLoop(
                 std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
         }
 
-        outputBuffer_.append((char *)data + nwrote, remaining);
-        if (!channel_->isWriting())
+        // 跳过已经写出的部分, 剩下的分片依次追加到输出缓冲区
+        size_t skip = nwrote;
+        for (int i = 0; i < iovcnt; ++i)
         {
-            channel_->enableWriting(); // 一定要注册channel写事件，否则poller无法通知
+            size_t n = iov[i].iov_len;
+            if (skip >= n)
+            {
+                skip -= n;
+                continue;
+            }
+            outputQueue_.append(static_cast<const char *>(iov[i].iov_base) + skip, n - skip);
+            skip = 0;
+        }
+        g_outputBufferBytes.add(remaining);
+        updateOutputStats();
+        // 写合并时由本轮结束的flushDeferred发送, 不需要EPOLLOUT
+        if (!channel_.isWriting() && !flushScheduled_)
+        {
+            channel_.enableWriting(); // 一定要注册channel写事件，否则poller无法通知
         }
     }
 }
@@ -246,8 +777,10 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
 void TcpConnection::connectEstablished()
 {
     setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading(); // 向poller注册channel的EPOLLIN事件
+    g_connections.inc();
+    SWIFTNET_PROBE2(conn_establish, this, channel_.fd());
+    channel_.tie(shared_from_this());
+    channel_.enableReading(); // 向poller注册channel的EPOLLIN事件
 
     // 新连接建立, 执行回调
     connectionCallback_(shared_from_this());
@@ -257,10 +790,12 @@ void TcpConnection::connectDestroyed()
     if (state_ == kConnected)
     {
         setState(kDisconnected);
-        channel_->disableAll();
+        channel_.disableAll();
         connectionCallback_(shared_from_this());
     }
-    channel_->remove();
+    channel_.remove();
+    g_connections.dec();
+    SWIFTNET_PROBE2(conn_destroy, this, channel_.fd());
 }
 
 void TcpConnection::shutdown()
@@ -274,8 +809,205 @@ void TcpConnection::shutdown()
 }
 void TcpConnection::shutdownInLoop()
 {
-    if (!channel_->isWriting()) // 说明发送缓冲区的数据都发送完了
+    if (!channel_.isWriting() && outputQueue_.empty()) // 说明发送缓冲区的数据都发送完了
+    {
+        socket_.shutdownWrite();
+    }
+}
+
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();
+    }
+}
+
+bool TcpConnection::setZeroCopyThreshold(size_t threshold)
+{
+    if (threshold > 0 && !socket_.setZeroCopy(true))
+    {
+        LOG_ERROR("TcpConnection::setZeroCopyThreshold SO_ZEROCOPY errno=%d", errno);
+        return false;
+    }
+    outputQueue_.setZeroCopyThreshold(threshold);
+    return true;
+}
+
+// 内核还可能在读这些分段的内存, 不能随连接一起释放. 析构不一定发生在loop线程,
+// 交接本身只碰自己的成员, 之后的检查都放到loop线程里做
+void TcpConnection::lingerZeroCopy()
+{
+    int fd = ::dup(channel_.fd());
+    if (fd < 0)
     {
-        socket_->shutdownWrite();
+        LOG_ERROR("TcpConnection::lingerZeroCopy [%s] dup errno=%d, leaking %zu in-flight segments \n",
+                  name().c_str(), errno, outputQueue_.zeroCopyInFlight());
+        // 宁可泄漏也不能让内核读到已经释放的内存
+        outputQueue_.moveInFlightTo(new OutputQueue);
+        return;
     }
+    // 对端看到的效果和关闭fd一样, 已经写出的数据之后跟着FIN
+    ::shutdown(fd, SHUT_RDWR);
+    std::shared_ptr<ZeroCopyLinger> linger(std::make_shared<ZeroCopyLinger>(loop_, fd));
+    outputQueue_.moveInFlightTo(linger->queue());
+    loop_->runInLoop([linger]()
+                     { linger->poll(); });
+}
+
+bool TcpConnection::readZeroCopyCompletions()
+{
+    return drainZeroCopyCompletions(channel_.fd(), &outputQueue_);
+}
+
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    reading_ = true;
+    updateReadingInLoop();
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    reading_ = false;
+    updateReadingInLoop();
+}
+
+void TcpConnection::addPendingWork(int64_t delta)
+{
+    int64_t old = pendingWork_.fetch_add(delta, std::memory_order_relaxed);
+    int64_t pending = old + delta;
+    if (inputHighWaterMark_ == 0)
+    {
+        return;
+    }
+    // 只有跨过水位时才需要让loop线程重新判断. 用这次加减前后的值判断, 不看inputPaused_:
+    // loop线程可能已经读了pendingWork_但还没写inputPaused_, 这时看到的paused是旧的,
+    // 按它判断会漏掉降到低水位以下的那一次, 连接就一直停在暂停状态
+    int64_t high = static_cast<int64_t>(inputHighWaterMark_);
+    int64_t low = static_cast<int64_t>(inputLowWaterMark_);
+    if ((old <= high && pending > high) || (old > low && pending <= low))
+    {
+        loop_->runInLoop(std::bind(&TcpConnection::updateReadingInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::updateReadingInLoop()
+{
+    if (state_ != kConnected && state_ != kDisconnecting)
+    {
+        return;
+    }
+
+    bool paused = false;
+    if (inputHighWaterMark_ > 0)
+    {
+        // 输入缓冲区里剩下的是应用还拼不成完整消息的数据, 只能靠继续读来消化, 不能算进水位,
+        // 否则一个比high还大的消息会让连接停止读之后再也恢复不了
+        int64_t pending = pendingWork_.load(std::memory_order_relaxed);
+        size_t load = static_cast<size_t>(pending > 0 ? pending : 0);
+        paused = inputPaused_.load(std::memory_order_relaxed);
+        if (!paused && load > inputHighWaterMark_)
+        {
+            paused = true;
+            g_inputPauses.inc();
+        }
+        else if (paused && load <= inputLowWaterMark_)
+        {
+            paused = false;
+        }
+    }
+    inputPaused_.store(paused, std::memory_order_relaxed);
+
+    bool wantRead = reading_ && !paused;
+    if (wantRead && !channel_.isReading())
+    {
+        channel_.enableReading();
+    }
+    else if (!wantRead && channel_.isReading())
+    {
+        channel_.disableReading();
+    }
+}
+
+void TcpConnection::updateOutputStats()
+{
+    if (!statsEnabled_)
+    {
+        return;
+    }
+    int64_t pending = static_cast<int64_t>(outputQueue_.readableBytes());
+    if (pending > stats_.maxOutputBufferBytes.load(std::memory_order_relaxed))
+    {
+        stats_.maxOutputBufferBytes.store(pending, std::memory_order_relaxed);
+    }
+
+    int64_t since = stats_.aboveHighWaterSinceNs.load(std::memory_order_relaxed);
+    if (pending > static_cast<int64_t>(highWaterMark_) && since == 0)
+    {
+        stats_.aboveHighWaterSinceNs.store(monotonicNanos(), std::memory_order_relaxed);
+    }
+    else if (pending <= static_cast<int64_t>(highWaterMark_) && since != 0)
+    {
+        bump(stats_.highWaterMarkNanos, monotonicNanos() - since);
+        stats_.aboveHighWaterSinceNs.store(0, std::memory_order_relaxed);
+    }
+}
+
+TcpConnection::Stats TcpConnection::stats() const
+{
+    int64_t now = monotonicNanos();
+    Stats result;
+    result.bytesRead = stats_.bytesRead.load(std::memory_order_relaxed);
+    result.bytesWritten = stats_.bytesWritten.load(std::memory_order_relaxed);
+    result.readCalls = stats_.readCalls.load(std::memory_order_relaxed);
+    result.writeCalls = stats_.writeCalls.load(std::memory_order_relaxed);
+    result.eagainCount = stats_.eagainCount.load(std::memory_order_relaxed);
+    result.maxOutputBufferBytes = stats_.maxOutputBufferBytes.load(std::memory_order_relaxed);
+
+    int64_t highWaterNanos = stats_.highWaterMarkNanos.load(std::memory_order_relaxed);
+    int64_t since = stats_.aboveHighWaterSinceNs.load(std::memory_order_relaxed);
+    if (since != 0)
+    {
+        highWaterNanos += now - since; // 还处在高水位之上, 把正在进行的这一段也算上
+    }
+    result.highWaterMarkMicros = highWaterNanos / 1000;
+    result.ageMicros = (now - createdNs_) / 1000;
+    return result;
+}
+
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    socket_.setTcpNoDelay(on);
+}
+
+bool TcpConnection::getTcpInfo(struct tcp_info *tcpi) const
+{
+    return socket_.getTcpInfo(tcpi);
+}
+
+std::string TcpConnection::getTcpInfoString() const
+{
+    char buf[1024] = {0};
+    socket_.getTcpInfoString(buf, sizeof buf);
+    return buf;
 }
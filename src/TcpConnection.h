@@ -4,17 +4,22 @@
 #include "InetAddress.h"
 #include "Callback.h"
 #include "Buffer.h"
+#include "Blob.h"
+#include "OutputQueue.h"
 #include "Timestamp.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "ConnectionPool.h"
+#include "ConnectionContext.h"
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <mutex>
 
-#include <boost/any.hpp>
-
-class Channel;
 class EventLoop;
-class Socket;
+struct tcp_info;
+struct iovec;
 
 class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
@@ -25,15 +30,65 @@ public:
                   int sockfd,
                   const InetAddress &localAddr,
                   const InetAddress &peerAddr);
+    // 只记下序号, 名字(namePrefix#id, id为0时就是namePrefix)在第一次调用name()时才生成, 不打日志的连接不用分配字符串
+    // pool不为空时输入缓冲区从池里取, 析构时还回去
+    TcpConnection(EventLoop *loop,
+                  const std::shared_ptr<const std::string> &namePrefix,
+                  uint64_t id,
+                  int sockfd,
+                  const InetAddress &localAddr,
+                  const InetAddress &peerAddr,
+                  const std::shared_ptr<ConnectionPool> &pool = nullptr);
     ~TcpConnection();
 
     EventLoop *getLoop() const { return loop_; }
-    const std::string &name() const { return name_; }
+    // 任意线程可调用
+    const std::string &name() const;
+    uint64_t id() const { return id_; }
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
 
+    // 连接的流量统计快照
+    struct Stats
+    {
+        int64_t bytesRead;
+        int64_t bytesWritten;
+        int64_t readCalls;
+        int64_t writeCalls;
+        int64_t eagainCount;
+        int64_t highWaterMarkMicros;  // 输出缓冲区处于高水位之上的累计时长
+        int64_t maxOutputBufferBytes; // 输出缓冲区的峰值
+        int64_t ageMicros;            // 连接创建至今的时长
+    };
+
+    // 默认关闭, 开启后由loop线程更新计数, 任意线程都可以无锁读取
+    void setStatsEnabled(bool on) { statsEnabled_ = on; }
+    bool statsEnabled() const { return statsEnabled_; }
+    Stats stats() const;
+
+    // 关掉Nagle, 适合自己控制批量发送的请求/响应协议
+    void setTcpNoDelay(bool on);
+
+    // 内核TCP_INFO快照(rtt, cwnd, 重传等), 任意线程可调用
+    bool getTcpInfo(struct tcp_info *tcpi) const;
+    std::string getTcpInfoString() const;
+
+    /**
+     * 写合并, 默认关闭. 开启后在loop分发事件期间(事件回调, pending functors, 定时器)的send
+     * 先放进发送队列, 本轮循环结束时用一次writev发出; 其他时候的send仍然立即写
+     */
+    void setWriteCoalescing(bool on) { coalesceWrites_ = on; }
+    bool writeCoalescing() const { return coalesceWrites_; }
+
+    /**
+     * 不小于threshold字节的发送分段改用MSG_ZEROCOPY, 0表示关闭(默认)
+     * 数据在内核通知完成之前一直由连接持有; 内核不支持SO_ZEROCOPY时返回false
+     * 只有几百KB以上的数据才划算, 回环地址上内核仍然会拷贝. 在loop线程调用
+     */
+    bool setZeroCopyThreshold(size_t threshold);
+
     void setConnectionCallback(const ConnectionCallback &cb)
     {
         connectionCallback_ = cb;
@@ -55,44 +110,74 @@ public:
         highWaterMark_ = highWaterMark;
     }
 
+    /**
+     * 读端流控: 应用用addPendingWork登记的待处理量(字节)超过high时自动暂停EPOLLIN,
+     * 降到low以下再恢复; high为0表示关闭(默认). 在连接回调里设置, 不是线程安全的
+     * 消息回调之后输入缓冲区里剩下的数据不计入, 它们是还不完整的消息, 暂停读只会让它永远凑不齐
+     */
+    void setInputHighWaterMark(size_t high, size_t low)
+    {
+        inputHighWaterMark_ = high;
+        inputLowWaterMark_ = low < high ? low : high;
+    }
+
+    // 应用还没处理完的工作量, 比如代理转发到下游但还没写出去的字节数, 任意线程可调用
+    void addPendingWork(int64_t delta);
+    int64_t pendingWork() const { return pendingWork_.load(std::memory_order_relaxed); }
+
+    // 手动暂停/恢复读, 任意线程可调用, 与水位的自动暂停相互独立
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+    bool inputPaused() const { return inputPaused_.load(std::memory_order_relaxed); }
+
     void setCloseCallback(const CloseCallback &cb)
     {
         closeCallback_ = cb;
     }
 
+    // TcpServer在连接所属loop的连接表里的位置, 只在loop线程访问
+    void setSlot(uint32_t slot) { slot_ = slot; }
+    uint32_t slot() const { return slot_; }
+
     Buffer *inputBuffer()
     {
         return &inputBuffer_;
     }
 
-    Buffer *outputBuffer()
+    const OutputQueue &outputQueue() const
     {
-        return &outputBuffer_;
+        return outputQueue_;
     }
 
     void connectEstablished();
     void connectDestroyed();
 
-    void send(std::string &buf);
+    /**
+     * send可以在任意线程调用, 不在loop线程时数据要交给loop线程发送:
+     * const&版本会拷贝一份, &&版本和BlobPtr版本直接转移所有权, 不拷贝
+     * send(Buffer*)会取走buf中的全部数据, 返回后buf为空
+     */
+    void send(const std::string &message);
+    void send(std::string &&message);
     void send(Buffer *buf);
+    void send(Buffer &&buf);
+    void send(const BlobPtr &blob);
+    // 多个分片用一次writev发出
+    void send(BlobList slices);
+    // 用sendfile发送文件的[offset, offset+len)区间, fd会被dup, 调用后可以立即关闭
+    void sendFile(int fd, off_t offset, size_t len);
     void shutdown();
+    // 不等发送队列写完, 直接关闭连接, 任意线程可调用
+    void forceClose();
     void sendInLoop(const void *message, size_t len);
+    void sendvInLoop(const struct iovec *iov, int iovcnt);
     void shutdownInLoop();
+    void forceCloseInLoop();
 
-    void setContext(const boost::any &context)
-    {
-        context_ = context;
-    }
-
-    const boost::any &getContext() const
-    {
-        return context_;
-    }
-
-    boost::any *getMutableContext()
-    {
-        return &context_;
-    }
+    // 应用层状态, 例如 conn->context().emplace<HttpContext>(), 之后 conn->context().get<HttpContext>()
+    ConnectionContext &context() { return context_; }
+    const ConnectionContext &context() const { return context_; }
 
 private:
     enum StateE
@@ -110,14 +195,61 @@ private:
 
     void setState(StateE state) { state_ = state; }
 
+    void startReadInLoop();
+    void stopReadInLoop();
+    // 根据reading_和输入水位决定是否关注EPOLLIN
+    void updateReadingInLoop();
+
+    // 供跨线程send绑定, 参数的所有权保存在functor里
+    void sendStringInLoop(std::string &message);
+    void sendBufferInLoop(const Buffer &buf);
+    void sendBlobInLoop(const BlobPtr &blob);
+    void sendSlicesInLoop(const BlobList &slices);
+    void sendFileInLoop(const FileRegionPtr &file, off_t offset, size_t len);
+
+    ssize_t writeOutput(int *savedErrno);
+    // 读取错误队列里的MSG_ZEROCOPY完成通知, 读到了返回true
+    bool readZeroCopyCompletions();
+    void lingerZeroCopy();
+    void outputQueued(size_t oldLen);
+    bool flushOutput();
+    void abortOutput();
+    bool deferWrite();
+    void flushDeferred();
+
+    // 只有loop线程写, 用relaxed的load+store代替原子加
+    static void bump(std::atomic<int64_t> &counter, int64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    // 输出缓冲区长度变化后更新峰值和高水位时长
+    void updateOutputStats();
+
+    struct StatsCounters
+    {
+        std::atomic<int64_t> bytesRead{0};
+        std::atomic<int64_t> bytesWritten{0};
+        std::atomic<int64_t> readCalls{0};
+        std::atomic<int64_t> writeCalls{0};
+        std::atomic<int64_t> eagainCount{0};
+        std::atomic<int64_t> highWaterMarkNanos{0};
+        std::atomic<int64_t> aboveHighWaterSinceNs{0};
+        std::atomic<int64_t> maxOutputBufferBytes{0};
+    };
+
     EventLoop *loop_; // 这里绝对不是baseLoop, 因为TcpConnection都是在subloop里面管理的
-    const std::string name_;
+    const uint64_t id_;
+    uint32_t slot_;
+    std::shared_ptr<const std::string> namePrefix_;
+    mutable std::string name_;
+    mutable std::once_flag nameOnce_;
     StateE state_;
     bool reading_;
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    Socket socket_;   // 和Channel一起内嵌在连接对象里, 不单独分配
+    Channel channel_;
     const InetAddress localAddr_;
     const InetAddress peerAddr_;
+    std::shared_ptr<ConnectionPool> pool_;
 
     ConnectionCallback connectionCallback_;       // 有新连接时的回调
     MessageCallback messageCallback_;             // 有读写消息时的回调
@@ -126,8 +258,18 @@ private:
     CloseCallback closeCallback_;
 
     size_t highWaterMark_;
+    size_t inputHighWaterMark_;
+    size_t inputLowWaterMark_;
+    std::atomic<int64_t> pendingWork_;
+    std::atomic<bool> inputPaused_;
+    bool coalesceWrites_;
+    bool flushScheduled_; // 已经安排了本轮结束时的flushDeferred
     Buffer inputBuffer_;  // 接收数据缓冲区
-    Buffer outputBuffer_; // 发送数据缓冲区
+    OutputQueue outputQueue_; // 发送队列
+
+    const int64_t createdNs_;
+    bool statsEnabled_;
+    StatsCounters stats_;
 
-    boost::any context_;
+    ConnectionContext context_;
 };
@@ -1,10 +1,18 @@
 #include "TcpServer.h"
 #include "Logger.h"
 #include "TcpConnection.h"
+#include "Metrics.h"
+#include "SocketsOps.h"
 
 #include <strings.h>
 #include <functional>
 
+namespace
+{
+    Counter &g_accepted = MetricsRegistry::instance().counter(
+        "swiftnet_tcpserver_accepted_total", "Number of connections accepted by tcp servers");
+}
+
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
     if(loop==nullptr)
@@ -26,8 +34,37 @@ TcpServer::TcpServer(EventLoop *loop,
     threadPool_(new EventLoopThreadPool(loop, name_)),
     connectionCallback_(),
     messaegCallback_(),
+    started_(0),
+    poolConnections_(true),
+    connNamePrefix_(std::make_shared<const std::string>(name_ + "-" + ipPort_)),
+    nextConnId_(1),
+    nextLoop_(0),
+    connectionCount_(0),
+    draining_(false),
+    listenerHandedOver_(false),
+    drainFinished_(false)
+{
+    acceptor_->setNewCOnnectionCallback(std::bind(&TcpServer::newConnection, this,
+        std::placeholders::_1, std::placeholders::_2));
+}
+
+TcpServer::TcpServer(EventLoop *loop, int listenFd, const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop)),
+    ipPort_(InetAddress(sockets::getLocalAddr(listenFd)).toIpPort()),
+    name_(nameArg),
+    acceptor_(new Acceptor(loop, listenFd)),
+    threadPool_(new EventLoopThreadPool(loop, name_)),
+    connectionCallback_(),
+    messaegCallback_(),
+    started_(0),
+    poolConnections_(true),
+    connNamePrefix_(std::make_shared<const std::string>(name_ + "-" + ipPort_)),
     nextConnId_(1),
-    started_(0)
+    nextLoop_(0),
+    connectionCount_(0),
+    draining_(false),
+    listenerHandedOver_(false),
+    drainFinished_(false)
 {
     acceptor_->setNewCOnnectionCallback(std::bind(&TcpServer::newConnection, this,
         std::placeholders::_1, std::placeholders::_2));
@@ -35,15 +72,24 @@ TcpServer::TcpServer(EventLoop *loop,
 
 TcpServer::~TcpServer()
 {
-    for(auto &item : connections_)
+    if (draining_ && !drainFinished_)
     {
-        TcpConnectionPtr conn(item.second); // 这个局部的shared_ptr智能指针，出右括号，可以自动释放new出来的tcpconnection对象
-        item.second.reset();
-
-        // 销毁连接
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestroyed, conn)
-        );
+        loop_->cancel(drainTimer_);
+    }
+    for (const LoopConnectionsPtr &loopConns : loopConnections_)
+    {
+        // 连接表只能在所属loop里访问, 表本身由lambda持有
+        loopConns->loop->runInLoop([loopConns]()
+                                   {
+                                       std::vector<TcpConnectionPtr> slots;
+                                       slots.swap(loopConns->slots);
+                                       for (const TcpConnectionPtr &conn : slots)
+                                       {
+                                           if (conn)
+                                           {
+                                               conn->connectDestroyed(); // 销毁连接
+                                           }
+                                       } });
     }
 }
 
@@ -59,68 +105,190 @@ void TcpServer::start()
     if(started_++ == 0) // 防止一个TcpServer对象被start多次
     {
         threadPool_->start(threadInitCallback_);
+        for (EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            loopConnections_.push_back(std::make_shared<LoopConnections>(ioLoop));
+            if (poolConnections_)
+            {
+                loopConnections_.back()->pool = std::make_shared<ConnectionPool>();
+            }
+        }
         loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
     }
 }
 
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
-    // 轮询栓发，选择一个subloop, 来管理channel
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
-
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n", 
-        name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
-
-    // 通过sockfd获取其绑定的本机ip地址和端口信息
-    sockaddr_in local;
-    ::bzero(&local, sizeof local);
-    socklen_t addrlen = sizeof local;
-    if(::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
-    {
-        LOG_ERROR("sockets::getLocalAddr");
-    }
-    InetAddress localAddr(local);
-
-    // 更具连接成功的sockfd, 创建TcpConnection连接对象
-    TcpConnectionPtr conn(new TcpConnection(
-                                    ioLoop,
-                                    connName,
-                                    sockfd,
-                                    localAddr,
-                                    peerAddr
-                                ));
-    connections_[connName] = conn;
+    // 轮询选择一个subloop, 来管理channel
+    g_accepted.inc();
+    LoopConnections *loopConns = loopConnections_[nextLoop_].get();
+    if (++nextLoop_ >= loopConnections_.size())
+    {
+        nextLoop_ = 0;
+    }
+    EventLoop *ioLoop = loopConns->loop;
+
+    // 通过sockfd获取其绑定的本机地址
+    InetAddress localAddr(sockets::getLocalAddr(sockfd));
+
+    // 根据连接成功的sockfd, 创建TcpConnection连接对象, 连接名等到打日志时才生成
+    TcpConnectionPtr conn;
+    if (loopConns->pool)
+    {
+        // 对象和控制块一起从池里分配
+        conn = std::allocate_shared<TcpConnection>(PoolAllocator<TcpConnection>(loopConns->pool),
+                                                   ioLoop, connNamePrefix_, nextConnId_++,
+                                                   sockfd, localAddr, peerAddr, loopConns->pool);
+    }
+    else
+    {
+        conn = std::make_shared<TcpConnection>(ioLoop, connNamePrefix_, nextConnId_++,
+                                               sockfd, localAddr, peerAddr);
+    }
+    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
+        name_.c_str(), conn->name().c_str(), peerAddr.toIpPort().c_str());
+
     // 设置回调
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messaegCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
 
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1)
-    );
-    ioLoop->runInLoop(
-        std::bind(&TcpConnection::connectEstablished, conn)
-    );
+    // 两个指针的lambda放得进std::function的内部存储, 不用分配
+    conn->setCloseCallback([this, loopConns](const TcpConnectionPtr &c)
+                           { removeConnection(loopConns, c); });
+    ++connectionCount_;
+    if (ioLoop->isInLoopThread())
+    {
+        connectionEstablishedInLoop(loopConns, conn);
+    }
+    else
+    {
+        ioLoop->queueInLoop(
+            std::bind(&TcpServer::connectionEstablishedInLoop, this, loopConns, conn)
+        );
+    }
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+void TcpServer::connectionEstablishedInLoop(LoopConnections *loopConns, const TcpConnectionPtr &conn)
 {
-    loop_->runInLoop(
-        std::bind(&TcpServer::removeConnecitonInLoop, this, conn)
-    );
+    uint32_t slot;
+    if (!loopConns->freeSlots.empty())
+    {
+        slot = loopConns->freeSlots.back();
+        loopConns->freeSlots.pop_back();
+        loopConns->slots[slot] = conn;
+    }
+    else
+    {
+        slot = static_cast<uint32_t>(loopConns->slots.size());
+        loopConns->slots.push_back(conn);
+    }
+    conn->setSlot(slot);
+    conn->connectEstablished();
 }
-void TcpServer::removeConnecitonInLoop(const TcpConnectionPtr &conn)
+
+// 在连接所属的loop中调用
+void TcpServer::removeConnection(LoopConnections *loopConns, const TcpConnectionPtr &conn)
 {
-    LOG_INFO("TcpServer::removeConnecitonInLoop [%s] - connection %s\n",
+    LOG_INFO("TcpServer::removeConnection [%s] - connection %s\n",
     name_.c_str(), conn->name().c_str());
 
-    connections_.erase(conn->name());
-    EventLoop *ioLoop = conn->getLoop();
-    ioLoop->queueInLoop(
-        std::bind(&TcpConnection::connectDestroyed, conn)
-    );
+    // 连接表里的引用留到connectDestroyed之后再释放, lambda只捕获两个标量, 不用分配
+    uint32_t slot = conn->slot();
+    conn->getLoop()->queueInLoop([loopConns, slot]()
+                                 {
+                                     TcpConnectionPtr destroyed;
+                                     destroyed.swap(loopConns->slots[slot]);
+                                     loopConns->freeSlots.push_back(slot);
+                                     destroyed->connectDestroyed(); });
+
+    --connectionCount_;
+    if (draining_)
+    {
+        loop_->runInLoop(std::bind(&TcpServer::checkDrainFinished, this));
+    }
+}
+
+void TcpServer::forEachConnection(const ConnectionCallback &func)
+{
+    for (const LoopConnectionsPtr &loopConns : loopConnections_)
+    {
+        loopConns->loop->runInLoop([loopConns, func]()
+                                   {
+                                       // 回调里关闭连接会修改slots, 先复制一份
+                                       std::vector<TcpConnectionPtr> conns;
+                                       for (const TcpConnectionPtr &conn : loopConns->slots)
+                                       {
+                                           if (conn)
+                                           {
+                                               conns.push_back(conn);
+                                           }
+                                       }
+                                       for (const TcpConnectionPtr &conn : conns)
+                                       {
+                                           func(conn);
+                                       } });
+    }
+}
+
+void TcpServer::stopAccepting()
+{
+    loop_->runInLoop([this]()
+                     { acceptor_->stopListening(!listenerHandedOver_); });
+}
+
+void TcpServer::drain(double timeoutSeconds, const DrainCallback &cb)
+{
+    loop_->runInLoop(std::bind(&TcpServer::drainInLoop, this, timeoutSeconds, cb));
+}
+
+void TcpServer::drainInLoop(double timeoutSeconds, const DrainCallback &cb)
+{
+    if (draining_)
+    {
+        return;
+    }
+    // 先置位再看连接数: 之后关闭的连接都会回到baseloop检查一次
+    draining_ = true;
+    drainCallback_ = cb;
+    // backlog里剩下的连接也会在这里建立, 并在下面一起被drain; 监听fd交出去之后它们归新进程
+    acceptor_->stopListening(!listenerHandedOver_);
+    LOG_INFO("TcpServer::drain [%s] - %d connections, timeout %.1fs\n",
+             name_.c_str(), static_cast<int>(connectionCount_), timeoutSeconds);
+    if (connectionCount_ == 0)
+    {
+        checkDrainFinished();
+        return;
+    }
+
+    drainTimer_ = loop_->runAfter(timeoutSeconds, std::bind(&TcpServer::forceCloseAll, this));
+    // 没有设置时什么都不做: 输入缓冲区为空不代表空闲, 异步处理的请求可能已经读走但还没回复,
+    // 这时shutdown会让之后的send被丢掉. 只有协议层知道什么时候可以提前关闭
+    if (drainConnectionCallback_)
+    {
+        forEachConnection(drainConnectionCallback_);
+    }
+}
+
+void TcpServer::forceCloseAll()
+{
+    LOG_WARN("TcpServer::drain [%s] - timeout, force closing %d connections\n",
+             name_.c_str(), static_cast<int>(connectionCount_));
+    forEachConnection([](const TcpConnectionPtr &conn)
+                      { conn->forceClose(); });
+}
+
+void TcpServer::checkDrainFinished()
+{
+    if (drainFinished_ || connectionCount_ != 0)
+    {
+        return;
+    }
+    drainFinished_ = true;
+    loop_->cancel(drainTimer_);
+    if (drainCallback_)
+    {
+        // 排在刚刚放进队列的connectDestroyed之后, 回调里退出loop也不会漏掉连接的清理
+        loop_->queueInLoop(drainCallback_);
+    }
 }
@@ -16,13 +16,14 @@
 #include <string>
 #include <memory>
 #include <atomic>
-#include <unordered_map>
+#include <vector>
 
 // 事件循环
 class TcpServer : noncopyable
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
+    using DrainCallback = std::function<void()>;
 
     enum Option
     {
@@ -34,6 +35,8 @@ public:
               const InetAddress &listenAddr,
               const std::string &nameArg,
               Option option = kNoReusePort);
+    // 接管已经在监听的fd而不是自己bind/listen, 用于热升级时从老进程继承监听socket
+    TcpServer(EventLoop *loop, int listenFd, const std::string &nameArg);
     ~TcpServer();
 
     void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
@@ -44,20 +47,59 @@ public:
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
 
+    // 每个loop一个ConnectionPool, 连接对象和输入缓冲区的内存循环使用, 默认开启, 在start()之前设置
+    void setConnectionPool(bool on) { poolConnections_ = on; }
+
     // 开启服务器监听
     void start();
 
+    // 停止接受新连接, 已有连接不受影响, 线程安全
+    void stopAccepting();
+    // 监听fd已经交给了新进程(见ListenerHandover.h), 之后的stopAccepting/drain直接关闭监听fd,
+    // 不再accept共享backlog里的连接, 那些连接由新进程处理. 线程安全
+    void setListenerHandedOver() { listenerHandedOver_ = true; }
+
+    /**
+     * 优雅下线: 停止接受新连接, 在每个连接所在的loop里调用drainConnectionCallback
+     * (默认不设置, 连接都等它自己结束; HttpServer用它关闭空闲的keep-alive连接),
+     * 超过timeoutSeconds仍未关闭的连接被强制关闭, 所有连接都关闭后在baseloop中调用cb. 线程安全
+     */
+    void drain(double timeoutSeconds, const DrainCallback &cb);
+    bool draining() const { return draining_; }
+
+    // drain开始时对每个连接调用, 在连接所在的loop中执行, 用来关闭协议层面空闲的连接.
+    // 只有协议层能判断连接是否空闲: 输入缓冲区为空时请求也可能正在异步处理, 回复还没发出
+    void setDrainConnectionCallback(const ConnectionCallback &cb) { drainConnectionCallback_ = cb; }
+
     EventLoop *getLoop() const { return loop_; }
 
     const std::string &ipPort() const { return ipPort_; }
+    // 监听fd, 热升级时交给新进程(见ListenerHandover.h), stopAccepting之后为-1
+    int listenFd() const { return acceptor_->listenFd(); }
     const std::string &name() const { return name_; }
+    // 当前连接数, 任意线程可调用
+    size_t connectionCount() const { return connectionCount_; }
 
 private:
-    void newConnection(int sockfd, const InetAddress &peerAddr);
-    void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnecitonInLoop(const TcpConnectionPtr &conn);
+    // 每个loop一张连接表(slot map, 下标存在TcpConnection::slot里), 增删都在所属loop线程完成, 不用回到baseloop
+    struct LoopConnections
+    {
+        explicit LoopConnections(EventLoop *l) : loop(l) {}
+        EventLoop *loop;
+        std::vector<TcpConnectionPtr> slots;
+        std::vector<uint32_t> freeSlots;
+        std::shared_ptr<ConnectionPool> pool; // 关闭连接池时为空
+    };
+    using LoopConnectionsPtr = std::shared_ptr<LoopConnections>;
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    void newConnection(int sockfd, const InetAddress &peerAddr);
+    void connectionEstablishedInLoop(LoopConnections *loopConns, const TcpConnectionPtr &conn);
+    void removeConnection(LoopConnections *loopConns, const TcpConnectionPtr &conn);
+    // 对每个loop里的每个连接, 在该loop线程中调用func
+    void forEachConnection(const ConnectionCallback &func);
+    void drainInLoop(double timeoutSeconds, const DrainCallback &cb);
+    void forceCloseAll();
+    void checkDrainFinished();
 
     EventLoop *loop_; // baseloop 用户定义的baseloop
     const std::string ipPort_;
@@ -70,9 +112,20 @@ private:
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
 
     ThreadInitCallback threadInitCallback_; // loop线程初始化的回调
+    ConnectionCallback drainConnectionCallback_;
 
     std::atomic_int started_;
-
-    int nextConnId_;
-    ConnectionMap connections_; // 保存所有的连接
+    bool poolConnections_;
+
+    std::shared_ptr<const std::string> connNamePrefix_; // 连接名的前缀 name-ip:port, 所有连接共用
+    uint64_t nextConnId_;
+    std::vector<LoopConnectionsPtr> loopConnections_; // start()之后和threadPool的loop一一对应
+    size_t nextLoop_;
+    std::atomic<size_t> connectionCount_;
+
+    std::atomic_bool draining_;
+    std::atomic_bool listenerHandedOver_;
+    bool drainFinished_;
+    TimerId drainTimer_;
+    DrainCallback drainCallback_;
 };
\ No newline at end of file
@@ -6,11 +6,21 @@
 #include "EventLoop.h"
 #include "Timer.h"
 #include "TimerId.h"
+#include "Metrics.h"
+#include "Probes.h"
 
 #include <sys/timerfd.h>
 #include <unistd.h>
 #include <cstring>
 
+namespace
+{
+  Counter &g_timersFired = MetricsRegistry::instance().counter(
+      "swiftnet_timers_fired_total", "Number of timer callbacks run");
+  Gauge &g_timersActive = MetricsRegistry::instance().gauge(
+      "swiftnet_timers_active", "Number of timers waiting to fire");
+}
+
 int createTimerfd()
 {
   int timerfd = ::timerfd_create(CLOCK_MONOTONIC,
@@ -86,6 +96,7 @@ TimerQueue::~TimerQueue()
   {
     delete timer.second;
   }
+  g_timersActive.sub(timers_.size());
 }
 
 TimerId TimerQueue::addTimer(TimerCallback cb,
@@ -106,6 +117,7 @@ void TimerQueue::cancel(TimerId timerId)
 
 void TimerQueue::addTimerInLoop(Timer *timer)
 {
+  g_timersActive.inc();
   bool earliestChanged = insert(timer);
 
   if (earliestChanged)
@@ -124,6 +136,7 @@ void TimerQueue::cancelInLoop(TimerId timerId)
     (void)n;
     delete it->first; // FIXME: no delete please
     activeTimers_.erase(it);
+    g_timersActive.dec();
   }
   else if (callingExpiredTimers_)
   {
@@ -143,8 +156,12 @@ void TimerQueue::handleRead()
   // safe to callback outside critical section
   for (const Entry &it : expired)
   {
+    int64_t start = monotonicNanos();
+    SWIFTNET_PROBE2(timer_fire, it.second, it.second->sequence());
     it.second->run();
+    loop_->finishCallback(EventLoop::kTimer, &loop_->timerLatency_, nullptr, timerfd_, start);
   }
+  g_timersFired.add(expired.size());
   callingExpiredTimers_ = false;
 
   reset(expired, now);
@@ -184,6 +201,7 @@ void TimerQueue::reset(const std::vector<Entry> &expired, Timestamp now)
     {
       // FIXME move to a free list
       delete it.second; // FIXME: no delete please
+      g_timersActive.dec();
     }
   }
 
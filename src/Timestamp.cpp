@@ -1,5 +1,6 @@
 #include "Timestamp.h"
 #include <time.h>
+#include <sys/time.h>
 
 Timestamp::Timestamp() : microSecondsSinceEpoch_(0) {};
 Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
@@ -9,14 +10,17 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
 
 Timestamp Timestamp::now()
 {
-    time_t it = time(NULL);
-    return Timestamp(it);
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t seconds = tv.tv_sec;
+    return Timestamp(seconds * kMicroSecondsPerSecond + tv.tv_usec);
 }
 
 std::string Timestamp::toString() const
 {
     char buf[128] = {0};
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);
+    time_t seconds = static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond);
+    tm *tm_time = localtime(&seconds);
     snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d",
              tm_time->tm_year + 1900,
              tm_time->tm_mon + 1,
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <string>
+#include <time.h>
 
 class Timestamp
 {
@@ -45,3 +46,11 @@ inline Timestamp addTime(Timestamp timestamp, double seconds)
     int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
     return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
 }
+
+// 单调时钟(纳秒), 不受系统时间调整影响, 只用于测量耗时
+inline int64_t monotonicNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
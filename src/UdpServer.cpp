@@ -0,0 +1,72 @@
+#include "UdpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <future>
+
+UdpServer::UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg)
+    : loop_(loop),
+      name_(nameArg),
+      localAddr_(listenAddr),
+      threadPool_(new EventLoopThreadPool(loop, nameArg)),
+      batchSize_(64),
+      maxDatagramSize_(2048),
+      gso_(true),
+      started_(false)
+{
+}
+
+UdpServer::~UdpServer()
+{
+    LOG_INFO("UdpServer::~UdpServer [%s] destructing\n", name_.c_str());
+    // 套接字在各自的loop里析构, 等它们都关掉之后线程池才能退出
+    for (UdpSocketPtr &socket : sockets_)
+    {
+        EventLoop *ioLoop = socket->getLoop();
+        if (ioLoop == loop_)
+        {
+            socket.reset();
+        }
+        else
+        {
+            std::promise<void> done;
+            ioLoop->runInLoop([&socket, &done]()
+                              {
+                                  socket.reset();
+                                  done.set_value(); });
+            done.get_future().wait();
+        }
+    }
+}
+
+void UdpServer::start()
+{
+    if (started_)
+    {
+        return;
+    }
+    started_ = true;
+    threadPool_->start(threadInitCallback_);
+
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    bool reusePort = loops.size() > 1;
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        // 第一个套接字绑定之后用它的实际地址, 端口为0时其余的套接字绑到同一个端口上
+        UdpSocketPtr socket(new UdpSocket(loops[i], localAddr_, name_ + "#" + std::to_string(i), reusePort));
+        if (i == 0)
+        {
+            localAddr_ = socket->localAddress();
+        }
+        socket->setMessageCallback(messageCallback_);
+        socket->setBatchSize(batchSize_);
+        socket->setMaxDatagramSize(maxDatagramSize_);
+        socket->setGso(gso_);
+        sockets_.push_back(socket);
+    }
+    for (const UdpSocketPtr &socket : sockets_)
+    {
+        socket->start();
+    }
+    LOG_INFO("UdpServer::start [%s] on %s with %zu sockets\n", name_.c_str(), localAddr_.toIpPort().c_str(), sockets_.size());
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "EventLoopThreadPool.h"
+#include "InetAddress.h"
+#include "UdpSocket.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * 多线程UDP服务器: 每个loop(只有baseloop时就是它)一个绑定同一地址的UdpSocket,
+ * 多于一个时设置SO_REUSEPORT, 由内核按对端地址哈希把报文分到各个套接字, 同一对端总落在同一个loop
+ * 回调在收到报文的套接字所在的loop里执行, 回复用回调参数里的UdpSocket::sendTo
+ * 必须在baseloop线程析构
+ */
+class UdpServer : noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop *)>;
+
+    UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg);
+    ~UdpServer();
+
+    // 以下设置在start()之前调用
+    void setThreadNum(int numThreads) { threadPool_->setThreadNum(numThreads); }
+    void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    void setMessageCallback(const UdpMessageCallback &cb) { messageCallback_ = cb; }
+    // 见UdpSocket的同名设置
+    void setBatchSize(int batchSize) { batchSize_ = batchSize; }
+    void setMaxDatagramSize(size_t size) { maxDatagramSize_ = size; }
+    void setGso(bool on) { gso_ = on; }
+
+    // 启动loop线程并开始接收, 只能在baseloop线程调用一次
+    void start();
+
+    EventLoop *getLoop() const { return loop_; }
+    const std::string &name() const { return name_; }
+    // 实际绑定的地址, 端口为0时在start()之后才是内核分配的端口
+    const InetAddress &localAddress() const { return localAddr_; }
+    // start()之后和线程池的loop一一对应
+    const std::vector<UdpSocketPtr> &sockets() const { return sockets_; }
+
+private:
+    EventLoop *loop_; // baseloop
+    const std::string name_;
+    InetAddress localAddr_;
+    std::shared_ptr<EventLoopThreadPool> threadPool_;
+    ThreadInitCallback threadInitCallback_;
+    UdpMessageCallback messageCallback_;
+    int batchSize_;
+    size_t maxDatagramSize_;
+    bool gso_;
+    bool started_;
+    std::vector<UdpSocketPtr> sockets_;
+};
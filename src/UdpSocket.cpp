@@ -0,0 +1,404 @@
+#include "UdpSocket.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "SocketsOps.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+namespace
+{
+    Counter &g_packetsReceived = MetricsRegistry::instance().counter(
+        "swiftnet_udp_packets_received_total", "Datagrams received by all udp sockets");
+    Counter &g_recvBatches = MetricsRegistry::instance().counter(
+        "swiftnet_udp_recv_batches_total", "recvmmsg calls that returned at least one datagram");
+    Counter &g_truncated = MetricsRegistry::instance().counter(
+        "swiftnet_udp_truncated_total", "Datagrams truncated because they exceeded the receive slot size");
+    Counter &g_packetsSent = MetricsRegistry::instance().counter(
+        "swiftnet_udp_packets_sent_total", "Datagrams handed to the kernel by all udp sockets");
+    Counter &g_sendBatches = MetricsRegistry::instance().counter(
+        "swiftnet_udp_send_batches_total", "sendmmsg calls that sent at least one message");
+    Counter &g_sendDrops = MetricsRegistry::instance().counter(
+        "swiftnet_udp_send_drops_total", "Datagrams dropped by a full send queue or a send error");
+
+    // IPv4上一个UDP报文的最大负载, 一个GSO报文合起来也不能超过它
+    const size_t kMaxUdpPayload = 65507;
+    // 一个GSO报文最多切成的段数, 老内核上限是64
+    const size_t kMaxGsoSegments = 64;
+    // 一次sendmmsg最多提交的消息数
+    const int kMaxSendBatch = 64;
+    // 一次可读事件最多收的报文数, 避免一个很忙的套接字把loop上的其他channel饿死
+    const int kMaxPacketsPerRead = 1024;
+
+    int createUdpSocket(sa_family_t family)
+    {
+        int sockfd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sockfd < 0)
+        {
+            LOG_FATAL("%s:%s:%d udp socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+        }
+        return sockfd;
+    }
+
+    bool samePeer(const InetAddress &a, const InetAddress &b)
+    {
+        return a.getSockLen() == b.getSockLen() &&
+               ::memcmp(a.getSockAddr(), b.getSockAddr(), a.getSockLen()) == 0;
+    }
+}
+
+UdpSocket::UdpSocket(EventLoop *loop, const InetAddress &bindAddr, const std::string &name, bool reusePort)
+    : loop_(loop),
+      name_(name),
+      fd_(createUdpSocket(bindAddr.family())),
+      channel_(loop, fd_),
+      started_(false),
+      gsoSupported_(false),
+      gso_(false),
+      batchSize_(64),
+      maxDatagramSize_(2048),
+      sendQueueLimit_(4 * 1024 * 1024),
+      flushScheduled_(false),
+      sendNext_(0)
+{
+    if (reusePort)
+    {
+        int optval = 1;
+        ::setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof optval);
+    }
+    if (::bind(fd_, bindAddr.getSockAddr(), bindAddr.getSockLen()) < 0)
+    {
+        LOG_FATAL("%s:%s:%d udp bind %s err:%d \n", __FILE__, __FUNCTION__, __LINE__, bindAddr.toIpPort().c_str(), errno);
+    }
+    localAddr_ = sockets::getLocalAddr(fd_);
+
+    // 能读出UDP_SEGMENT选项说明内核支持GSO(4.18+), 网卡不支持时发送会报错, 到时再关掉
+    if (bindAddr.family() == AF_INET)
+    {
+        int segment = 0;
+        socklen_t len = sizeof segment;
+        gsoSupported_ = ::getsockopt(fd_, SOL_UDP, UDP_SEGMENT, &segment, &len) == 0;
+    }
+    gso_ = gsoSupported_;
+
+    channel_.setReadCallback(std::bind(&UdpSocket::handleRead, this, std::placeholders::_1));
+    channel_.setWriteCallback(std::bind(&UdpSocket::handleWrite, this));
+}
+
+UdpSocket::~UdpSocket()
+{
+    LOG_DEBUG("UdpSocket::dtor[%s] fd=%d\n", name_.c_str(), fd_);
+    channel_.disableAll();
+    channel_.remove();
+    ::close(fd_);
+}
+
+void UdpSocket::setBatchSize(int batchSize)
+{
+    batchSize_ = batchSize > 0 ? batchSize : 1;
+}
+
+void UdpSocket::setMaxDatagramSize(size_t size)
+{
+    maxDatagramSize_ = size > 0 ? size : 1;
+}
+
+void UdpSocket::start()
+{
+    loop_->runInLoop(std::bind(&UdpSocket::startInLoop, shared_from_this()));
+}
+
+void UdpSocket::stop()
+{
+    loop_->runInLoop(std::bind(&UdpSocket::stopInLoop, shared_from_this()));
+}
+
+void UdpSocket::startInLoop()
+{
+    if (started_)
+    {
+        return;
+    }
+    started_ = true;
+    allocateReceiveBuffers();
+    channel_.tie(shared_from_this());
+    channel_.enableReading();
+}
+
+void UdpSocket::stopInLoop()
+{
+    started_ = false;
+    channel_.disableAll();
+    g_sendDrops.add(static_cast<int64_t>(sendQueue_.size() - sendNext_));
+    sendBuffer_.clear();
+    sendQueue_.clear();
+    sendNext_ = 0;
+}
+
+// 每个报文在recvBuffer_里有一个固定的槽, mmsghdr/iovec/地址数组都指向这些槽, 之后每次收包只重置长度
+void UdpSocket::allocateReceiveBuffers()
+{
+    recvBuffer_.resize(batchSize_ * maxDatagramSize_);
+    recvMsgs_.resize(batchSize_);
+    recvIovs_.resize(batchSize_);
+    recvAddrs_.resize(batchSize_);
+    for (int i = 0; i < batchSize_; ++i)
+    {
+        recvIovs_[i].iov_base = &recvBuffer_[i * maxDatagramSize_];
+        recvIovs_[i].iov_len = maxDatagramSize_;
+        struct msghdr &hdr = recvMsgs_[i].msg_hdr;
+        ::memset(&hdr, 0, sizeof hdr);
+        hdr.msg_iov = &recvIovs_[i];
+        hdr.msg_iovlen = 1;
+        hdr.msg_name = &recvAddrs_[i];
+    }
+}
+
+void UdpSocket::handleRead(Timestamp receiveTime)
+{
+    UdpSocketPtr guard(shared_from_this());
+    int received = 0;
+    while (started_ && received < kMaxPacketsPerRead)
+    {
+        for (int i = 0; i < batchSize_; ++i)
+        {
+            recvMsgs_[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+            recvMsgs_[i].msg_hdr.msg_flags = 0;
+        }
+        int n = ::recvmmsg(fd_, recvMsgs_.data(), batchSize_, MSG_DONTWAIT, nullptr);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                // ICMP端口不可达等错误会在这里报告一次, 不影响之后收包
+                LOG_ERROR("UdpSocket::handleRead[%s] recvmmsg err:%d\n", name_.c_str(), errno);
+            }
+            break;
+        }
+        g_recvBatches.inc();
+        g_packetsReceived.add(n);
+        received += n;
+        for (int i = 0; i < n; ++i)
+        {
+            const struct msghdr &hdr = recvMsgs_[i].msg_hdr;
+            if (hdr.msg_flags & MSG_TRUNC)
+            {
+                g_truncated.inc();
+            }
+            if (messageCallback_)
+            {
+                InetAddress peer(static_cast<const sockaddr *>(hdr.msg_name), hdr.msg_namelen);
+                messageCallback_(guard, static_cast<const char *>(recvIovs_[i].iov_base),
+                                 recvMsgs_[i].msg_len, peer, receiveTime);
+            }
+        }
+        if (n < batchSize_)
+        {
+            break;
+        }
+    }
+}
+
+void UdpSocket::handleWrite()
+{
+    flush();
+}
+
+void UdpSocket::sendTo(const InetAddress &peer, const void *data, size_t len)
+{
+    if (loop_->isInLoopThread())
+    {
+        sendInLoop(peer, data, len);
+    }
+    else
+    {
+        UdpSocketPtr self(shared_from_this());
+        std::string message(static_cast<const char *>(data), len);
+        loop_->runInLoop([self, peer, message]()
+                         { self->sendInLoop(peer, message.data(), message.size()); });
+    }
+}
+
+void UdpSocket::sendInLoop(const InetAddress &peer, const void *data, size_t len)
+{
+    if (len > kMaxUdpPayload || pendingBytes() + len > sendQueueLimit_)
+    {
+        g_sendDrops.inc();
+        return;
+    }
+    if (sendNext_ == sendQueue_.size())
+    {
+        sendBuffer_.clear();
+        sendQueue_.clear();
+        sendNext_ = 0;
+    }
+    sendQueue_.push_back(Datagram{peer, sendBuffer_.size(), len});
+    sendBuffer_.append(static_cast<const char *>(data), len);
+
+    // 正在等可写时由handleWrite发, 否则本轮循环结束时把这一轮排的报文一起发出去
+    if (!flushScheduled_ && !channel_.isWriting())
+    {
+        flushScheduled_ = true;
+        std::weak_ptr<UdpSocket> weak(shared_from_this());
+        loop_->runAfterIteration([weak]()
+                                 {
+                                     UdpSocketPtr self(weak.lock());
+                                     if (self)
+                                     {
+                                         self->flushScheduled_ = false;
+                                         self->flush();
+                                     } });
+    }
+}
+
+// 同一个对端, 长度相同的连续报文(最后一个可以更短)合并成一个GSO报文
+size_t UdpSocket::gsoRun(size_t first) const
+{
+    const Datagram &head = sendQueue_[first];
+    size_t count = 1;
+    size_t total = head.len;
+    if (head.len == 0)
+    {
+        return count;
+    }
+    for (size_t i = first + 1; i < sendQueue_.size() && count < kMaxGsoSegments; ++i)
+    {
+        const Datagram &d = sendQueue_[i];
+        if (d.len == 0 || d.len > head.len || total + d.len > kMaxUdpPayload || !samePeer(d.peer, head.peer))
+        {
+            break;
+        }
+        ++count;
+        total += d.len;
+        if (d.len < head.len)
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+void UdpSocket::flush()
+{
+    struct mmsghdr msgs[kMaxSendBatch];
+    struct iovec iovs[kMaxSendBatch];
+    char control[kMaxSendBatch][CMSG_SPACE(sizeof(uint16_t))];
+    size_t runs[kMaxSendBatch];
+
+    while (sendNext_ < sendQueue_.size())
+    {
+        int count = 0;
+        for (size_t next = sendNext_; count < kMaxSendBatch && next < sendQueue_.size(); ++count)
+        {
+            size_t run = gso_ ? gsoRun(next) : 1;
+            const Datagram &head = sendQueue_[next];
+            const Datagram &last = sendQueue_[next + run - 1];
+            iovs[count].iov_base = &sendBuffer_[head.offset];
+            iovs[count].iov_len = last.offset + last.len - head.offset;
+
+            struct msghdr &hdr = msgs[count].msg_hdr;
+            ::memset(&hdr, 0, sizeof hdr);
+            hdr.msg_name = const_cast<sockaddr *>(head.peer.getSockAddr());
+            hdr.msg_namelen = head.peer.getSockLen();
+            hdr.msg_iov = &iovs[count];
+            hdr.msg_iovlen = 1;
+            if (run > 1)
+            {
+                hdr.msg_control = control[count];
+                hdr.msg_controllen = sizeof control[count];
+                struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t segmentSize = static_cast<uint16_t>(head.len);
+                ::memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof segmentSize);
+            }
+            runs[count] = run;
+            next += run;
+        }
+
+        int n = ::sendmmsg(fd_, msgs, count, MSG_DONTWAIT);
+        if (n < 0)
+        {
+            int savedErrno = errno;
+            if (savedErrno == EINTR)
+            {
+                continue;
+            }
+            if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+            {
+                // 套接字发送缓冲区满了, 等可写再继续
+                if (sendNext_ > 0)
+                {
+                    compactSendQueue();
+                }
+                if (!channel_.isWriting())
+                {
+                    channel_.enableWriting();
+                }
+                return;
+            }
+            if (savedErrno == ENOBUFS)
+            {
+                // 网卡或qdisc队列满了, 套接字本身仍然可写, 等EPOLLOUT会立即返回而空转.
+                // 和内核在队列满时的做法一样, 丢掉这批报文, 由上层协议负责重传
+                g_sendDrops.add(static_cast<int64_t>(runs[0]));
+                sendNext_ += runs[0];
+                continue;
+            }
+            if (runs[0] > 1 && (savedErrno == EIO || savedErrno == EINVAL || savedErrno == ENOPROTOOPT))
+            {
+                // 网卡不支持校验和卸载等情况下GSO报文会被拒绝, 以后都一个报文一个报文地发
+                LOG_WARN("UdpSocket::flush[%s] UDP GSO rejected err:%d, falling back to sendmmsg\n", name_.c_str(), savedErrno);
+                gso_ = false;
+                continue;
+            }
+            LOG_ERROR("UdpSocket::flush[%s] sendmmsg to %s err:%d\n", name_.c_str(),
+                      sendQueue_[sendNext_].peer.toIpPort().c_str(), savedErrno);
+            g_sendDrops.add(static_cast<int64_t>(runs[0]));
+            sendNext_ += runs[0];
+            continue;
+        }
+        g_sendBatches.inc();
+        for (int i = 0; i < n; ++i)
+        {
+            g_packetsSent.add(static_cast<int64_t>(runs[i]));
+            sendNext_ += runs[i];
+        }
+        // 只发出去一部分时, 下一次sendmmsg会报告剩下的第一个消息出了什么错
+    }
+
+    sendBuffer_.clear();
+    sendQueue_.clear();
+    sendNext_ = 0;
+    if (channel_.isWriting())
+    {
+        channel_.disableWriting();
+    }
+}
+
+void UdpSocket::compactSendQueue()
+{
+    size_t base = sendQueue_[sendNext_].offset;
+    sendBuffer_.erase(0, base);
+    sendQueue_.erase(sendQueue_.begin(), sendQueue_.begin() + sendNext_);
+    for (Datagram &d : sendQueue_)
+    {
+        d.offset -= base;
+    }
+    sendNext_ = 0;
+}
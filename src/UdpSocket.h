@@ -0,0 +1,114 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Channel.h"
+#include "InetAddress.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+class EventLoop;
+class UdpSocket;
+
+using UdpSocketPtr = std::shared_ptr<UdpSocket>;
+// data只在回调期间有效, 指向UdpSocket内部循环使用的接收缓冲区
+using UdpMessageCallback = std::function<void(const UdpSocketPtr &, const char *data, size_t len,
+                                              const InetAddress &peer, Timestamp receiveTime)>;
+
+/**
+ * 绑定在一个loop上的UDP套接字(IPv4)
+ * 接收: 可读时用recvmmsg一次收一批报文, 接收缓冲区在构造时一次分配好, 之后一直复用
+ * 发送: loop线程里的sendTo先排队, 本轮循环结束时用一次sendmmsg发出; 同一对端的等长报文
+ *       合并成一个UDP GSO(UDP_SEGMENT)报文, 由内核切分. 发送缓冲区满(EAGAIN)时等可写再发,
+ *       网卡队列满(ENOBUFS)时丢弃, 排队的数据超过上限后新的报文直接丢弃
+ * 必须由shared_ptr管理, 在所属loop线程析构
+ */
+class UdpSocket : noncopyable,
+                  public std::enable_shared_from_this<UdpSocket>
+{
+public:
+    // 创建并绑定套接字, 失败时LOG_FATAL; 端口为0时由内核分配, 见localAddress()
+    // reusePort为true时设置SO_REUSEPORT, 多个套接字绑定同一端口, 内核按四元组哈希分流
+    UdpSocket(EventLoop *loop, const InetAddress &bindAddr, const std::string &name, bool reusePort = false);
+    ~UdpSocket();
+
+    // 以下设置在start()之前调用
+    void setMessageCallback(const UdpMessageCallback &cb) { messageCallback_ = cb; }
+    // 一次recvmmsg最多收的报文数, 默认64
+    void setBatchSize(int batchSize);
+    // 单个报文的最大长度, 更长的报文被截断并计数, 默认2048
+    void setMaxDatagramSize(size_t size);
+    // 排队待发的字节数上限, 默认4MiB
+    void setSendQueueLimit(size_t bytes) { sendQueueLimit_ = bytes; }
+    // 是否用UDP GSO合并发送, 内核支持时默认开启
+    void setGso(bool on) { gso_ = on && gsoSupported_; }
+
+    // 开始接收, 线程安全
+    void start();
+    // 停止接收和发送, 线程安全, 排队未发的报文丢弃
+    void stop();
+
+    // 线程安全. 在loop线程里调用时不拷贝到别处, 报文直接进发送队列
+    void sendTo(const InetAddress &peer, const void *data, size_t len);
+
+    EventLoop *getLoop() const { return loop_; }
+    const std::string &name() const { return name_; }
+    int fd() const { return fd_; }
+    const InetAddress &localAddress() const { return localAddr_; }
+    bool gsoEnabled() const { return gso_; }
+    // 排队还没发出的字节数, 只在loop线程调用
+    size_t pendingBytes() const
+    {
+        return sendNext_ < sendQueue_.size() ? sendBuffer_.size() - sendQueue_[sendNext_].offset : 0;
+    }
+
+private:
+    // 发送队列里的一个报文, 数据在sendBuffer_[offset, offset + len)
+    struct Datagram
+    {
+        InetAddress peer;
+        size_t offset;
+        size_t len;
+    };
+
+    void startInLoop();
+    void stopInLoop();
+    void allocateReceiveBuffers();
+    void handleRead(Timestamp receiveTime);
+    void handleWrite();
+    void sendInLoop(const InetAddress &peer, const void *data, size_t len);
+    void flush();
+    // 丢掉已经发出的部分, 只在发送被阻塞时调用
+    void compactSendQueue();
+    // 从sendQueue_[first]开始, 能合并进一个GSO报文的个数
+    size_t gsoRun(size_t first) const;
+
+    EventLoop *loop_;
+    const std::string name_;
+    const int fd_;
+    InetAddress localAddr_;
+    Channel channel_;
+    bool started_;
+    bool gsoSupported_;
+    bool gso_;
+    UdpMessageCallback messageCallback_;
+
+    // 接收
+    int batchSize_;
+    size_t maxDatagramSize_;
+    std::vector<char> recvBuffer_; // batchSize_ * maxDatagramSize_
+    std::vector<struct mmsghdr> recvMsgs_;
+    std::vector<struct iovec> recvIovs_;
+    std::vector<struct sockaddr_storage> recvAddrs_;
+
+    // 发送
+    size_t sendQueueLimit_;
+    bool flushScheduled_;
+    std::string sendBuffer_;
+    std::vector<Datagram> sendQueue_;
+    size_t sendNext_; // sendQueue_里第一个未发出的报文
+};
@@ -1,4 +1,5 @@
 #include "HttpClient.h"
+#include "../EventLoop.h"
 #include "../Logger.h"
 
 #include "HttpContext.h"
@@ -6,6 +7,7 @@
 #include "HttpResponse.h"
 
 #include <iostream>
+#include <iterator>
 
 namespace detail
 {
@@ -25,6 +27,9 @@ HttpClient::HttpClient(EventLoop *loop,
     : client_(loop, serverAddr, name),
       httpResponseCallback_(detail::defaultHttpCallback),
       connected_(false), isConnecting_(false),
+      pipelineDepth_(1),
+      peerClosing_(false),
+      userDisconnected_(false),
       useThreadPool_(useThreadPool),
       maxThreadPoolSize_(maxThreadPoolSize),
       maxTaskCount_(maxTaskCount)
@@ -39,6 +44,9 @@ HttpClient::HttpClient(EventLoop *loop,
     client_.setConnectionCallback(
         std::bind(&HttpClient::onConnection, this, std::placeholders::_1));
 
+    client_.setConnectFailedCallback([this]()
+                                     { onConnectFailed(); });
+
     // 设置消息回调
     client_.setMessageCallback(
         std::bind(&HttpClient::onMessage, this,
@@ -49,16 +57,28 @@ HttpClient::HttpClient(EventLoop *loop,
 
 void HttpClient::connect()
 {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        userDisconnected_ = false;
+    }
     client_.connect();
 }
 
 void HttpClient::disconnect()
 {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        userDisconnected_ = true;
+    }
     client_.disconnect();
 }
 
 void HttpClient::stop()
 {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        userDisconnected_ = true;
+    }
     client_.stop();
 }
 
@@ -71,22 +91,7 @@ void HttpClient::get(const std::string &path)
     request.setPath(path.c_str(), path.c_str() + path.size());
     request.setVersion(HttpRequest::kHttp11);
 
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (!connected_ && !isConnecting_)
-    {
-        LOG_WARN("HttpClient::get - not connected");
-        connect();
-        isConnecting_ = true;
-    }
-    if (!connected_)
-    {
-        // LOG_WARN("HttpClient::get - 添加到请求队列");
-        requests_.push(request);
-    }
-    else
-    {
-        sendRequest(request, httpResponseCallback_);
-    }
+    sendRequest(request, httpResponseCallback_);
 }
 
 void HttpClient::post(const std::string &path,
@@ -102,65 +107,98 @@ void HttpClient::post(const std::string &path,
     request.addHeader("Content-Length", std::to_string(body.length()));
     request.setBody(body);
 
+    sendRequest(request, httpResponseCallback_);
+}
+
+void HttpClient::sendRequest(const HttpRequest &req, const HttpResponseCallback &cb)
+{
+    sendRequest(req, cb, HttpBodyCallback());
+}
+
+void HttpClient::sendRequest(const HttpRequest &req, const HttpResponseCallback &cb, const HttpBodyCallback &onBody)
+{
+    // 在锁外构造HTTP请求
+    Buffer buf;
+    req.appendToBuffer(&buf);
+    PendingRequest pending;
+    pending.wire = buf.retrieveAllAsString();
+    pending.cb = cb;
+    pending.idempotent = req.method() != HttpRequest::kPost;
+    pending.head = req.method() == HttpRequest::kHead;
+    pending.onBody = onBody;
+    pending.replays = 0;
+
     std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back(std::move(pending));
     if (!connected_ && !isConnecting_)
     {
-        LOG_WARN("HttpClient::post - not connected");
-        connect();
+        LOG_WARN("HttpClient::sendRequest - not connected");
+        userDisconnected_ = false;
+        client_.connect();
         isConnecting_ = true;
     }
-    if (!connected_)
+    else if (connected_)
     {
-        // LOG_WARN("HttpClient::post - 添加到请求队列");
-        requests_.push(request);
-    }
-    else
-    {
-        // LOG_WARN("HttpClient::post - 直接发送");
-        sendRequest(request, httpResponseCallback_);
+        sendNextLocked();
     }
 }
 
-void HttpClient::sendRequest(const HttpRequest &req, const HttpResponseCallback &cb)
+std::future<HttpResponse> HttpClient::sendRequest(const HttpRequest &req)
 {
-    httpResponseCallback_ = cb;
+    std::shared_ptr<std::promise<HttpResponse>> promise = std::make_shared<std::promise<HttpResponse>>();
+    std::future<HttpResponse> future = promise->get_future();
+    sendRequest(req, [promise](const HttpResponse &resp)
+                { promise->set_value(resp); });
+    return future;
+}
 
-    // 获取连接
+void HttpClient::sendNextLocked()
+{
+    if (peerClosing_ || requests_.empty() ||
+        inflight_.size() >= static_cast<size_t>(pipelineDepth_))
+    {
+        return;
+    }
     TcpConnectionPtr conn = client_.connection();
-    if (conn && conn->connected())
-    {
-        // 构造HTTP请求
-        Buffer buf;
-        // 添加请求行
-        buf.append(req.methodString());
-        buf.append(" ");
-        buf.append(req.path());
-        buf.append(" HTTP/1.1\r\n");
-
-        // 添加其他头部
-        for (const auto &header : req.headers())
+    if (!conn || !conn->connected())
+    {
+        LOG_WARN("HttpClient::sendRequest - connection is not available");
+        return;
+    }
+
+    // 能发的请求拼进同一个Buffer, 一次写出去
+    Buffer buf;
+    while (!requests_.empty() && inflight_.size() < static_cast<size_t>(pipelineDepth_))
+    {
+        bool idempotent = requests_.front().idempotent;
+        if (!idempotent && !inflight_.empty())
         {
-            buf.append(header.first);
-            buf.append(": ");
-            buf.append(header.second);
-            buf.append("\r\n");
+            break;
         }
-
-        // 添加空行
-        buf.append("\r\n");
-
-        // 添加请求体
-        if (!req.body().empty())
+        buf.append(requests_.front().wire);
+        inflight_.push_back(std::move(requests_.front()));
+        requests_.pop_front();
+        if (!idempotent)
         {
-            buf.append(req.body());
+            break;
         }
+    }
+    conn->send(&buf);
+}
 
-        // 发送请求
-        conn->send(&buf);
+void HttpClient::deliver(const HttpResponseCallback &cb, const HttpResponse &resp)
+{
+    if (!cb)
+    {
+        return;
+    }
+    if (useThreadPool_)
+    {
+        threadPool_.submit(std::bind(cb, resp));
     }
     else
     {
-        LOG_WARN("HttpClient::sendRequest - connection is not available");
+        cb(resp);
     }
 }
 
@@ -173,80 +211,155 @@ void HttpClient::onConnection(const TcpConnectionPtr &conn)
 
     if (conn->connected())
     {
-        conn->setContext(HttpContext());
+        // 解析状态跟着连接走, 一个响应分几次到达也能接着解析
+        conn->context().emplace<HttpContext>();
+        // 请求已经由sendNextLocked攒批, 不需要Nagle再等
+        conn->setTcpNoDelay(true);
 
-        // 发送请求
         std::lock_guard<std::mutex> lock(mutex_);
         connected_ = true;
-        // LOG_WARN("HttpClient::onConnection - 发送请求数量 %d", requests_.size());
-        if (!requests_.empty())
+        isConnecting_ = false;
+        sendNextLocked();
+    }
+    else
+    {
+        std::deque<PendingRequest> lost;
         {
-            // LOG_WARN("HttpClient::onConnection - 发送请求");
-            sendRequest(requests_.front(), httpResponseCallback_);
-            requests_.pop();
-            // 等待10ms
+            std::lock_guard<std::mutex> lock(mutex_);
+            connected_ = false;
+            isConnecting_ = false;
+            peerClosing_ = false;
+            lost.swap(inflight_);
+        }
+        // 以关闭连接作为结束的body, 这时才算收完
+        HttpContext *context = conn->context().get<HttpContext>();
+        if (!lost.empty() && context != nullptr && context->finishResponseOnClose())
+        {
+            deliver(lost.front().cb, context->response());
+            lost.pop_front();
+            context->reset();
+        }
+
+        // 队头的响应已经收到一部分时, 它的body可能已经交给了onBody, 重发会让调用方收到重复的数据
+        bool frontStarted = context != nullptr && !context->expectRequestLine();
+
+        // 已经发出去的幂等请求按原顺序放回队头, 在新连接上重发, 没发出去的也留给新连接
+        std::deque<PendingRequest> failed;
+        bool reconnect = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::deque<PendingRequest> replay;
+            for (PendingRequest &pending : lost)
+            {
+                bool delivered = frontStarted && &pending == &lost.front() && pending.onBody;
+                if (pending.idempotent && !delivered && pending.replays < kMaxReplays && !userDisconnected_)
+                {
+                    ++pending.replays;
+                    replay.push_back(std::move(pending));
+                }
+                else
+                {
+                    failed.push_back(std::move(pending));
+                }
+            }
+            requests_.insert(requests_.begin(),
+                             std::make_move_iterator(replay.begin()),
+                             std::make_move_iterator(replay.end()));
+            if (!requests_.empty() && !userDisconnected_)
+            {
+                isConnecting_ = true;
+                reconnect = true;
+            }
+        }
+        if (reconnect)
+        {
+            // 等TcpClient处理完这个连接的关闭再重连
+            client_.getLoop()->queueInLoop([this]()
+                                           { client_.connect(); });
+        }
+
+        HttpResponse resp(true);
+        resp.setStatusMessage("connection closed");
+        for (const PendingRequest &pending : failed)
+        {
+            deliver(pending.cb, resp);
         }
-        // 清空请求队列
-        // requests_.clear();
     }
-    else
+}
+
+void HttpClient::onConnectFailed()
+{
+    std::deque<PendingRequest> failed;
     {
-        connected_ = false;
+        std::lock_guard<std::mutex> lock(mutex_);
         isConnecting_ = false;
+        failed.swap(requests_);
+    }
+    LOG_ERROR("HttpClient::onConnectFailed - %s, %zu requests failed",
+              client_.name().c_str(), failed.size());
+    HttpResponse resp(true);
+    resp.setStatusMessage("connect failed");
+    for (const PendingRequest &pending : failed)
+    {
+        deliver(pending.cb, resp);
     }
 }
 
 void HttpClient::onMessage(const TcpConnectionPtr &conn, Buffer *buffer, Timestamp receiveTime)
 {
     handleResponse(conn, buffer, receiveTime);
-    // 判断是否还有请求
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (!requests_.empty())
-    {
-        HttpRequest req = requests_.front();
-        requests_.pop();
-        sendRequest(req, httpResponseCallback_);
-    }
 }
 
 void HttpClient::handleResponse(const TcpConnectionPtr &conn, Buffer *buffer, Timestamp receiveTime)
 {
-    // HttpContext *context = boost::any_cast<HttpContext>(conn->getMutableContext());
-    HttpContext *context = new HttpContext();
-    // 解析HTTP响应
-    if (context->parseResponse(buffer, receiveTime))
+    HttpContext *context = conn->context().get<HttpContext>();
+    while (context != nullptr && buffer->readableBytes() > 0)
     {
-        if (context->gotAll())
+        if (context->expectRequestLine())
+        {
+            // 新响应开始, 按它对应的请求设置: HEAD没有body, 请求可能要求边收边交付body
+            std::lock_guard<std::mutex> lock(mutex_);
+            bool known = !inflight_.empty();
+            context->setExpectNoBody(known && inflight_.front().head);
+            context->setBodyCallback(known ? inflight_.front().onBody : HttpBodyCallback());
+        }
+        // 解析HTTP响应
+        if (!context->parseResponse(buffer, receiveTime))
+        {
+            LOG_ERROR("HttpClient::handleResponse - failed to parse response");
+            conn->shutdown();
+            return;
+        }
+        if (!context->gotAll())
         {
-            // 调用用户设置的回调函数
-            if (httpResponseCallback_)
+            break;
+        }
+
+        HttpResponse response = context->response();
+        // 重置上下文以准备下一次解析
+        context->reset();
+
+        HttpResponseCallback cb;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (inflight_.empty())
             {
-                // 注意：由于当前HttpContext的设计限制，我们无法直接获取HttpResponse对象
-                // 这里需要创建一个临时的HttpResponse对象
-                HttpResponse response = context->response(); // 假设连接关闭
-                HttpResponse resp = response;
-                // 实际应用中应该从context中提取响应信息设置到response对象中
-                // 是否使用线程池
-                if (useThreadPool_)
-                {
-                    threadPool_.submit(
-                        std::bind(httpResponseCallback_, resp));
-                    // LOG_WARN("线程池线程数量 %d, 任务数量 %d", threadPool_.threadsNum(), threadPool_.tasksNum());
-                }
-                else
-                {
-                    httpResponseCallback_(response);
-                }
-                // httpResponseCallback_(response);
+                LOG_ERROR("HttpClient::handleResponse - response without request");
+                conn->shutdown();
+                return;
+            }
+            cb = std::move(inflight_.front().cb);
+            inflight_.pop_front();
+            if (response.closeConnection())
+            {
+                // 后面已经发出去的请求等连接关闭后重发
+                peerClosing_ = true;
             }
-
-            // 重置上下文以准备下一次解析
-            context->reset();
         }
+        deliver(cb, response);
     }
-    else
-    {
-        LOG_ERROR("HttpClient::handleResponse - failed to parse response");
-        conn->shutdown();
-    }
-}
\ No newline at end of file
+
+    // 这次读到的响应都处理完再补发, 空出来的位置一次填满
+    std::lock_guard<std::mutex> lock(mutex_);
+    sendNextLocked();
+}
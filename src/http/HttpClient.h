@@ -3,7 +3,8 @@
 #include "../TcpClient.h"
 #include "ThreadPool.h"
 
-#include <queue>
+#include <deque>
+#include <future>
 
 class HttpRequest;
 class HttpResponse;
@@ -17,6 +18,8 @@ class HttpClient : noncopyable
 {
 public:
     using HttpResponseCallback = std::function<void(const HttpResponse &)>;
+    // 响应body到达一段就调用一次, data只在回调期间有效
+    using HttpBodyCallback = std::function<void(const char *data, size_t len)>;
 
     HttpClient(EventLoop *loop,
                const InetAddress &listenAddr,
@@ -27,12 +30,29 @@ public:
 
     EventLoop *getLoop() const { return client_.getLoop(); }
 
+    /// Default completion of get() and post().
     /// Not thread safe, callback be registered before calling start().
     void setHttpCallback(const HttpResponseCallback &cb)
     {
         httpResponseCallback_ = cb;
     }
 
+    // 每个连接上最多同时在途的请求数, 默认1即不开流水线
+    // 大于1时排队的请求拼在一个Buffer里一起发出, 响应按发送顺序对应
+    // 非幂等请求(POST)只在连接空闲时单独发送, 后面也不跟其他请求
+    void setPipelineDepth(int depth)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pipelineDepth_ = depth < 1 ? 1 : depth;
+    }
+
+    // 连接超时和重试次数, 见Connector; 放弃连接时排队的请求都以kUnknown结束
+    // 默认不超时, 一直重试. 在发送请求之前设置
+    void setConnectTimeout(double seconds) { client_.setConnectTimeout(seconds); }
+    void setMaxConnectRetries(int retries) { client_.setMaxConnectRetries(retries); }
+    // 和其他客户端共用的重试预算, 见Connector::setRetryBudget
+    void setRetryBudget(const RetryBudgetPtr &budget) { client_.setRetryBudget(budget); }
+
     void connect();
 
     void disconnect();
@@ -47,9 +67,18 @@ public:
               const std::string &body,
               const std::string &contentType);
 
-    // 发送HTTP请求
+    // 发送HTTP请求, 线程安全, 每个请求带自己的回调, 按发送顺序和响应对应
+    // 连接在响应到达前断开时, 幂等请求(GET/HEAD/PUT/DELETE)换一个新连接重发一次,
+    // 其他请求的回调收到statusCode()为kUnknown的响应
     void sendRequest(const HttpRequest &req, const HttpResponseCallback &cb);
 
+    // 同上, 响应body不攒在HttpResponse里, 边收边交给onBody(在loop线程调用), 适合大文件下载;
+    // cb收到的响应只有状态行和头部. body已经开始交付的请求断线后不会重发
+    void sendRequest(const HttpRequest &req, const HttpResponseCallback &cb, const HttpBodyCallback &onBody);
+
+    // 同上, 用future取结果; 不要在loop线程里等待它
+    std::future<HttpResponse> sendRequest(const HttpRequest &req);
+
     void handleResponse(const TcpConnectionPtr &conn, Buffer *buffer, Timestamp receiveTime);
 
     ThreadPool &getThreadPool()
@@ -58,7 +87,24 @@ public:
     }
 
 private:
+    static const int kMaxReplays = 1;
+
+    struct PendingRequest
+    {
+        std::string wire; // 序列化好的请求, 留着断线重发
+        HttpResponseCallback cb;
+        bool idempotent;
+        bool head; // HEAD请求的响应没有body
+        HttpBodyCallback onBody;
+        int replays;
+    };
+
+    // 调用时持有mutex_
+    void sendNextLocked();
+    void deliver(const HttpResponseCallback &cb, const HttpResponse &resp);
+
     void onConnection(const TcpConnectionPtr &conn);
+    void onConnectFailed();
     void onMessage(const TcpConnectionPtr &conn,
                    Buffer *buf,
                    Timestamp receiveTime);
@@ -67,8 +113,12 @@ private:
     HttpResponseCallback httpResponseCallback_;
     bool connected_;
     bool isConnecting_;
-    // std::vector<HttpRequest> requests_;
-    std::queue<HttpRequest> requests_;
+    // 以下由mutex_保护
+    std::deque<PendingRequest> requests_; // 还没发出去的请求
+    std::deque<PendingRequest> inflight_; // 已发出等待响应的请求, 响应按这个顺序返回
+    int pipelineDepth_;
+    bool peerClosing_;      // 服务端声明了Connection: close, 这个连接上不再发新请求
+    bool userDisconnected_; // 用户主动断开, 不再自动重连
     std::mutex mutex_;
     bool useThreadPool_;
     int maxThreadPoolSize_;
@@ -0,0 +1,433 @@
+#include "HttpClientPool.h"
+
+#include "../Buffer.h"
+#include "../Connector.h"
+#include "../EventLoop.h"
+#include "../EventLoopThreadPool.h"
+#include "../Logger.h"
+#include "../SocketsOps.h"
+#include "../TcpConnection.h"
+#include "HttpContext.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <future>
+
+struct HttpClientPool::Host
+{
+  explicit Host(const InetAddress &upstream)
+      : addr(upstream),
+        connecting(0)
+  {
+  }
+
+  const InetAddress addr;
+  std::mutex mutex;
+  // every connection that is connecting, open or being evicted,
+  // a connection leaves the list only in onClose() or the pool's dtor
+  std::vector<ConnectionPtr> connections;
+  int connecting;
+  std::deque<PendingRequest> waiting;
+};
+
+struct HttpClientPool::Connection
+{
+  Connection(Host *h, EventLoop *l)
+      : host(h),
+        loop(l),
+        connected(false),
+        evicting(false),
+        inflightHead(false)
+  {
+  }
+
+  Host *const host;
+  EventLoop *const loop;
+  ConnectorPtr connector;
+  // guarded by host->mutex
+  TcpConnectionPtr conn;
+  bool connected;
+  bool evicting;
+  std::deque<ResponseCallback> inflight; // responses arrive in this order
+  bool inflightHead;                     // inflight.front() is a HEAD request
+  BodyCallback inflightBody;             // of inflight.front()
+  Timestamp lastActive;
+  // loop thread only
+  HttpContext context;
+};
+
+HttpClientPool::HttpClientPool(EventLoop *loop, const std::string &name)
+    : loop_(loop),
+      name_(name),
+      maxConnectionsPerHost_(8),
+      idleTimeout_(60.0),
+      connectTimeout_(5.0),
+      maxConnectRetries_(3),
+      retryBudget_(std::make_shared<RetryBudget>(10, 1)),
+      connectionCount_(0),
+      nextConnId_(0),
+      connNamePrefix_(std::make_shared<const std::string>(name)),
+      threadPool_(new EventLoopThreadPool(loop, name)),
+      nextLoop_(0)
+{
+}
+
+HttpClientPool::~HttpClientPool()
+{
+  loop_->cancel(idleTimer_);
+  // connections must be torn down in their own loop, before the IO threads exit
+  for (EventLoop *ioLoop : loops_)
+  {
+    if (ioLoop == loop_)
+    {
+      destroyConnectionsInLoop(ioLoop);
+    }
+    else
+    {
+      std::promise<void> done;
+      ioLoop->runInLoop([this, ioLoop, &done]()
+                        {
+                          destroyConnectionsInLoop(ioLoop);
+                          done.set_value(); });
+      done.get_future().wait();
+    }
+  }
+}
+
+void HttpClientPool::setThreadNum(int numThreads)
+{
+  threadPool_->setThreadNum(numThreads);
+}
+
+void HttpClientPool::start()
+{
+  threadPool_->start();
+  loops_ = threadPool_->getAllLoops();
+  if (idleTimeout_ > 0)
+  {
+    idleTimer_ = loop_->runAfter(std::min(idleTimeout_, 1.0), [this]()
+                                 { evictIdle(); });
+  }
+}
+
+void HttpClientPool::send(const InetAddress &upstream, const HttpRequest &req, const ResponseCallback &cb)
+{
+  send(upstream, req, cb, BodyCallback());
+}
+
+void HttpClientPool::send(const InetAddress &upstream, const HttpRequest &req, const ResponseCallback &cb,
+                          const BodyCallback &onBody)
+{
+  assert(!loops_.empty());
+  PendingRequest pending;
+  Buffer buf;
+  req.appendToBuffer(&buf);
+  pending.wire = buf.retrieveAllAsString();
+  pending.cb = cb;
+  pending.head = req.method() == HttpRequest::kHead;
+  pending.onBody = onBody;
+
+  Host *host = getHost(upstream);
+  std::lock_guard<std::mutex> lock(host->mutex);
+  host->waiting.push_back(std::move(pending));
+
+  Connection *best = nullptr;
+  for (const ConnectionPtr &c : host->connections)
+  {
+    if (c->connected && !c->evicting &&
+        (best == nullptr || c->inflight.size() < best->inflight.size()))
+    {
+      best = c.get();
+    }
+  }
+  if (best != nullptr && best->inflight.empty())
+  {
+    dispatch(host, best);
+  }
+  else if (host->waiting.size() > static_cast<size_t>(host->connecting) &&
+           host->connections.size() < static_cast<size_t>(maxConnectionsPerHost_))
+  {
+    openConnection(host);
+  }
+}
+
+HttpClientPool::Host *HttpClientPool::getHost(const InetAddress &upstream)
+{
+  std::string key = upstream.toIpPort();
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<Host> &host = hosts_[key];
+  if (!host)
+  {
+    host.reset(new Host(upstream));
+  }
+  return host.get();
+}
+
+void HttpClientPool::openConnection(Host *host)
+{
+  EventLoop *ioLoop = loops_[nextLoop_++ % loops_.size()];
+  ConnectionPtr c = std::make_shared<Connection>(host, ioLoop);
+  c->connector = std::make_shared<Connector>(ioLoop, host->addr);
+  // the Connection owns the Connector, so the Connector must not own it back
+  std::weak_ptr<Connection> weak(c);
+  c->connector->setNewConnectionCallback([this, weak](int sockfd)
+                                         {
+                                           ConnectionPtr c = weak.lock();
+                                           if (c)
+                                           {
+                                             onConnected(c, sockfd);
+                                           }
+                                           else
+                                           {
+                                             sockets::close(sockfd);
+                                           } });
+  c->connector->setConnectFailedCallback([this, weak]()
+                                         {
+                                           ConnectionPtr c = weak.lock();
+                                           if (c)
+                                           {
+                                             onConnectFailed(c);
+                                           } });
+  c->connector->setConnectTimeout(connectTimeout_);
+  c->connector->setMaxRetries(maxConnectRetries_);
+  c->connector->setRetryBudget(retryBudget_);
+  host->connections.push_back(c);
+  ++host->connecting;
+  ++connectionCount_;
+  c->connector->start();
+}
+
+void HttpClientPool::dispatch(Host *host, Connection *c)
+{
+  if (c->connected && !c->evicting && c->inflight.empty() && !host->waiting.empty())
+  {
+    PendingRequest &pending = host->waiting.front();
+    c->inflight.push_back(std::move(pending.cb));
+    c->inflightHead = pending.head;
+    c->inflightBody = std::move(pending.onBody);
+    c->conn->send(std::move(pending.wire));
+    host->waiting.pop_front();
+  }
+}
+
+void HttpClientPool::onConnected(const ConnectionPtr &c, int sockfd)
+{
+  InetAddress peerAddr(sockets::getPeerAddr(sockfd));
+  InetAddress localAddr(sockets::getLocalAddr(sockfd));
+  TcpConnectionPtr conn = std::make_shared<TcpConnection>(c->loop, connNamePrefix_, ++nextConnId_,
+                                                          sockfd, localAddr, peerAddr);
+  // the callbacks keep the Connection alive until the TcpConnection is destroyed,
+  // onClose() drops c->conn to break the cycle
+  conn->setConnectionCallback([](const TcpConnectionPtr &) {});
+  conn->setMessageCallback([this, c](const TcpConnectionPtr &, Buffer *buf, Timestamp receiveTime)
+                           { onMessage(c, buf, receiveTime); });
+  conn->setCloseCallback([this, c](const TcpConnectionPtr &)
+                         { onClose(c); });
+  conn->connectEstablished();
+
+  Host *host = c->host;
+  std::lock_guard<std::mutex> lock(host->mutex);
+  --host->connecting;
+  c->conn = conn;
+  c->connected = true;
+  c->lastActive = Timestamp::now();
+  dispatch(host, c.get());
+}
+
+void HttpClientPool::onConnectFailed(const ConnectionPtr &c)
+{
+  Host *host = c->host;
+  std::deque<PendingRequest> failed;
+  {
+    std::lock_guard<std::mutex> lock(host->mutex);
+    auto it = std::find(host->connections.begin(), host->connections.end(), c);
+    if (it == host->connections.end())
+    {
+      return;
+    }
+    host->connections.erase(it);
+    --host->connecting;
+    --connectionCount_;
+    // other connections keep serving the queue, fail it only when none is left
+    if (host->connections.empty())
+    {
+      failed.swap(host->waiting);
+    }
+  }
+  LOG_ERROR("HttpClientPool::onConnectFailed [%s] - cannot connect to %s, %zu requests failed",
+            name_.c_str(), host->addr.toIpPort().c_str(), failed.size());
+
+  HttpResponse lost(true);
+  lost.setStatusMessage("connect failed");
+  for (const PendingRequest &pending : failed)
+  {
+    if (pending.cb)
+    {
+      pending.cb(lost);
+    }
+  }
+}
+
+void HttpClientPool::onMessage(const ConnectionPtr &c, Buffer *buf, Timestamp receiveTime)
+{
+  while (buf->readableBytes() > 0)
+  {
+    if (c->context.expectRequestLine())
+    {
+      // a new response starts, dispatch() may run on another thread
+      std::lock_guard<std::mutex> lock(c->host->mutex);
+      bool known = !c->inflight.empty();
+      c->context.setExpectNoBody(known && c->inflightHead);
+      c->context.setBodyCallback(known ? c->inflightBody : BodyCallback());
+    }
+    if (!c->context.parseResponse(buf, receiveTime))
+    {
+      LOG_ERROR("HttpClientPool::onMessage [%s] - bad response from %s",
+                name_.c_str(), c->host->addr.toIpPort().c_str());
+      c->conn->forceClose();
+      return;
+    }
+    if (!c->context.gotAll())
+    {
+      break;
+    }
+    HttpResponse response = c->context.response();
+    c->context.reset();
+
+    ResponseCallback cb;
+    {
+      std::lock_guard<std::mutex> lock(c->host->mutex);
+      if (c->inflight.empty())
+      {
+        LOG_ERROR("HttpClientPool::onMessage [%s] - unsolicited response from %s",
+                  name_.c_str(), c->host->addr.toIpPort().c_str());
+        c->conn->forceClose();
+        return;
+      }
+      cb = std::move(c->inflight.front());
+      c->inflight.pop_front();
+      c->lastActive = receiveTime;
+      if (response.closeConnection())
+      {
+        // the upstream closes after this response, onClose() cleans up
+        c->evicting = true;
+      }
+      dispatch(c->host, c.get());
+    }
+    if (cb)
+    {
+      cb(response);
+    }
+  }
+}
+
+void HttpClientPool::onClose(const ConnectionPtr &c)
+{
+  Host *host = c->host;
+  std::deque<ResponseCallback> failed;
+  TcpConnectionPtr conn;
+  {
+    std::lock_guard<std::mutex> lock(host->mutex);
+    c->connected = false;
+    failed.swap(c->inflight);
+    conn.swap(c->conn);
+    host->connections.erase(std::find(host->connections.begin(), host->connections.end(), c));
+    --connectionCount_;
+    // requests still waiting need somewhere to go
+    if (host->waiting.size() > static_cast<size_t>(host->connecting) &&
+        host->connections.size() < static_cast<size_t>(maxConnectionsPerHost_))
+    {
+      openConnection(host);
+    }
+  }
+  c->loop->queueInLoop([conn]()
+                       { conn->connectDestroyed(); });
+
+  // a body delimited by connection close is complete now
+  if (!failed.empty() && c->context.finishResponseOnClose())
+  {
+    HttpResponse response = c->context.response();
+    c->context.reset();
+    if (failed.front())
+    {
+      failed.front()(response);
+    }
+    failed.pop_front();
+  }
+
+  HttpResponse lost(true);
+  lost.setStatusMessage("connection closed");
+  for (const ResponseCallback &cb : failed)
+  {
+    if (cb)
+    {
+      cb(lost);
+    }
+  }
+}
+
+void HttpClientPool::evictIdle()
+{
+  Timestamp now = Timestamp::now();
+  std::vector<TcpConnectionPtr> idle;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : hosts_)
+    {
+      Host *host = entry.second.get();
+      std::lock_guard<std::mutex> hostLock(host->mutex);
+      for (const ConnectionPtr &c : host->connections)
+      {
+        if (c->connected && !c->evicting && c->inflight.empty() &&
+            now.microSecondsSinceEpoch() - c->lastActive.microSecondsSinceEpoch() >
+                static_cast<int64_t>(idleTimeout_ * Timestamp::kMicroSecondsPerSecond))
+        {
+          // no new requests from now on, onClose() removes it once the upstream closes too
+          c->evicting = true;
+          idle.push_back(c->conn);
+        }
+      }
+    }
+  }
+  for (const TcpConnectionPtr &conn : idle)
+  {
+    LOG_INFO("HttpClientPool::evictIdle [%s] - close idle connection %s",
+             name_.c_str(), conn->name().c_str());
+    conn->shutdown();
+  }
+  idleTimer_ = loop_->runAfter(std::min(idleTimeout_, 1.0), [this]()
+                               { evictIdle(); });
+}
+
+void HttpClientPool::destroyConnectionsInLoop(EventLoop *ioLoop)
+{
+  std::vector<ConnectionPtr> owned;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : hosts_)
+    {
+      Host *host = entry.second.get();
+      std::lock_guard<std::mutex> hostLock(host->mutex);
+      auto it = std::partition(host->connections.begin(), host->connections.end(),
+                               [ioLoop](const ConnectionPtr &c)
+                               { return c->loop != ioLoop; });
+      owned.insert(owned.end(), it, host->connections.end());
+      host->connections.erase(it, host->connections.end());
+    }
+  }
+  for (const ConnectionPtr &c : owned)
+  {
+    if (c->conn)
+    {
+      c->conn->connectDestroyed();
+      c->conn.reset();
+    }
+    else
+    {
+      c->connector->stop();
+    }
+    c->inflight.clear();
+  }
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "../Callback.h"
+#include "../InetAddress.h"
+#include "../TimerId.h"
+#include "../noncopyable.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class EventLoop;
+class EventLoopThreadPool;
+class HttpRequest;
+class HttpResponse;
+class RetryBudget;
+typedef std::shared_ptr<RetryBudget> RetryBudgetPtr;
+
+/// A pooled HTTP/1.1 client. Every upstream address gets its own set of
+/// keep-alive connections, spread round-robin over the IO threads.
+/// A request goes to the least busy open connection; a new connection is
+/// opened while the host is below its limit, otherwise the request waits in
+/// the host's queue until a connection frees up.
+///
+/// Each connection carries one request at a time. Requests still queued or
+/// in flight when the pool is destroyed are dropped without a callback.
+class HttpClientPool : noncopyable
+{
+public:
+  typedef std::function<void(const HttpResponse &)> ResponseCallback;
+  /// Receives response body bytes as they arrive; data is only valid during the call.
+  typedef std::function<void(const char *data, size_t len)> BodyCallback;
+
+  HttpClientPool(EventLoop *loop, const std::string &name);
+  ~HttpClientPool(); // must be destroyed in loop thread
+
+  /// Number of IO threads, 0 means all connections live in loop.
+  /// Not thread safe, call before start().
+  void setThreadNum(int numThreads);
+
+  /// Upper bound of open connections to one upstream, default 8.
+  /// Not thread safe, call before start().
+  void setMaxConnectionsPerHost(int n)
+  {
+    maxConnectionsPerHost_ = n;
+  }
+
+  /// Keep-alive connections idle for longer than this are closed,
+  /// default 60 seconds, 0 disables eviction.
+  /// Not thread safe, call before start().
+  void setIdleTimeout(double seconds)
+  {
+    idleTimeout_ = seconds;
+  }
+
+  /// Connect timeout and retries of each new connection, see Connector.
+  /// Defaults are 5 seconds and 3 retries. When a host has no connection
+  /// left after one gives up, its queued requests fail with kUnknown.
+  /// Not thread safe, call before start().
+  void setConnectTimeout(double seconds)
+  {
+    connectTimeout_ = seconds;
+  }
+
+  void setMaxConnectRetries(int retries)
+  {
+    maxConnectRetries_ = retries;
+  }
+
+  /// Retries of all connections together, see Connector::setRetryBudget().
+  /// Defaults to a budget of 10 retries refilled at 1 per second, so a down
+  /// upstream fails queued requests quickly instead of every connection
+  /// retrying on its own. Null disables it. Not thread safe, call before start().
+  void setRetryBudget(const RetryBudgetPtr &budget)
+  {
+    retryBudget_ = budget;
+  }
+
+  void start();
+
+  /// Thread safe. cb runs in the IO thread of the connection that carried
+  /// the request. If the connection is lost before the full response
+  /// arrives, cb gets a response with statusCode() == kUnknown.
+  void send(const InetAddress &upstream, const HttpRequest &req, const ResponseCallback &cb);
+
+  /// Same, but the response body is streamed to onBody in the IO thread as it
+  /// arrives instead of being accumulated, e.g. for large downloads. cb then
+  /// gets the status line and headers only.
+  void send(const InetAddress &upstream, const HttpRequest &req, const ResponseCallback &cb,
+            const BodyCallback &onBody);
+
+  /// Open connections over all upstreams, thread safe.
+  size_t connectionCount() const
+  {
+    return connectionCount_;
+  }
+
+private:
+  struct PendingRequest
+  {
+    std::string wire; // serialized request
+    ResponseCallback cb;
+    bool head; // the response to HEAD has no body
+    BodyCallback onBody;
+  };
+  struct Host;
+  struct Connection;
+  typedef std::shared_ptr<Connection> ConnectionPtr;
+
+  Host *getHost(const InetAddress &upstream);
+  // with host->mutex held
+  void openConnection(Host *host);
+  void dispatch(Host *host, Connection *c);
+
+  void onConnected(const ConnectionPtr &c, int sockfd);
+  void onConnectFailed(const ConnectionPtr &c);
+  void onMessage(const ConnectionPtr &c, Buffer *buf, Timestamp receiveTime);
+  void onClose(const ConnectionPtr &c);
+  void evictIdle();
+  void destroyConnectionsInLoop(EventLoop *ioLoop);
+
+  EventLoop *loop_;
+  const std::string name_;
+  int maxConnectionsPerHost_;
+  double idleTimeout_;
+  double connectTimeout_;
+  int maxConnectRetries_;
+  RetryBudgetPtr retryBudget_;
+  TimerId idleTimer_;
+  std::atomic<size_t> connectionCount_;
+  std::atomic<uint64_t> nextConnId_;
+  std::shared_ptr<const std::string> connNamePrefix_;
+
+  std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<Host>> hosts_; // hosts are never removed
+
+  std::unique_ptr<EventLoopThreadPool> threadPool_;
+  std::vector<EventLoop *> loops_; // fixed after start()
+  std::atomic<size_t> nextLoop_;
+};
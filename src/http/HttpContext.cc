@@ -3,6 +3,11 @@
 #include "../Logger.h"
 #include "HttpContext.h"
 
+#include <algorithm>
+#include <ctype.h>
+#include <stdint.h>
+#include <strings.h>
+
 bool HttpContext::processRequestLine(const char *begin, const char *end)
 {
   bool succeed = false;
@@ -134,115 +139,266 @@ bool HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime)
   return ok;
 }
 
+bool HttpContext::processStatusLine(const char *begin, const char *end)
+{
+  // HTTP/1.x SP 3DIGIT [SP reason-phrase]
+  if (end - begin < 12 || !std::equal(begin, begin + 7, "HTTP/1.") || begin[8] != ' ')
+  {
+    return false;
+  }
+  if (begin[7] != '0' && begin[7] != '1')
+  {
+    return false;
+  }
+  const char *code = begin + 9;
+  if (!isdigit(code[0]) || !isdigit(code[1]) || !isdigit(code[2]) ||
+      (code + 3 != end && code[3] != ' '))
+  {
+    return false;
+  }
+  responseCode_ = (code[0] - '0') * 100 + (code[1] - '0') * 10 + (code[2] - '0');
+  response_.setStatusCode(responseCode_);
+  if (code + 3 != end)
+  {
+    response_.setStatusMessage(string(code + 4, end));
+  }
+  // HTTP/1.0 closes unless the server says keep-alive
+  response_.setCloseConnection(begin[7] == '0');
+  return true;
+}
+
+namespace
+{
+
+  bool fieldIs(const char *begin, const char *colon, const char *name, size_t len)
+  {
+    return static_cast<size_t>(colon - begin) == len && ::strncasecmp(begin, name, len) == 0;
+  }
+
+  // value of a header line with surrounding spaces removed
+  void trimValue(const char *colon, const char *end, const char **valueBegin, const char **valueEnd)
+  {
+    const char *b = colon + 1;
+    while (b < end && isspace(*b))
+    {
+      ++b;
+    }
+    const char *e = end;
+    while (e > b && isspace(*(e - 1)))
+    {
+      --e;
+    }
+    *valueBegin = b;
+    *valueEnd = e;
+  }
+
+} // namespace
+
+bool HttpContext::processResponseHeader(const char *begin, const char *colon, const char *end)
+{
+  const char *value;
+  const char *valueEnd;
+  trimValue(colon, end, &value, &valueEnd);
+  size_t valueLen = valueEnd - value;
+  if (fieldIs(begin, colon, "Content-Length", 14))
+  {
+    if (value == valueEnd)
+    {
+      return false;
+    }
+    int64_t length = 0;
+    for (const char *p = value; p < valueEnd; ++p)
+    {
+      if (!isdigit(*p) || length > (INT64_MAX - 9) / 10)
+      {
+        return false;
+      }
+      length = length * 10 + (*p - '0');
+    }
+    contentLength_ = length;
+  }
+  else if (fieldIs(begin, colon, "Transfer-Encoding", 17))
+  {
+    // chunked is always the last coding when present
+    chunked_ = valueLen >= 7 && ::strncasecmp(valueEnd - 7, "chunked", 7) == 0;
+  }
+  else if (fieldIs(begin, colon, "Connection", 10))
+  {
+    if (valueLen == 5 && ::strncasecmp(value, "close", 5) == 0)
+    {
+      response_.setCloseConnection(true);
+    }
+    else if (valueLen == 10 && ::strncasecmp(value, "keep-alive", 10) == 0)
+    {
+      response_.setCloseConnection(false);
+    }
+  }
+  response_.addHeader(begin, colon, end);
+  return true;
+}
+
+HttpContext::HttpRequestParseState HttpContext::responseBodyState() const
+{
+  // 1xx, 204, 304 and responses to HEAD never have a body
+  if (noBody_ || (responseCode_ >= 100 && responseCode_ < 200) || responseCode_ == 204 || responseCode_ == 304)
+  {
+    return kGotAll;
+  }
+  if (chunked_)
+  {
+    return kExpectChunkSize;
+  }
+  if (contentLength_ >= 0)
+  {
+    return contentLength_ > 0 ? kExpectBody : kGotAll;
+  }
+  return kExpectBodyUntilClose;
+}
+
+bool HttpContext::processChunkSize(const char *begin, const char *end)
+{
+  int64_t size = 0;
+  const char *p = begin;
+  for (; p < end && isxdigit(*p); ++p)
+  {
+    if (size > (INT64_MAX >> 4))
+    {
+      return false;
+    }
+    int digit = isdigit(*p) ? *p - '0' : (tolower(*p) - 'a' + 10);
+    size = (size << 4) | digit;
+  }
+  // chunk extensions after ';' are ignored
+  if (p == begin || (p != end && *p != ';' && !isspace(*p)))
+  {
+    return false;
+  }
+  bodyRemaining_ = size;
+  return true;
+}
+
+void HttpContext::appendResponseBody(const char *data, size_t len)
+{
+  if (bodyCallback_)
+  {
+    bodyCallback_(data, len);
+  }
+  else
+  {
+    response_.appendBody(data, len);
+  }
+}
+
 bool HttpContext::parseResponse(Buffer *buf, Timestamp receiveTime)
 {
   bool ok = true;
   bool hasMore = true;
-
-  // std::vector<char> &buffer = buf->buffer();
-  // Buffer buf1 = *buf;
-  // std::string ss = buf1.retrieveAllAsString();
-  // LOG_INFO("parseResponse: %d", buffer.size());
-  // LOG_INFO("parseResponse: %s", ss.c_str());
-
-  while (hasMore)
+  while (hasMore && ok)
   {
     if (state_ == kExpectRequestLine)
     {
-      // 解析响应行，格式如: HTTP/1.1 200 OK
       const char *crlf = buf->findCRLF();
       if (crlf)
       {
-        const char *start = buf->peek();
-        const char *space1 = std::find(start, crlf, ' ');
-
-        if (space1 != crlf)
+        ok = processStatusLine(buf->peek(), crlf);
+        if (ok)
         {
-          // 解析HTTP版本
-          if (space1 - start == 8 && std::equal(start, start + 5, "HTTP/"))
-          {
-            if (*(start + 5) == '1' && *(start + 6) == '.' && (*(start + 7) == '0' || *(start + 7) == '1'))
-            {
-              // 设置版本信息（这里简化处理，实际应该在HttpResponse中添加版本字段）
-            }
-            else
-            {
-              ok = false;
-              hasMore = false;
-              break;
-            }
-          }
-          else
-          {
-            ok = false;
-            hasMore = false;
-            break;
-          }
-
-          // 解析状态码
-          const char *space2 = std::find(space1 + 1, crlf, ' ');
-          if (space2 != crlf)
-          {
-            // 提取状态码
-            std::string statusCodeStr(space1 + 1, space2);
-            int statusCode = atoi(statusCodeStr.c_str());
-            // 设置状态码
-            response_.setStatusCode(statusCode);
-
-            // 这里应该设置HttpResponse的状态码，但由于当前设计是基于HttpRequest的，
-            // 我们暂时跳过这一步，实际应用中应该有HttpResponse对象来存储这些信息
-
-            // 提取状态消息
-            std::string statusMessage(space2 + 1, crlf);
-
-            buf->retrieveUntil(crlf + 2);
-            state_ = kExpectHeaders;
-          }
-          else
-          {
-            ok = false;
-            hasMore = false;
-          }
+          buf->retrieveUntil(crlf + 2);
+          state_ = kExpectHeaders;
+        }
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (state_ == kExpectHeaders)
+    {
+      const char *crlf = buf->findCRLF();
+      if (crlf)
+      {
+        const char *colon = std::find(buf->peek(), crlf, ':');
+        if (colon != crlf)
+        {
+          ok = processResponseHeader(buf->peek(), colon, crlf);
+        }
+        else if (crlf == buf->peek() && responseCode_ >= 100 && responseCode_ < 200 && responseCode_ != 101)
+        {
+          // interim response (100 Continue, 103 Early Hints...), the final one follows
+          resetResponse();
+        }
+        else if (crlf == buf->peek())
+        {
+          // empty line, end of header
+          state_ = responseBodyState();
+          bodyRemaining_ = contentLength_;
         }
         else
         {
           ok = false;
-          hasMore = false;
         }
+        buf->retrieveUntil(crlf + 2);
       }
       else
       {
         hasMore = false;
       }
     }
-    else if (state_ == kExpectHeaders)
+    else if (state_ == kExpectBody || state_ == kExpectChunkData)
+    {
+      size_t n = std::min(static_cast<int64_t>(buf->readableBytes()), bodyRemaining_);
+      appendResponseBody(buf->peek(), n);
+      buf->retrieve(n);
+      bodyRemaining_ -= n;
+      if (bodyRemaining_ == 0)
+      {
+        state_ = state_ == kExpectBody ? kGotAll : kExpectChunkEnd;
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (state_ == kExpectChunkSize)
+    {
+      const char *crlf = buf->findCRLF();
+      if (crlf)
+      {
+        ok = processChunkSize(buf->peek(), crlf);
+        buf->retrieveUntil(crlf + 2);
+        state_ = bodyRemaining_ > 0 ? kExpectChunkData : kExpectTrailers;
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (state_ == kExpectChunkEnd)
+    {
+      if (buf->readableBytes() >= 2)
+      {
+        ok = buf->peek()[0] == '\r' && buf->peek()[1] == '\n';
+        buf->retrieve(2);
+        state_ = kExpectChunkSize;
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (state_ == kExpectTrailers)
     {
-      // LOG_INFO("kExpectHeaders");
       const char *crlf = buf->findCRLF();
       if (crlf)
       {
         const char *colon = std::find(buf->peek(), crlf, ':');
         if (colon != crlf)
         {
-          // 解析响应头
-          std::string headerName(buf->peek(), colon);
-          std::string headerValue(colon + 1, crlf);
-          // LOG_INFO("headerName: %s, headerValue: %s", headerName.c_str(), headerValue.c_str());
-          response_.addHeader(headerName, headerValue);
+          response_.addHeader(buf->peek(), colon, crlf);
         }
         else
         {
-          // 空行，表示响应头结束
-          // 判断是否有body
-          if (buf->readableBytes() > 0)
-          {
-            state_ = kExpectBody;
-          }
-          else
-          {
-            state_ = kGotAll;
-            hasMore = false;
-          }
+          state_ = kGotAll;
         }
         buf->retrieveUntil(crlf + 2);
       }
@@ -251,33 +407,16 @@ bool HttpContext::parseResponse(Buffer *buf, Timestamp receiveTime)
         hasMore = false;
       }
     }
-    else if (state_ == kExpectBody)
+    else if (state_ == kExpectBodyUntilClose)
+    {
+      appendResponseBody(buf->peek(), buf->readableBytes());
+      buf->retrieveAll();
+      hasMore = false;
+    }
+    else // kGotAll
     {
-      // LOG_INFO("kExpectBody");
-      // 处理响应体（如果需要）
-      // 这里需要根据Content-Length或者Transfer-Encoding来判断body的长度
-      // 由于当前设计限制，我们暂时不处理body
-      // 实际应用中，应该根据Content-Length或Transfer-Encoding来判断body的长度
-      // 并在kExpectBody状态下，根据长度读取body数据
-      // 读取完成后，设置state_为kGotAll
-      // 这里只是简单地假设body为空
-
-      // 找到body结束的位置
-      // const char *crlf = buf->findCRLF();
-      // LOG_INFO("crlf: %s", crlf);
-      // const char *start = buf->peek();
-      // LOG_INFO("body: %d", crlf - start);
-      // if (crlf)
-      // {
-      std::string body = buf->retrieveAllAsString();
-      // const char *start = buf->peek();
-      // LOG_INFO("body: %d", crlf - start);
-      response_.setBody(body);
-      // }
-      state_ = kGotAll;
       hasMore = false;
     }
   }
-
   return ok;
-}
\ No newline at end of file
+}
@@ -3,6 +3,8 @@
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 
+#include <functional>
+
 class Buffer;
 
 class HttpContext
@@ -10,14 +12,30 @@ class HttpContext
 public:
   enum HttpRequestParseState
   {
-    kExpectRequestLine,
+    kExpectRequestLine, // request line, or status line of a response
     kExpectHeaders,
     kExpectBody,
+    // response bodies only
+    kExpectChunkSize,
+    kExpectChunkData,
+    kExpectChunkEnd,
+    kExpectTrailers,
+    kExpectBodyUntilClose,
     kGotAll,
   };
 
+  /// Receives response body bytes as they arrive, instead of the body being
+  /// accumulated in response(). data is only valid during the call.
+  typedef std::function<void(const char *data, size_t len)> BodyCallback;
+
   HttpContext()
-      : state_(kExpectRequestLine)
+      : state_(kExpectRequestLine),
+        parseStartNs_(0),
+        bodyRemaining_(0),
+        responseCode_(0),
+        contentLength_(-1),
+        chunked_(false),
+        noBody_(false)
   {
   }
 
@@ -27,18 +45,65 @@ public:
   bool parseRequest(Buffer *buf, Timestamp receiveTime);
 
   // return false if any error
+  // Incremental: call again with the same buffer as more data arrives.
+  // Consumes exactly one final response, so pipelined responses stay in buf.
+  // Interim 1xx responses other than 101 are skipped.
   bool parseResponse(Buffer *buf, Timestamp receiveTime);
 
+  // The peer closed the connection. Ends a body delimited by connection
+  // close, return true if a complete response is now available.
+  bool finishResponseOnClose()
+  {
+    if (state_ == kExpectBodyUntilClose)
+    {
+      state_ = kGotAll;
+      return true;
+    }
+    return false;
+  }
+
+  // The response being parsed answers a HEAD request: its Content-Length or
+  // Transfer-Encoding describe the body a GET would get, but none follows.
+  // Set before the status line arrives; cleared by reset().
+  void setExpectNoBody(bool on)
+  {
+    noBody_ = on;
+  }
+
+  // kept across reset()
+  void setBodyCallback(const BodyCallback &cb)
+  {
+    bodyCallback_ = cb;
+  }
+
   bool gotAll() const
   {
     return state_ == kGotAll;
   }
 
+  // 还没有收到新请求的任何数据
+  bool expectRequestLine() const
+  {
+    return state_ == kExpectRequestLine;
+  }
+
+  // 只在开启tracing时记录, 用于计算解析耗时
+  void setParseStartNs(int64_t ns)
+  {
+    parseStartNs_ = ns;
+  }
+
+  int64_t parseStartNs() const
+  {
+    return parseStartNs_;
+  }
+
   void reset()
   {
-    state_ = kExpectRequestLine;
     HttpRequest dummy;
     request_.swap(dummy);
+    resetResponse();
+    noBody_ = false;
   }
 
   const HttpRequest &request() const
@@ -63,8 +128,32 @@ public:
 
 private:
   bool processRequestLine(const char *begin, const char *end);
+  bool processStatusLine(const char *begin, const char *end);
+  bool processResponseHeader(const char *begin, const char *colon, const char *end);
+  bool processChunkSize(const char *begin, const char *end);
+  // state after the blank line that ends the headers
+  HttpRequestParseState responseBodyState() const;
+  void appendResponseBody(const char *data, size_t len);
+  // back to kExpectRequestLine for the next (or the final after a 1xx) response
+  void resetResponse()
+  {
+    state_ = kExpectRequestLine;
+    response_ = HttpResponse();
+    bodyRemaining_ = 0;
+    responseCode_ = 0;
+    contentLength_ = -1;
+    chunked_ = false;
+  }
 
   HttpRequestParseState state_;
+  int64_t parseStartNs_;
   HttpRequest request_;
   HttpResponse response_;
+  // response side
+  BodyCallback bodyCallback_;
+  int64_t bodyRemaining_; // of Content-Length, or of the current chunk
+  int responseCode_;
+  int64_t contentLength_; // -1 if absent
+  bool chunked_;
+  bool noBody_; // answers a HEAD request
 };
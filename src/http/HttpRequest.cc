@@ -0,0 +1,29 @@
+#include "HttpRequest.h"
+#include "../Buffer.h"
+
+void HttpRequest::appendToBuffer(Buffer *output) const
+{
+  output->append(methodString());
+  output->append(" ");
+  output->append(path_);
+  output->append(query_);
+  output->append(" HTTP/1.1\r\n");
+
+  for (const auto &header : headers_)
+  {
+    output->append(header.first);
+    output->append(": ");
+    output->append(header.second);
+    output->append("\r\n");
+  }
+
+  if (traced_ && headers_.find("traceparent") == headers_.end())
+  {
+    output->append("traceparent: ");
+    output->append(trace_.child().toTraceparent());
+    output->append("\r\n");
+  }
+
+  output->append("\r\n");
+  output->append(body_);
+}
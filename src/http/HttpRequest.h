@@ -2,11 +2,14 @@
 
 #include "../Timestamp.h"
 #include "../Types.h"
+#include "Trace.h"
 
 #include <map>
 #include <assert.h>
 #include <stdio.h>
 
+class Buffer;
+
 class HttpRequest
 {
 public:
@@ -28,7 +31,8 @@ public:
 
   HttpRequest()
       : method_(kInvalid),
-        version_(kUnknown)
+        version_(kUnknown),
+        traced_(false)
   {
   }
 
@@ -201,14 +205,41 @@ public:
     return headers_;
   }
 
+  /// Set by HttpServer when the request starts or continues a trace, sampled
+  /// or not. Copy it into an outgoing HttpClient request to continue the
+  /// trace upstream.
+  void setTraceContext(const TraceContext &ctx)
+  {
+    trace_ = ctx;
+    traced_ = true;
+  }
+
+  bool traced() const
+  {
+    return traced_;
+  }
+
+  const TraceContext &traceContext() const
+  {
+    return trace_;
+  }
+
+  /// Serialize as an HTTP/1.1 request. The trace context is propagated as a
+  /// child span, flags 00 when unsampled, unless the caller already set
+  /// "traceparent".
+  void appendToBuffer(Buffer *output) const;
+
   void swap(HttpRequest &that)
   {
     std::swap(method_, that.method_);
     std::swap(version_, that.version_);
     path_.swap(that.path_);
     query_.swap(that.query_);
+    body_.swap(that.body_);
     receiveTime_.swap(that.receiveTime_);
     headers_.swap(that.headers_);
+    std::swap(trace_, that.trace_);
+    std::swap(traced_, that.traced_);
   }
 
 private:
@@ -219,4 +250,6 @@ private:
   string body_;
   Timestamp receiveTime_;
   std::map<string, string> headers_;
+  TraceContext trace_;
+  bool traced_;
 };
@@ -2,6 +2,7 @@
 
 #include "../Types.h"
 
+#include <ctype.h>
 #include <map>
 
 class Buffer;
@@ -68,6 +69,11 @@ public:
     statusMessage_ = message;
   }
 
+  const string &statusMessage() const
+  {
+    return statusMessage_;
+  }
+
   void setCloseConnection(bool on)
   {
     closeConnection_ = on;
@@ -89,6 +95,34 @@ public:
     headers_[key] = value;
   }
 
+  /// Header line as received by HttpContext, the value is trimmed in place
+  /// and copied once into the map.
+  void addHeader(const char *start, const char *colon, const char *end)
+  {
+    const char *valueStart = colon + 1;
+    while (valueStart < end && isspace(*valueStart))
+    {
+      ++valueStart;
+    }
+    const char *valueEnd = end;
+    while (valueEnd > valueStart && isspace(*(valueEnd - 1)))
+    {
+      --valueEnd;
+    }
+    headers_[string(start, colon)].assign(valueStart, valueEnd);
+  }
+
+  string getHeader(const string &field) const
+  {
+    string result;
+    std::map<string, string>::const_iterator it = headers_.find(field);
+    if (it != headers_.end())
+    {
+      result = it->second;
+    }
+    return result;
+  }
+
   std::map<string, string> headers() const
   {
     return headers_;
@@ -104,6 +138,11 @@ public:
     return body_;
   }
 
+  void appendBody(const char *data, size_t len)
+  {
+    body_.append(data, len);
+  }
+
   void appendToBuffer(Buffer *output) const;
 
 private:
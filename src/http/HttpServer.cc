@@ -3,13 +3,33 @@
 #include "HttpServer.h"
 
 #include "../Logger.h"
+#include "../Metrics.h"
+#include "../Probes.h"
 #include "HttpContext.h"
 #include "HttpRequest.h"
 #include "HttpResponse.h"
+#include "Trace.h"
+
+#include <string.h>
 
 namespace detail
 {
 
+  Counter &g_requests = MetricsRegistry::instance().counter(
+      "swiftnet_http_requests_total", "Number of http requests handled");
+  Counter &g_badRequests = MetricsRegistry::instance().counter(
+      "swiftnet_http_bad_requests_total", "Number of http requests rejected by the parser");
+
+  void metricsHttpCallback(const HttpRequest &, HttpResponse *resp)
+  {
+    std::string body;
+    MetricsRegistry::instance().writePrometheus(&body);
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain; version=0.0.4; charset=utf-8");
+    resp->setBody(body);
+  }
+
   void defaultHttpCallback(const HttpRequest &, HttpResponse *resp)
   {
     resp->setStatusCode(HttpResponse::k404NotFound);
@@ -24,12 +44,17 @@ HttpServer::HttpServer(EventLoop *loop,
                        const string &name,
                        TcpServer::Option option)
     : server_(loop, listenAddr, name, option),
-      httpCallback_(detail::defaultHttpCallback)
+      httpCallback_(detail::defaultHttpCallback),
+      pipelineCoalescing_(true)
 {
-  server_.setConnectionCallback(
-      std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
-  server_.setMessageCallback(
-      std::bind(&HttpServer::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+  // Lambdas capturing only this fit in std::function's local storage, so
+  // copying them into every TcpConnection does not allocate.
+  server_.setConnectionCallback([this](const TcpConnectionPtr &conn)
+                                { onConnection(conn); });
+  server_.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+                             { onMessage(conn, buf, receiveTime); });
+  server_.setDrainConnectionCallback([this](const TcpConnectionPtr &conn)
+                                     { onDrain(conn); });
 }
 
 void HttpServer::start()
@@ -38,11 +63,27 @@ void HttpServer::start()
   server_.start();
 }
 
+// The parser state lives inside the connection object, no heap allocation.
+static_assert(ConnectionContext::fitsInline<HttpContext>(),
+              "HttpContext outgrew ConnectionContext::kInlineSize");
+
 void HttpServer::onConnection(const TcpConnectionPtr &conn)
 {
   if (conn->connected())
   {
-    conn->setContext(HttpContext());
+    conn->context().emplace<HttpContext>();
+  }
+}
+
+void HttpServer::onDrain(const TcpConnectionPtr &conn)
+{
+  HttpContext *context = conn->context().get<HttpContext>();
+  // no partial request: an idle keep-alive connection, close it now.
+  // A request in progress gets "Connection: close" on its response instead.
+  if (conn->connected() && context != nullptr &&
+      context->expectRequestLine() && conn->inputBuffer()->readableBytes() == 0)
+  {
+    conn->shutdown();
   }
 }
 
@@ -50,35 +91,131 @@ void HttpServer::onMessage(const TcpConnectionPtr &conn,
                            Buffer *buf,
                            Timestamp receiveTime)
 {
-  HttpContext *context = boost::any_cast<HttpContext>(conn->getMutableContext());
+  HttpContext *context = conn->context().get<HttpContext>();
   // Buffer buf1 = *buf;
   // string ss = buf1.retrieveAllAsString();
   // LOG_WARN("HttpServer::onMessage - 收到请求 %s", ss.c_str());
+  bool tracing = Tracer::instance().enabled();
+  // a pipelining client may have sent several requests in one segment
+  while (true)
+  {
+    if (context->expectRequestLine())
+    {
+      SWIFTNET_PROBE1(http_request_start, conn.get());
+      if (tracing)
+      {
+        context->setParseStartNs(monotonicNanos());
+      }
+    }
+
+    if (!context->parseRequest(buf, receiveTime))
+    {
+      detail::g_badRequests.inc();
+      string msg = "HTTP/1.1 400 Bad Request\r\n\r\n";
+      conn->send(msg);
+      conn->shutdown();
+      return;
+    }
+
+    if (!context->gotAll())
+    {
+      break;
+    }
+    if (tracing)
+    {
+      onTracedRequest(conn, context);
+    }
+    else
+    {
+      continueTrace(&context->request());
+      onRequest(conn, context->request(), nullptr);
+    }
+    context->reset();
+
+    // stop after a response that closes the connection
+    if (buf->readableBytes() == 0 || !conn->connected())
+    {
+      break;
+    }
+    // The client pipelines: let the rest of this batch leave in one write
+    // at the end of the loop iteration. The writes are batched already,
+    // so Nagle would only hold them back until the client's delayed ACK.
+    // Only once per connection, setTcpNoDelay() is a syscall.
+    if (pipelineCoalescing_ && !conn->writeCoalescing())
+    {
+      conn->setWriteCoalescing(true);
+      conn->setTcpNoDelay(true);
+    }
+  }
+}
 
-  if (!context->parseRequest(buf, receiveTime))
+void HttpServer::continueTrace(HttpRequest *req)
+{
+  // not tracing ourselves, but an incoming trace is still passed on
+  // upstream with the caller's sampled flag
+  const std::map<string, string> &headers = req->headers();
+  std::map<string, string>::const_iterator it = headers.find("traceparent");
+  TraceContext ctx;
+  if (it != headers.end() && TraceContext::parse(it->second, &ctx))
   {
-    string msg = "HTTP/1.1 400 Bad Request\r\n\r\n";
-    conn->send(msg);
-    conn->shutdown();
+    memcpy(ctx.spanId, ctx.parentSpanId, sizeof ctx.spanId);
+    req->setTraceContext(ctx);
   }
+}
 
-  if (context->gotAll())
+void HttpServer::onTracedRequest(const TcpConnectionPtr &conn, HttpContext *context)
+{
+  HttpRequest &req = context->request();
+  SpanRecord span;
+  bool sampled = Tracer::instance().startSpan(req.getHeader("traceparent"), &span.context);
+  // propagated upstream either way, an unsampled one with flags 00
+  req.setTraceContext(span.context);
+  if (!sampled)
   {
-    onRequest(conn, context->request());
-    context->reset();
+    onRequest(conn, req, nullptr);
+    return;
   }
+  // tracing may have been switched on in the middle of this request
+  int64_t parseNs = context->parseStartNs() > 0 ? monotonicNanos() - context->parseStartNs() : 0;
+  span.parseMicros = parseNs / 1000;
+  span.startMicros = Timestamp::now().microSecondsSinceEpoch() - span.parseMicros;
+  onRequest(conn, req, &span);
 }
 
-void HttpServer::onRequest(const TcpConnectionPtr &conn, const HttpRequest &req)
+void HttpServer::onRequest(const TcpConnectionPtr &conn, const HttpRequest &req, SpanRecord *span)
 {
+  int64_t handlerStart = span ? monotonicNanos() : 0;
   const string &connection = req.getHeader("Connection");
   bool close = connection == "close" ||
-               (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
+               (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive") ||
+               server_.draining();
   HttpResponse response(close);
-  httpCallback_(req, &response);
+  detail::g_requests.inc();
+  if (!metricsPath_.empty() && req.path() == metricsPath_)
+  {
+    detail::metricsHttpCallback(req, &response);
+  }
+  else
+  {
+    httpCallback_(req, &response);
+  }
+  int64_t serializeStart = span ? monotonicNanos() : 0;
   Buffer buf;
   response.appendToBuffer(&buf);
+  int64_t flushStart = span ? monotonicNanos() : 0;
   conn->send(&buf);
+  SWIFTNET_PROBE2(http_request_end, conn.get(), static_cast<int>(response.statusCode()));
+  if (span)
+  {
+    int64_t end = monotonicNanos();
+    span->handlerMicros = (serializeStart - handlerStart) / 1000;
+    span->serializeMicros = (flushStart - serializeStart) / 1000;
+    span->flushMicros = (end - flushStart) / 1000;
+    span->status = static_cast<int>(response.statusCode());
+    span->name.reserve(8 + req.path().size());
+    span->name.append(req.methodString()).append(" ").append(req.path());
+    Tracer::instance().finishSpan(*span);
+  }
   if (response.closeConnection())
   {
     conn->shutdown();
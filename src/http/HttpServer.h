@@ -2,8 +2,10 @@
 
 #include "../TcpServer.h"
 
+class HttpContext;
 class HttpRequest;
 class HttpResponse;
+struct SpanRecord;
 
 /// A simple embeddable HTTP server designed for report status of a program.
 /// It is not a fully HTTP 1.1 compliant server, but provides minimum features
@@ -34,15 +36,55 @@ public:
     server_.setThreadNum(numThreads);
   }
 
+  /// When a client pipelines requests, turn on write coalescing and
+  /// TCP_NODELAY for its connection, so the responses to one batch leave in
+  /// a single write. Done once, at the first pipelined batch, and kept for the
+  /// life of the connection. Default on. Not thread safe, call before start().
+  void setPipelineCoalescing(bool on)
+  {
+    pipelineCoalescing_ = on;
+  }
+
+  /// Serve all registered metrics in Prometheus text format on the given path,
+  /// e.g. "/metrics". Empty path disables it. Not thread safe, call before start().
+  void setMetricsPath(const std::string &path)
+  {
+    metricsPath_ = path;
+  }
+
   void start();
 
+  /// Graceful shutdown, see TcpServer::drain(). Idle keep-alive connections
+  /// are closed at once; responses sent while draining carry "Connection: close".
+  void drain(double timeoutSeconds, const TcpServer::DrainCallback &cb)
+  {
+    server_.drain(timeoutSeconds, cb);
+  }
+
+  void stopAccepting()
+  {
+    server_.stopAccepting();
+  }
+
+  /// See TcpServer::setListenerHandedOver().
+  void setListenerHandedOver()
+  {
+    server_.setListenerHandedOver();
+  }
+
 private:
   void onConnection(const TcpConnectionPtr &conn);
+  void onDrain(const TcpConnectionPtr &conn);
   void onMessage(const TcpConnectionPtr &conn,
                  Buffer *buf,
                  Timestamp receiveTime);
-  void onRequest(const TcpConnectionPtr &, const HttpRequest &);
+  void onTracedRequest(const TcpConnectionPtr &conn, HttpContext *context);
+  static void continueTrace(HttpRequest *req);
+  // span is null unless the request is sampled by Tracer
+  void onRequest(const TcpConnectionPtr &, const HttpRequest &, SpanRecord *span);
 
   TcpServer server_;
   HttpCallback httpCallback_;
+  std::string metricsPath_;
+  bool pipelineCoalescing_;
 };
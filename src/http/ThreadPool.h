@@ -10,6 +10,7 @@
 #include <thread>
 #include <unordered_map>
 #include "../Logger.h"
+#include "../Metrics.h"
 using namespace std;
 
 class ThreadPool
@@ -103,11 +104,14 @@ public:
             // 丢弃策略：直接丢弃新提交的任务
             // std::cout << "[INFO] task queue is full, drop new task" << std::endl;
             LOG_ERROR("task queue is full, drop new task");
+            droppedCounter().inc();
             return result;
         }
 
         tasks_.emplace([task]()
                        { (*task)(); });
+        submittedCounter().inc();
+        queueDepthGauge().inc();
 
         if (idleThreads_ > 0)
         {
@@ -152,6 +156,28 @@ public:
     }
 
 private:
+    // 所有ThreadPool实例共享同一组指标
+    static Counter &submittedCounter()
+    {
+        static Counter &counter = MetricsRegistry::instance().counter(
+            "swiftnet_threadpool_tasks_submitted_total", "Number of tasks accepted by thread pools");
+        return counter;
+    }
+
+    static Counter &droppedCounter()
+    {
+        static Counter &counter = MetricsRegistry::instance().counter(
+            "swiftnet_threadpool_tasks_dropped_total", "Number of tasks dropped because the queue was full");
+        return counter;
+    }
+
+    static Gauge &queueDepthGauge()
+    {
+        static Gauge &gauge = MetricsRegistry::instance().gauge(
+            "swiftnet_threadpool_queue_depth", "Number of tasks waiting in thread pool queues");
+        return gauge;
+    }
+
     void worker()
     {
         while (true)
@@ -184,6 +210,7 @@ private:
                 }
                 task = std::move(tasks_.front());
                 tasks_.pop();
+                queueDepthGauge().dec();
             }
             task();
         }
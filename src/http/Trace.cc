@@ -0,0 +1,249 @@
+#include "Trace.h"
+#include "../CurrentThread.h"
+#include "../Timestamp.h"
+
+#include <string.h>
+
+namespace
+{
+  const char kHexDigits[] = "0123456789abcdef";
+
+  // xorshift64*, one generator per thread
+  __thread uint64_t t_randomState = 0;
+
+  uint64_t nextRandom()
+  {
+    if (t_randomState == 0)
+    {
+      t_randomState = static_cast<uint64_t>(monotonicNanos()) ^
+                      (static_cast<uint64_t>(CurrentThread::tid()) << 32) ^
+                      0x9E3779B97F4A7C15ULL;
+    }
+    t_randomState ^= t_randomState >> 12;
+    t_randomState ^= t_randomState << 25;
+    t_randomState ^= t_randomState >> 27;
+    return t_randomState * 0x2545F4914F6CDD1DULL;
+  }
+
+  void randomBytes(uint8_t *out, size_t len)
+  {
+    while (len > 0)
+    {
+      uint64_t r = nextRandom();
+      size_t n = len < sizeof r ? len : sizeof r;
+      memcpy(out, &r, n);
+      out += n;
+      len -= n;
+    }
+  }
+
+  bool allZero(const uint8_t *bytes, size_t len)
+  {
+    for (size_t i = 0; i < len; ++i)
+    {
+      if (bytes[i] != 0)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  int hexValue(char c)
+  {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    return -1; // upper case is invalid in traceparent
+  }
+
+  bool parseHex(const char *hex, uint8_t *out, size_t len)
+  {
+    for (size_t i = 0; i < len; ++i)
+    {
+      int hi = hexValue(hex[2 * i]);
+      int lo = hexValue(hex[2 * i + 1]);
+      if (hi < 0 || lo < 0)
+      {
+        return false;
+      }
+      out[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    return true;
+  }
+
+  void appendHex(std::string *out, const uint8_t *bytes, size_t len)
+  {
+    for (size_t i = 0; i < len; ++i)
+    {
+      out->push_back(kHexDigits[bytes[i] >> 4]);
+      out->push_back(kHexDigits[bytes[i] & 0x0f]);
+    }
+  }
+
+  void newSpanId(uint8_t *spanId)
+  {
+    do
+    {
+      randomBytes(spanId, 8);
+    } while (allZero(spanId, 8));
+  }
+} // namespace
+
+void TraceContext::memZeroIds()
+{
+  memset(traceId, 0, sizeof traceId);
+  memset(spanId, 0, sizeof spanId);
+  memset(parentSpanId, 0, sizeof parentSpanId);
+}
+
+bool TraceContext::parse(const std::string &traceparent, TraceContext *ctx)
+{
+  // 2 + 1 + 32 + 1 + 16 + 1 + 2, future versions may append fields after a '-'
+  const size_t kLength = 55;
+  if (traceparent.size() < kLength ||
+      (traceparent.size() > kLength && traceparent[kLength] != '-'))
+  {
+    return false;
+  }
+  const char *p = traceparent.data();
+  uint8_t version;
+  if (!parseHex(p, &version, 1) || version == 0xff ||
+      (version == 0 && traceparent.size() != kLength) ||
+      p[2] != '-' || p[35] != '-' || p[52] != '-')
+  {
+    return false;
+  }
+  TraceContext result;
+  if (!parseHex(p + 3, result.traceId, sizeof result.traceId) ||
+      !parseHex(p + 36, result.parentSpanId, sizeof result.parentSpanId) ||
+      !parseHex(p + 53, &result.flags, 1) ||
+      allZero(result.traceId, sizeof result.traceId) ||
+      allZero(result.parentSpanId, sizeof result.parentSpanId))
+  {
+    return false;
+  }
+  result.hasParent = true;
+  *ctx = result;
+  return true;
+}
+
+TraceContext TraceContext::child() const
+{
+  TraceContext result(*this);
+  memcpy(result.parentSpanId, spanId, sizeof spanId);
+  result.hasParent = true;
+  newSpanId(result.spanId);
+  return result;
+}
+
+std::string TraceContext::toTraceparent() const
+{
+  std::string result("00-");
+  result.reserve(55);
+  appendHex(&result, traceId, sizeof traceId);
+  result.push_back('-');
+  appendHex(&result, spanId, sizeof spanId);
+  result.push_back('-');
+  appendHex(&result, &flags, 1);
+  return result;
+}
+
+std::string TraceContext::traceIdHex() const
+{
+  std::string result;
+  appendHex(&result, traceId, sizeof traceId);
+  return result;
+}
+
+std::string TraceContext::spanIdHex() const
+{
+  std::string result;
+  appendHex(&result, spanId, sizeof spanId);
+  return result;
+}
+
+void MemoryTraceSink::exportSpan(const SpanRecord &span)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (spans_.size() >= capacity_)
+  {
+    spans_.pop_front();
+  }
+  spans_.push_back(span);
+}
+
+std::vector<SpanRecord> MemoryTraceSink::spans() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::vector<SpanRecord>(spans_.begin(), spans_.end());
+}
+
+Tracer &Tracer::instance()
+{
+  static Tracer tracer;
+  return tracer;
+}
+
+Tracer::Tracer()
+    : enabled_(false),
+      threshold_(0)
+{
+}
+
+void Tracer::setSampleRatio(double ratio)
+{
+  if (ratio <= 0)
+  {
+    threshold_.store(0, std::memory_order_relaxed);
+    enabled_.store(false, std::memory_order_relaxed);
+    return;
+  }
+  uint64_t threshold = ratio >= 1.0 ? UINT64_MAX
+                                    : static_cast<uint64_t>(ratio * 18446744073709551615.0);
+  threshold_.store(threshold, std::memory_order_relaxed);
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::setSink(const std::shared_ptr<TraceSink> &sink)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  sink_ = sink;
+}
+
+bool Tracer::startSpan(const std::string &traceparent, TraceContext *ctx)
+{
+  bool continued = !traceparent.empty() && TraceContext::parse(traceparent, ctx);
+  if (!continued)
+  {
+    *ctx = TraceContext();
+    do
+    {
+      randomBytes(ctx->traceId, sizeof ctx->traceId);
+    } while (allZero(ctx->traceId, sizeof ctx->traceId));
+  }
+  newSpanId(ctx->spanId);
+
+  if (!(continued && ctx->sampled()))
+  {
+    uint64_t threshold = threshold_.load(std::memory_order_relaxed);
+    bool sampled = threshold == UINT64_MAX || nextRandom() < threshold;
+    ctx->flags = sampled ? static_cast<uint8_t>(ctx->flags | TraceContext::kSampledFlag)
+                         : static_cast<uint8_t>(ctx->flags & ~TraceContext::kSampledFlag);
+  }
+  return ctx->sampled();
+}
+
+void Tracer::finishSpan(const SpanRecord &span)
+{
+  std::shared_ptr<TraceSink> sink;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sink = sink_;
+  }
+  if (sink)
+  {
+    sink->exportSpan(span);
+  }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "../noncopyable.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/// W3C Trace Context, carried in the "traceparent" header:
+///   00-<32 hex trace-id>-<16 hex parent-id>-<2 hex flags>
+struct TraceContext
+{
+  static const uint8_t kSampledFlag = 0x01;
+
+  TraceContext()
+      : flags(0),
+        hasParent(false)
+  {
+    memZeroIds();
+  }
+
+  uint8_t traceId[16];
+  uint8_t spanId[8];       // id of the span this process is running
+  uint8_t parentSpanId[8]; // id from the incoming traceparent, if any
+  uint8_t flags;
+  bool hasParent;
+
+  bool sampled() const { return (flags & kSampledFlag) != 0; }
+
+  /// Parse a traceparent header value, return false if it is malformed.
+  /// On success the parsed parent-id is stored in parentSpanId.
+  static bool parse(const std::string &traceparent, TraceContext *ctx);
+
+  /// Context for an outgoing call: same trace, fresh span id, our span as parent.
+  TraceContext child() const;
+
+  /// Format as a traceparent header value with spanId as the parent-id.
+  std::string toTraceparent() const;
+  std::string traceIdHex() const;
+  std::string spanIdHex() const;
+
+private:
+  void memZeroIds();
+};
+
+/// One finished server span. All durations are in microseconds.
+struct SpanRecord
+{
+  SpanRecord()
+      : startMicros(0),
+        parseMicros(0),
+        handlerMicros(0),
+        serializeMicros(0),
+        flushMicros(0),
+        status(0)
+  {
+  }
+
+  TraceContext context;
+  std::string name; // "GET /path"
+  int64_t startMicros;  // wall clock, microseconds since epoch
+  int64_t parseMicros;
+  int64_t handlerMicros;
+  int64_t serializeMicros;
+  int64_t flushMicros; // time spent handing the response to the socket
+  int status;
+};
+
+/// Receives sampled spans, called in the event loop thread, so keep it cheap.
+class TraceSink
+{
+public:
+  virtual ~TraceSink() = default;
+  virtual void exportSpan(const SpanRecord &span) = 0;
+};
+
+/// Keeps the most recent spans in memory, for debug pages and tests.
+class MemoryTraceSink : public TraceSink
+{
+public:
+  explicit MemoryTraceSink(size_t capacity = 1024)
+      : capacity_(capacity)
+  {
+  }
+
+  void exportSpan(const SpanRecord &span) override;
+  std::vector<SpanRecord> spans() const;
+
+private:
+  const size_t capacity_;
+  mutable std::mutex mutex_;
+  std::deque<SpanRecord> spans_;
+};
+
+/// Process wide sampling decision and sink.
+/// With a sample ratio of 0 (the default) tracing costs one relaxed load per request.
+class Tracer : noncopyable
+{
+public:
+  static Tracer &instance();
+
+  /// ratio in [0, 1]. An incoming sampled traceparent is always honored while ratio > 0.
+  void setSampleRatio(double ratio);
+  void setSink(const std::shared_ptr<TraceSink> &sink);
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  /// Decide whether to sample this request and fill ctx for it,
+  /// continuing the trace in traceparent if it parses. Return ctx->sampled().
+  bool startSpan(const std::string &traceparent, TraceContext *ctx);
+  void finishSpan(const SpanRecord &span);
+
+private:
+  Tracer();
+
+  std::atomic<bool> enabled_;
+  std::atomic<uint64_t> threshold_; // sample if random < threshold_
+  mutable std::mutex mutex_;
+  std::shared_ptr<TraceSink> sink_;
+};
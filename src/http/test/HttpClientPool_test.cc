@@ -0,0 +1,66 @@
+#include <swiftNetCore/http/HttpClientPool.h>
+#include <swiftNetCore/http/HttpRequest.h>
+#include <swiftNetCore/http/HttpResponse.h>
+#include <swiftNetCore/Connector.h>
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/Logger.h>
+
+#include <memory>
+#include <stdio.h>
+#include <unistd.h>
+
+// A pool whose retry budget runs out gives up inside send(): the connector
+// fails synchronously in start() while send() holds the host's mutex. The
+// failure callback must still run outside it, and may send() again.
+// Usage: ./poolfail_test, exits 0 on success
+
+static const char *kMissingPath = "/tmp/swiftnet_poolfail_test.sock";
+static const int kRounds = 5;
+
+static HttpRequest makeGet()
+{
+  HttpRequest req;
+  req.setMethod(HttpRequest::kGet);
+  req.setPath("/");
+  req.setVersion(HttpRequest::kHttp11);
+  return req;
+}
+
+int main()
+{
+  Logger::instance().setMinLogLevel(LogLevel::FATAL);
+  ::unlink(kMissingPath);
+
+  EventLoop loop;
+  InetAddress upstream = InetAddress::fromUnixPath(kMissingPath);
+  HttpClientPool pool(&loop, "poolfail");
+  pool.setRetryBudget(std::make_shared<RetryBudget>(2, 0.001));
+  pool.start();
+
+  int failures = 0;
+  HttpClientPool::ResponseCallback onResponse;
+  onResponse = [&](const HttpResponse &resp)
+  {
+    if (resp.statusCode() == HttpResponse::kUnknown)
+    {
+      ++failures;
+    }
+    if (failures < kRounds)
+    {
+      pool.send(upstream, makeGet(), onResponse);
+    }
+    else
+    {
+      loop.quit();
+    }
+  };
+  pool.send(upstream, makeGet(), onResponse);
+  loop.runAfter(5.0, [&loop]()
+                { loop.quit(); });
+  loop.loop();
+
+  bool ok = failures == kRounds;
+  printf("failures=%d: %s\n", failures, ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
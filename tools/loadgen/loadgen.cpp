@@ -0,0 +1,515 @@
+#include <swiftNetCore/Buffer.h>
+#include <swiftNetCore/EventLoop.h>
+#include <swiftNetCore/EventLoopThreadPool.h>
+#include <swiftNetCore/Histogram.h>
+#include <swiftNetCore/InetAddress.h>
+#include <swiftNetCore/Logger.h>
+#include <swiftNetCore/TcpClient.h>
+#include <swiftNetCore/Timestamp.h>
+#include <swiftNetCore/http/HttpContext.h>
+#include <swiftNetCore/http/HttpRequest.h>
+#include <swiftNetCore/http/HttpResponse.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// 基于本库(EventLoopThreadPool + TcpClient + HttpContext)的压测工具, 类似wrk/wrk2
+//
+// 用法: ./loadgen [选项] host port
+//   -t 线程数      IO线程数, 连接按轮询分到各线程, 默认1
+//   -c 连接数      总连接数, 默认10
+//   -d 秒数        测试时长, 默认10
+//   -R 每秒请求数  总的目标速率, 开环模式; 0(默认)为闭环, 每个连接始终保持-p个请求在途
+//   -p 深度        每个连接最多同时在途的请求数(流水线), 默认1
+//   -m http|echo   协议, 默认http: GET请求; echo: 发-s字节, 等同样字节数回来算一次响应
+//   -P 路径        http请求路径, 默认/
+//   -s 字节数      echo消息大小, 默认64
+//
+// 开环模式下每个请求都有预定的发送时刻, 延迟从预定时刻算起: 服务端卡住时排队等发送的
+// 请求也计入延迟, 不会因为压测端跟着变慢而漏掉(coordinated omission)
+// 闭环模式下延迟从实际发送时刻算起, 只适合测最大吞吐
+
+namespace
+{
+
+struct Options
+{
+    Options()
+        : port(0), threads(1), connections(10), duration(10), rate(0),
+          depth(1), http(true), path("/"), messageSize(64)
+    {
+    }
+
+    std::string host;
+    uint16_t port;
+    int threads;
+    int connections;
+    double duration;
+    double rate;
+    int depth;
+    bool http;
+    std::string path;
+    int messageSize;
+};
+
+// 每个IO线程一份, 只由该线程写入
+struct LoopStats
+{
+    LoopStats() : completed(0), bytesRead(0), errors(0), non2xx(0), unsent(0) {}
+
+    Histogram latency; // 微秒
+    int64_t completed;
+    int64_t bytesRead;
+    int64_t errors;
+    int64_t non2xx;
+    int64_t unsent; // 开环模式下到结束时还没轮到发送的请求, 说明目标速率超过了服务端能力
+};
+
+std::atomic<int> g_connected(0);
+std::atomic<int64_t> g_outstanding(0); // 已排期但还没完成的请求
+
+// 一个连接, 除构造外都在所属loop线程里执行
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const Options &options,
+            const std::string &request, LoopStats *stats, int id)
+        : loop_(loop),
+          client_(loop, serverAddr, "loadgen#" + std::to_string(id)),
+          options_(options),
+          request_(request),
+          stats_(stats),
+          echoReceived_(0),
+          nextNs_(0),
+          intervalNs_(0),
+          endNs_(0),
+          running_(false),
+          everConnected_(false)
+    {
+        client_.setConnectionCallback([this](const TcpConnectionPtr &conn)
+                                      { onConnection(conn); });
+        client_.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                   { onMessage(conn, buf); });
+        client_.enableRetry();
+    }
+
+    void connect() { client_.connect(); }
+
+    // 从startNs开始发送, intervalNs为0时是闭环
+    void begin(int64_t startNs, int64_t intervalNs, int64_t endNs)
+    {
+        nextNs_ = startNs;
+        intervalNs_ = intervalNs;
+        endNs_ = endNs;
+        running_ = true;
+        if (intervalNs_ > 0)
+        {
+            loop_->runAfter(std::max<int64_t>(startNs - monotonicNanos(), 0) / 1e9, [this]()
+                            { tick(); });
+        }
+        else
+        {
+            flush();
+        }
+    }
+
+    // 不再发新请求, 在途的请求继续等响应
+    void finish()
+    {
+        running_ = false;
+        stats_->unsent += backlog_.size();
+        g_outstanding -= backlog_.size();
+        backlog_.clear();
+    }
+
+    // 结束时还没收到响应的请求
+    size_t unfinished() const { return inflight_.size(); }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn_ = conn;
+            conn_->setTcpNoDelay(true);
+            if (!everConnected_)
+            {
+                everConnected_ = true;
+                ++g_connected;
+            }
+            flush();
+        }
+        else
+        {
+            // 在途请求的响应不会来了, 算作错误; TcpClient会自动重连
+            conn_.reset();
+            stats_->errors += inflight_.size();
+            g_outstanding -= inflight_.size();
+            inflight_.clear();
+            context_.reset();
+            echoReceived_ = 0;
+        }
+    }
+
+    void tick()
+    {
+        if (!running_)
+        {
+            return;
+        }
+        int64_t now = monotonicNanos();
+        while (nextNs_ <= now && nextNs_ < endNs_)
+        {
+            backlog_.push_back(nextNs_);
+            ++g_outstanding;
+            nextNs_ += intervalNs_;
+        }
+        flush();
+        if (nextNs_ < endNs_)
+        {
+            loop_->runAfter((nextNs_ - now) / 1e9, [this]()
+                            { tick(); });
+        }
+    }
+
+    // 把能发的请求拼在一起一次发出
+    void flush()
+    {
+        if (!conn_ || !running_)
+        {
+            return;
+        }
+        bool closedLoop = intervalNs_ == 0;
+        while (inflight_.size() < static_cast<size_t>(options_.depth))
+        {
+            int64_t scheduledNs;
+            if (closedLoop)
+            {
+                scheduledNs = monotonicNanos();
+                if (scheduledNs >= endNs_)
+                {
+                    break;
+                }
+                ++g_outstanding;
+            }
+            else if (!backlog_.empty())
+            {
+                scheduledNs = backlog_.front();
+                backlog_.pop_front();
+            }
+            else
+            {
+                break;
+            }
+            inflight_.push_back(scheduledNs);
+            output_.append(request_);
+        }
+        if (output_.readableBytes() > 0)
+        {
+            conn_->send(&output_);
+            output_.retrieveAll();
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf)
+    {
+        stats_->bytesRead += buf->readableBytes();
+        if (options_.http)
+        {
+            while (buf->readableBytes() > 0)
+            {
+                if (!context_.parseResponse(buf, Timestamp()))
+                {
+                    ++stats_->errors;
+                    conn->forceClose();
+                    return;
+                }
+                if (!context_.gotAll())
+                {
+                    break;
+                }
+                int status = static_cast<int>(context_.response().statusCode());
+                if (status < 200 || status >= 300)
+                {
+                    ++stats_->non2xx;
+                }
+                context_.reset();
+                complete();
+            }
+        }
+        else
+        {
+            while (buf->readableBytes() > 0)
+            {
+                size_t n = std::min(buf->readableBytes(),
+                                    static_cast<size_t>(options_.messageSize) - echoReceived_);
+                buf->retrieve(n);
+                echoReceived_ += n;
+                if (echoReceived_ == static_cast<size_t>(options_.messageSize))
+                {
+                    echoReceived_ = 0;
+                    complete();
+                }
+            }
+        }
+        flush();
+    }
+
+    void complete()
+    {
+        if (inflight_.empty())
+        {
+            ++stats_->errors;
+            return;
+        }
+        int64_t scheduledNs = inflight_.front();
+        inflight_.pop_front();
+        --g_outstanding;
+        stats_->latency.record((monotonicNanos() - scheduledNs) / 1000);
+        ++stats_->completed;
+    }
+
+    EventLoop *loop_;
+    TcpClient client_;
+    const Options &options_;
+    const std::string &request_;
+    LoopStats *stats_;
+    TcpConnectionPtr conn_;
+    HttpContext context_;
+    size_t echoReceived_;
+    Buffer output_;
+    std::deque<int64_t> backlog_;  // 到了预定时刻但还没发出的请求
+    std::deque<int64_t> inflight_; // 已发出的请求的预定时刻, 响应按顺序返回
+    int64_t nextNs_;
+    int64_t intervalNs_;
+    int64_t endNs_;
+    bool running_;
+    bool everConnected_;
+};
+
+// 在loop线程里执行f并等它完成
+template <typename F>
+void runAndWait(EventLoop *loop, F f)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        f();
+                        done.set_value(); });
+    done.get_future().wait();
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t threads] [-c connections] [-d seconds] [-R rate] [-p depth]\n"
+                    "          [-m http|echo] [-P path] [-s size] host port\n",
+            prog);
+    exit(1);
+}
+
+// HdrHistogram风格的百分位分布: 每个"剩余一半"区间输出5个刻度
+void printDistribution(const Histogram &h)
+{
+    printf("%12s %14s %12s %18s\n", "Value(us)", "Percentile", "TotalCount", "1/(1-Percentile)");
+    const int kTicksPerHalf = 5;
+    // 分位再往上已经不到一个样本, 没有意义
+    double lastPercentile = 100.0 * (1.0 - 1.0 / std::max<int64_t>(h.count(), 1));
+    for (int half = 0; half < 30; ++half)
+    {
+        double base = 100.0 * (1.0 - pow(0.5, half));
+        double step = 100.0 * pow(0.5, half + 1) / kTicksPerHalf;
+        for (int tick = 0; tick < kTicksPerHalf; ++tick)
+        {
+            double p = base + tick * step;
+            if (p > lastPercentile)
+            {
+                half = 30;
+                break;
+            }
+            printf("%12lld %14.6f %12lld %18.2f\n",
+                   static_cast<long long>(h.percentile(p)), p / 100,
+                   static_cast<long long>(h.count() * p / 100), 1.0 / (1.0 - p / 100));
+        }
+    }
+    printf("%12lld %14.6f %12lld %18s\n", static_cast<long long>(h.max()), 1.0,
+           static_cast<long long>(h.count()), "inf");
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:d:R:p:m:P:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            options.threads = atoi(optarg);
+            break;
+        case 'c':
+            options.connections = atoi(optarg);
+            break;
+        case 'd':
+            options.duration = atof(optarg);
+            break;
+        case 'R':
+            options.rate = atof(optarg);
+            break;
+        case 'p':
+            options.depth = atoi(optarg);
+            break;
+        case 'm':
+            options.http = std::string(optarg) != "echo";
+            break;
+        case 'P':
+            options.path = optarg;
+            break;
+        case 's':
+            options.messageSize = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind + 2 != argc || options.threads < 1 || options.connections < 1 ||
+        options.depth < 1 || options.messageSize < 1 || options.duration <= 0)
+    {
+        usage(argv[0]);
+    }
+    options.host = argv[optind];
+    options.port = static_cast<uint16_t>(atoi(argv[optind + 1]));
+    Logger::instance().setMinLogLevel(LogLevel::ERROR);
+
+    std::string request;
+    if (options.http)
+    {
+        HttpRequest req;
+        req.setMethod(HttpRequest::kGet);
+        req.setPath(options.path);
+        req.setVersion(HttpRequest::kHttp11);
+        req.addHeader("Host", options.host);
+        Buffer buf;
+        req.appendToBuffer(&buf);
+        request = buf.retrieveAllAsString();
+    }
+    else
+    {
+        request.assign(options.messageSize, 'x');
+    }
+
+    EventLoop baseLoop;
+    EventLoopThreadPool pool(&baseLoop, "loadgen");
+    pool.setThreadNum(options.threads);
+    pool.start();
+    std::vector<EventLoop *> loops = pool.getAllLoops();
+    std::vector<std::unique_ptr<LoopStats>> stats;
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        stats.emplace_back(new LoopStats);
+    }
+
+    InetAddress serverAddr(options.port, options.host);
+    std::vector<std::unique_ptr<Session>> sessions;
+    for (int i = 0; i < options.connections; ++i)
+    {
+        size_t index = i % loops.size();
+        sessions.emplace_back(new Session(loops[index], serverAddr, options, request, stats[index].get(), i));
+        sessions.back()->connect();
+    }
+    for (int i = 0; i < 500 && g_connected < options.connections; ++i)
+    {
+        ::usleep(10 * 1000);
+    }
+    if (g_connected < options.connections)
+    {
+        fprintf(stderr, "only %d of %d connections established\n", g_connected.load(), options.connections);
+        return 1;
+    }
+
+    printf("Running %.0fs test @ %s:%d (%s)\n", options.duration, options.host.c_str(), options.port,
+           options.http ? ("GET " + options.path).c_str() : ("echo " + std::to_string(options.messageSize) + "B").c_str());
+    if (options.rate > 0)
+    {
+        printf("  %d threads and %d connections, pipeline depth %d, target %.0f req/s (open loop)\n",
+               options.threads, options.connections, options.depth, options.rate);
+    }
+    else
+    {
+        printf("  %d threads and %d connections, pipeline depth %d (closed loop)\n",
+               options.threads, options.connections, options.depth);
+    }
+
+    // 各连接的发送时刻错开, 合起来是均匀的options.rate
+    int64_t startNs = monotonicNanos() + 10 * 1000 * 1000;
+    int64_t endNs = startNs + static_cast<int64_t>(options.duration * 1e9);
+    int64_t intervalNs = options.rate > 0 ? static_cast<int64_t>(1e9 * options.connections / options.rate) : 0;
+    for (int i = 0; i < options.connections; ++i)
+    {
+        Session *session = sessions[i].get();
+        int64_t offset = intervalNs * i / options.connections;
+        loops[i % loops.size()]->runInLoop([session, startNs, offset, intervalNs, endNs]()
+                                           { session->begin(startNs + offset, intervalNs, endNs); });
+    }
+    ::usleep(static_cast<useconds_t>((endNs - monotonicNanos()) / 1000));
+
+    // 停止发送, 最多再等2秒让在途的请求完成
+    for (int i = 0; i < options.connections; ++i)
+    {
+        Session *session = sessions[i].get();
+        loops[i % loops.size()]->runInLoop([session]()
+                                           { session->finish(); });
+    }
+    int64_t drainDeadline = monotonicNanos() + 2000LL * 1000 * 1000;
+    while (g_outstanding > 0 && monotonicNanos() < drainDeadline)
+    {
+        ::usleep(1000);
+    }
+    double elapsed = (monotonicNanos() - startNs) / 1e9;
+
+    // 在各自的loop线程里汇总, 同时析构连接
+    Histogram latency;
+    LoopStats total;
+    int64_t unfinished = 0;
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        runAndWait(loops[i], [&]()
+                   {
+                       latency.merge(stats[i]->latency);
+                       total.completed += stats[i]->completed;
+                       total.bytesRead += stats[i]->bytesRead;
+                       total.errors += stats[i]->errors;
+                       total.non2xx += stats[i]->non2xx;
+                       total.unsent += stats[i]->unsent;
+                       for (int j = static_cast<int>(i); j < options.connections; j += static_cast<int>(loops.size()))
+                       {
+                           unfinished += sessions[j]->unfinished();
+                           sessions[j].reset();
+                       } });
+    }
+
+    printf("  Latency (us, from %s send time): %s\n", options.rate > 0 ? "scheduled" : "actual",
+           latency.toString().c_str());
+    printf("  %lld requests in %.2fs, %.2fMB read\n", static_cast<long long>(total.completed), elapsed,
+           total.bytesRead / 1024.0 / 1024.0);
+    if (total.errors > 0 || total.non2xx > 0 || unfinished > 0 || total.unsent > 0)
+    {
+        printf("  Errors: connection %lld, non-2xx %lld, unfinished %lld, unsent %lld\n",
+               static_cast<long long>(total.errors), static_cast<long long>(total.non2xx),
+               static_cast<long long>(unfinished), static_cast<long long>(total.unsent));
+    }
+    printf("Requests/sec: %.2f\n", total.completed / options.duration);
+    printf("Transfer/sec: %.2fMB\n\n", total.bytesRead / 1024.0 / 1024.0 / options.duration);
+    printDistribution(latency);
+    return 0;
+}